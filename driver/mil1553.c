@@ -35,6 +35,10 @@
 #include <linux/wait.h>
 #include <linux/mutex.h>
 #include <linux/debugfs.h>
+#include <linux/list.h>
+#include <linux/poll.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
 
 #include "mil1553.h"
 #include "mil1553P.h"
@@ -121,6 +125,12 @@ static char *ioctl_names[] = {
 
 	NAME(SET_TP),
 	NAME(GET_TP),
+	NAME(SEND_RECEIVE),
+	NAME(SUBSCRIBE),
+	NAME(XFER),
+	NAME(GET_RTI_GEN),
+	NAME(SYNC_SEND),
+	NAME(GET_BC_STATS),
 };
 
 /**
@@ -132,17 +142,30 @@ static char *ioctl_names[] = {
 
 struct mil1553_device_s *get_dev(int bc)
 {
-	int i;
-	struct mil1553_device_s *mdev;
+	if ((bc > 0) && (bc < MAX_DEVS))
+		return wa.bc_dev[bc];
+	return NULL;
+}
 
-	if (bc > 0) {
-		for (i=0; i<wa.bcs; i++) {
-			mdev = &(wa.mil1553_dev[i]);
-			if (mdev->bc == bc)
-				return mdev;
-		}
+/**
+ * =========================================================
+ * @brief Get the device a client wants to talk to
+ * @param client  The calling client
+ * @param bc      BC number from the ioctl argument
+ * @return Pointer to device if allowed, else NULL
+ *
+ * A client opened on /dev/mil1553.<bc> is bound to that BC,
+ * it may pass zero or its own BC number, nothing else.
+ */
+
+static struct mil1553_device_s *client_dev(struct client_s *client, int bc)
+{
+	if (client->mdev) {
+		if ((bc) && (bc != client->mdev->bc))
+			return NULL;
+		return client->mdev;
 	}
-	return NULL;
+	return get_dev(bc);
 }
 
 /**
@@ -377,6 +400,7 @@ static int int_timeout = CBMIA_INT_TIMEOUT;
 static int busy_timeout = INT_MISSING_TIMEOUT;
 static int rti_cooldown_us = DEFAULT_RTI_COOLDOWN_US;
 static int clear_missed_int = 0;
+static int read_share_us = 0;           /** Read sharing window, 0 is off */
 
 static int do_start_tx(struct mil1553_device_s *mdev, uint32_t txreg)
 {
@@ -387,6 +411,11 @@ static int do_start_tx(struct mil1553_device_s *mdev, uint32_t txreg)
 	struct tspoint *ts = &mdev->tspoints[mdev->tspidx];
 	struct timeval tv;
 
+	/* A broadcast is never repeated, it may already have been acted on */
+
+	if (rti == RTI_BROADCAST)
+		retries = 1;
+
 retries:
 	ts->rti = rti;
 	icnt = mdev->icnt;
@@ -425,6 +454,11 @@ retries:
 		mdev->checkpoints[rti].int_pending++;
 		if ((ISRC & ioread32be(&memory_map->isrc)) != 0)
 			mdev->checkpoints[rti].int_raised_and_pending++;
+		if (rti == RTI_BROADCAST) {
+			atomic_set(&mdev->int_busy, 0);  /** Nobody answers */
+			cc = 0;
+			goto exit;
+		}
 		if (--retries > 0)
 			goto retries;
 		else
@@ -445,14 +479,147 @@ exit:
 	return cc;
 }
 
-void update_rti_mask(struct mil1553_device_s *mdev, int rtin)
+/**
+ * =========================================================
+ * @brief Index of a device in the working area
+ * @param mdev    Device
+ * @return 0..MAX_DEVS-1, BC numbers may be larger so dont use them
+ */
+
+static inline int dev_index(struct mil1553_device_s *mdev)
 {
-	struct rti_interrupt_s *rti_interrupt = &mdev->rti_interrupt;
+	return mdev - wa.mil1553_dev;
+}
+
+/**
+ * =========================================================
+ * @brief Put an event on a clients queue and wake it up
+ * @param client  The client to notify
+ * @param evt     The event, copied onto the queue
+ *
+ * If the client doesn't read its queue the oldest entry is lost.
+ */
+
+static void post_client_event(struct client_s *client,
+			      struct rti_interrupt_s *evt)
+{
+	struct rx_queue_s *rx_queue = &client->rx_queue;
+	unsigned long flags;
+
+	spin_lock_irqsave(&rx_queue->lock, flags);
+	rx_queue->rti_interrupt[rx_queue->wp] = *evt;
+	rx_queue->wp = (rx_queue->wp + 1) % QSZ;
+	if (rx_queue->wp == rx_queue->rp)
+		rx_queue->rp = (rx_queue->rp + 1) % QSZ;
+	client->icnt++;
+	spin_unlock_irqrestore(&rx_queue->lock, flags);
+
+	wake_up_interruptible(&client->wait_queue);
+}
+
+/**
+ * =========================================================
+ * @brief Post an event to all clients subscribed to a bc/rti
+ * @param mdev    Device the event came from
+ * @param evt     The event, evt->event holds the EVT_xxx bits
+ *
+ * An rti_number of zero concerns the whole BC and goes to
+ * every client subscribed to any RTI on it.
+ */
+
+static void post_event(struct mil1553_device_s *mdev,
+		       struct rti_interrupt_s *evt)
+{
+	struct client_s *client;
+	uint32_t events, rti_subs, mask;
+	unsigned long flags;
+
+	mask = evt->rti_number ? 1 << evt->rti_number : ~0;
+	spin_lock_irqsave(&wa.clients_lock, flags);
+	list_for_each_entry(client, &wa.clients, list) {
+		events   = client->events[dev_index(mdev)];
+		rti_subs = client->rti_subs[dev_index(mdev)];
+		if ((events & evt->event) && (rti_subs & mask))
+			post_client_event(client, evt);
+	}
+	spin_unlock_irqrestore(&wa.clients_lock, flags);
+}
+
+/**
+ * =========================================================
+ * @brief Post an event that carries no data from the bus
+ * @param mdev    Device concerned
+ * @param rti     RTI concerned or zero for the BC
+ * @param event   EVT_xxx
+ */
+
+static void post_bc_event(struct mil1553_device_s *mdev,
+			  int rti, uint32_t event)
+{
+	struct rti_interrupt_s evt;
+
+	memset(&evt, 0, sizeof(evt));
+	evt.bc         = mdev->bc;
+	evt.rti_number = rti;
+	evt.event      = event;
+	post_event(mdev, &evt);
+}
+
+/**
+ * =========================================================
+ * @brief Mark an RTI up or down
+ * @param mdev    Device, bcdev held
+ * @param rtin    RTI 1..30
+ * @param up      Whether it answered
+ *
+ * Going down bumps the RTI generation, any change is posted
+ * as EVT_RTI_UP or EVT_RTI_DOWN.
+ */
 
-	if (!rti_interrupt->timeout)
+static void set_rti_up(struct mil1553_device_s *mdev, int rtin, int up)
+{
+	uint32_t up_rtis = mdev->up_rtis;
+
+	if (up)
 		mdev->up_rtis |= 1 << rtin;
-	if (!rti_interrupt->packet_ok || rti_interrupt->timeout)
+	else
 		mdev->up_rtis &= ~(1 << rtin);
+
+	if (mdev->up_rtis != up_rtis) {
+		if (!up)
+			mdev->rti_gen[rtin]++;
+		post_bc_event(mdev, rtin, up ? EVT_RTI_UP : EVT_RTI_DOWN);
+	}
+}
+
+void update_rti_mask(struct mil1553_device_s *mdev, int rtin)
+{
+	struct rti_interrupt_s *rti_interrupt = &mdev->rti_interrupt;
+
+	set_rti_up(mdev, rtin, rti_interrupt->packet_ok && !rti_interrupt->timeout);
+}
+
+/**
+ * =========================================================
+ * @brief Keep up_rtis current from the frames sent
+ * @param mdev    Device, bcdev held
+ * @param rti     RTI the frame went to
+ * @param cc      Result of the frame
+ *
+ * Every frame tells whether its RTI answers, as a ping does, so
+ * an RTI that stops answering is seen going down at its next
+ * frame and not only at the next scan. A frame that never
+ * completed (-EBUSY) counts as not answered.
+ */
+
+static void frame_rti_status(struct mil1553_device_s *mdev, int rti, int cc)
+{
+	if ((rti < 1) || (rti > 30))
+		return;
+	if (cc == -EBUSY)
+		set_rti_up(mdev, rti, 0);
+	else
+		update_rti_mask(mdev, rti);
 }
 
 static void ping_rtis(struct mil1553_device_s *mdev)
@@ -665,6 +832,33 @@ static void encode_txreg(unsigned int *txreg,
 		       | ((rti << TXREG_RTI_SHIFT)  & TXREG_RTI_MASK);
 }
 
+/**
+ * =========================================================
+ * @brief Number of data words the BC puts on the bus for a frame
+ * @param wc   Word count or mode code number when sa is 0 or 31
+ * @param sa   Sub-address
+ * @param tr   1 when the RTI transmits, 0 when it receives
+ * @return 0..TX_BUF_SIZE
+ *
+ * When the RTI transmits, the BC only sends the command word.
+ * Mode codes 16..31 carry a single data word, lower ones none.
+ */
+
+#define SA_MODE_0  0
+#define SA_MODE_31 31
+#define MODE_DATA  16
+
+static int tx_data_words(int wc, int sa, int tr)
+{
+	if (tr)
+		return 0;
+	if ((sa == SA_MODE_0) || (sa == SA_MODE_31))
+		return ((wc & 0x1F) >= MODE_DATA) ? 1 : 0;
+	if (wc > TX_BUF_SIZE)
+		return TX_BUF_SIZE;
+	return wc;
+}
+
 static void dump_buf(unsigned short *buf, int wc)
 {
 	int i;
@@ -680,53 +874,240 @@ static void dump_buf(unsigned short *buf, int wc)
 	printk("\n");
 }
 
-static int send_receive(struct mil1553_device_s *mdev,
-			int rti, int sent_wc, int sa, int tr,
-			int wants_reply,
-			unsigned short *rxbuf,
-			unsigned short *txbuf,
-			int *received_wc)
+/**
+ * =========================================================
+ * @brief Decode the RTI status word of a completed frame
+ * @param mdev    Device that did the transaction
+ * @param rti     RTI that was addressed
+ * @param str     First word of the reply
+ *
+ * When the RTI raises SR or TB an event is posted for each
+ * completed frame that carries the bit, so a client waiting
+ * on its queue sees the equipment as soon as the bus does.
+ */
+
+static void check_rti_status(struct mil1553_device_s *mdev,
+			     int rti, unsigned short str)
 {
-	uint32_t		txreg;
-	uint32_t		*regp, reg;
-	int			i, cc;
-	struct rti_interrupt_s	*rti_interrupt = &mdev->rti_interrupt;
-	struct memory_map_s	*memory_map = mdev->memory_map;
-	struct timeval		start, end;
-	uint64_t		elapsed_ns;
+	struct rti_interrupt_s evt;
+	uint32_t events = 0;
 
-	if (debug_msg)
-	printk(KERN_ERR PFX "calling send_receive "
-		"%d:%d wc:%d sa:%d tr:%d %s\n",
-		mdev->bc, rti, sent_wc, sa, tr,
-		wants_reply? "reply" : "noreply");
-	do_gettimeofday(&start);
-	mutex_lock_interruptible(&mdev->bcdev);
-	encode_txreg(&txreg, sent_wc, sa, tr, rti);
-	if (sent_wc > TX_BUF_SIZE)
-		sent_wc = TX_BUF_SIZE;
-	regp = (uint32_t *) memory_map->txbuf;
-	for (i=0; i < (sent_wc + 1) / 2; i++) {
+	if (((str & RTI_STR_RTI_MASK) >> RTI_STR_RTI_SHIFT) != rti)
+		return;
+	if (str & RTI_STR_SR)
+		events |= EVT_SR;
+	if (str & RTI_STR_TB)
+		events |= EVT_TB;
+	if (!events)
+		return;
+
+	memset(&evt, 0, sizeof(evt));
+	evt.bc             = mdev->bc;
+	evt.rti_number     = rti;
+	evt.packet_ok      = 1;
+	evt.rxbuf_rti_stat = str;
+	evt.event          = events;
+
+	mdev->str_events++;
+	post_event(mdev, &evt);
+}
+
+#define RXBUF_REGS ((RX_BUF_SIZE + 1) / 2)  /** 32 bit registers an rxbuf fills */
+
+/**
+ * =========================================================
+ * Read sharing.
+ * A register read (CSR, signature or the STR mode code) that is
+ * identical to one queued or in flight on the BC, claimed less than
+ * read_share_us ago, is not sent again: the requester waits for that
+ * frame and gets a copy of its reply. Once done, the reply still answers
+ * identical reads inside the same window. Any other frame to the RTI
+ * drops its replies. Buffer reads move the RTI buffer pointer, so two
+ * identical ones return different data and are never shared.
+ */
+
+#define RD_SHARE_WAIT_MS 100
+
+#define SA_CSR_REG       1
+#define SA_SIGNATURE_REG 30
+#define MODE_READ_STR    1
+
+static uint64_t now_ns(void)
+{
+	struct timeval tv;
+
+	do_gettimeofday(&tv);
+	return timeval_to_ns(&tv);
+}
+
+static int read_shareable(int wc, int sa, int tr, int wants_reply)
+{
+	if (!read_share_us || !tr || !wants_reply)
+		return 0;
+	return (sa == SA_CSR_REG) || (sa == SA_SIGNATURE_REG)
+	    || (((sa == SA_MODE_0) || (sa == SA_MODE_31)) && (wc == MODE_READ_STR));
+}
+
+static void read_share_copy(struct rd_share_s *rs,
+			    unsigned short *rxbuf, int *received_wc)
+{
+	memcpy(rxbuf, rs->rxbuf, rs->wc * sizeof(short));
+	*received_wc = rs->wc;
+}
+
+/**
+ * @brief Look for a frame to share before doing a read
+ * @return 1 if rxbuf was filled from another frame, else 0 and
+ *         *claim is where to publish the reply of this one, or NULL
+ */
+
+static int read_share_join(struct mil1553_device_s *mdev, uint32_t txreg,
+			   unsigned short *rxbuf, int *received_wc,
+			   struct rd_share_s **claim)
+{
+	struct rd_share_s *rs, *found = NULL, *free = NULL;
+	uint64_t now = now_ns();
+	uint64_t window = (uint64_t) read_share_us * 1000;
+	uint32_t gen;
+	int i, hit = 0;
+
+	*claim = NULL;
+	spin_lock(&mdev->rd_lock);
+	for (i = 0; i < RD_SHARE_SLOTS; i++) {
+		rs = &mdev->rd_share[i];
+		if (rs->txreg == txreg)
+			found = rs;
+		else if (!rs->busy && !rs->waiters
+		     &&  (!free || rs->claim_ns < free->claim_ns))
+			free = rs;
+	}
+
+	if (found && (now - found->claim_ns <= window)) {
+		if (!found->busy) {
+			read_share_copy(found, rxbuf, received_wc);
+			mdev->rd_fresh_hits++;
+			spin_unlock(&mdev->rd_lock);
+			return 1;
+		}
+		gen = found->gen;
+		found->waiters++;
+		spin_unlock(&mdev->rd_lock);
+
+		wait_event_interruptible_timeout(mdev->rd_wq,
+			found->gen != gen, msecs_to_jiffies(RD_SHARE_WAIT_MS));
+
+		spin_lock(&mdev->rd_lock);
+		found->waiters--;
+		if ((found->gen != gen) && (found->txreg == txreg)) {
+			read_share_copy(found, rxbuf, received_wc);
+			mdev->rd_attach_hits++;
+			hit = 1;
+		}
+		spin_unlock(&mdev->rd_lock);
+		return hit;
+	}
+
+	if (found && !found->busy)
+		free = found;
+	else if (found)
+		free = NULL;            /** Stale but still busy, don't publish */
+	if (free) {
+		free->txreg    = txreg;
+		free->busy     = 1;
+		free->claim_ns = now;
+		*claim = free;
+	}
+	spin_unlock(&mdev->rd_lock);
+	return 0;
+}
+
+static void read_share_done(struct mil1553_device_s *mdev,
+			    struct rd_share_s *rs, int cc,
+			    unsigned short *rxbuf, int received_wc)
+{
+	spin_lock(&mdev->rd_lock);
+	if (cc == 0) {
+		if (received_wc > RX_BUF_SIZE)
+			received_wc = RX_BUF_SIZE;
+		memcpy(rs->rxbuf, rxbuf, received_wc * sizeof(short));
+		rs->wc = received_wc;
+	} else
+		rs->txreg = 0;
+	rs->busy = 0;
+	rs->gen++;
+	spin_unlock(&mdev->rd_lock);
+	wake_up_interruptible_all(&mdev->rd_wq);
+}
+
+static void read_share_forget(struct mil1553_device_s *mdev, uint32_t txreg)
+{
+	struct rd_share_s *rs;
+	int i, rti = (txreg & TXREG_RTI_MASK) >> TXREG_RTI_SHIFT;
+
+	spin_lock(&mdev->rd_lock);
+	for (i = 0; i < RD_SHARE_SLOTS; i++) {
+		rs = &mdev->rd_share[i];
+		if (!rs->busy
+		&&  ((rti == RTI_BROADCAST)
+		||   ((rs->txreg & TXREG_RTI_MASK) == (txreg & TXREG_RTI_MASK))))
+			rs->txreg = 0;
+	}
+	spin_unlock(&mdev->rd_lock);
+}
+
+/**
+ * =========================================================
+ * @brief Write the data words of a frame to TXBUF
+ * @param mdev     Device, bcdev held
+ * @param txbuf    Frame data
+ * @param sent_wc  Frame word count
+ *
+ * Only the words that go on the wire are written.
+ */
+
+static void write_txbuf(struct mil1553_device_s *mdev,
+			unsigned short *txbuf, int sent_wc, int sa, int tr)
+{
+	uint32_t *regp, reg;
+	int i, n, tx_wc;
+
+	tx_wc = tx_data_words(sent_wc, sa, tr);
+	n = (tx_wc + 1) / 2;
+	mdev->tx_mmio_saved += (sent_wc + 1) / 2 - n;
+	regp = (uint32_t *) mdev->memory_map->txbuf;
+	for (i=0; i < n; i++) {
 		reg  = txbuf[i*2 + 1] << 16;
 		reg |= txbuf[i*2 + 0] & 0xFFFF;
 		iowrite32be(reg, &regp[i]);
 	}
 	if (debug_msg) {
 		printk(KERN_ERR PFX "sending txbuf\n");
-		dump_buf(txbuf, sent_wc);
+		dump_buf(txbuf, tx_wc);
 	}
-	cc = do_start_tx(mdev, txreg);
-	if (cc)
-		goto exit;
+}
 
-	if (!wants_reply)
-		goto exit;
+/**
+ * =========================================================
+ * @brief Read the reply of the last frame from RXBUF
+ * @param mdev         Device, bcdev held and interrupt done
+ * @param rti          RTI the frame was sent to
+ * @param rxbuf        Status word then data
+ * @param received_wc  Words in rxbuf
+ * @return 0 or -ETIME if no RTI answered
+ */
+
+static int read_reply(struct mil1553_device_s *mdev, int rti,
+		      unsigned short *rxbuf, int *received_wc)
+{
+	struct rti_interrupt_s	*rti_interrupt = &mdev->rti_interrupt;
+	struct memory_map_s	*memory_map = mdev->memory_map;
+	uint32_t		*regp, reg;
+	int			i, n;
 
 	memset(rxbuf, 0, sizeof(rxbuf));
-	if (rti_interrupt->rti_number == 0) {
-		cc = -ETIME;
-		goto exit;
-	} else if (rti_interrupt->rti_number != rti) {
+	if (rti_interrupt->rti_number == 0)
+		return -ETIME;
+	else if (rti_interrupt->rti_number != rti) {
 		printk(KERN_ERR PFX "wrong rti expected %d, got %d replied\n",
 		rti, rti_interrupt->rti_number);
 	}
@@ -744,7 +1125,10 @@ static int send_receive(struct mil1553_device_s *mdev,
 			}
 		}
 	}
-	for (i = 0; i < (rti_interrupt->wc + 1) / 2 ; i++) {
+	n = (rti_interrupt->wc + 1) / 2;
+	if (n > RXBUF_REGS)
+		n = RXBUF_REGS;
+	for (i = 0; i < n; i++) {
 	       reg  = ioread32be(&regp[i]);
 	       rxbuf[i*2 + 1] = reg >> 16;
 	       rxbuf[i*2 + 0] = reg & 0xFFFF;
@@ -753,13 +1137,382 @@ static int send_receive(struct mil1553_device_s *mdev,
 		printk(KERN_ERR PFX "received rxbuf\n");
 		dump_buf(rxbuf, rti_interrupt->wc);
 	}
+	if (rti_interrupt->wc)
+		check_rti_status(mdev, rti, rxbuf[0]);
+	return 0;
+}
+
+static int send_receive(struct mil1553_device_s *mdev,
+			int rti, int sent_wc, int sa, int tr,
+			int wants_reply,
+			unsigned short *rxbuf,
+			unsigned short *txbuf,
+			int *received_wc)
+{
+	uint32_t		txreg;
+	int			cc;
+	struct timeval		start, end;
+	uint64_t		elapsed_ns;
+	struct rd_share_s	*share = NULL;
+
+	if (debug_msg)
+	printk(KERN_ERR PFX "calling send_receive "
+		"%d:%d wc:%d sa:%d tr:%d %s\n",
+		mdev->bc, rti, sent_wc, sa, tr,
+		wants_reply? "reply" : "noreply");
+
+	/* Broadcast: no status word comes back and RTIs can't transmit */
+
+	if (rti == RTI_BROADCAST) {
+		if (tr && (sa != SA_MODE_0) && (sa != SA_MODE_31))
+			return -EINVAL;
+		wants_reply = 0;
+		*received_wc = 0;
+		mdev->bcast_frames++;
+	}
+	encode_txreg(&txreg, sent_wc, sa, tr, rti);
+	if (read_shareable(sent_wc, sa, tr, wants_reply)) {
+		if (read_share_join(mdev, txreg, rxbuf, received_wc, &share))
+			return 0;
+	} else if (read_share_us)
+		read_share_forget(mdev, txreg);
+
+	do_gettimeofday(&start);
+	mutex_lock_interruptible(&mdev->bcdev);
+	if (sent_wc > TX_BUF_SIZE)
+		sent_wc = TX_BUF_SIZE;
+
+	write_txbuf(mdev, txbuf, sent_wc, sa, tr);
+	cc = do_start_tx(mdev, txreg);
+	frame_rti_status(mdev, rti, cc);
+	if (cc)
+		goto exit;
+
+	if (!wants_reply)
+		goto exit;
+
+	cc = read_reply(mdev, rti, rxbuf, received_wc);
 exit:
 	do_gettimeofday(&end);
 	elapsed_ns = timeval_to_ns(&end) - timeval_to_ns(&start);
 	mutex_unlock(&mdev->bcdev);
+	if (share)
+		read_share_done(mdev, share, cc, rxbuf, *received_wc);
+	return cc;
+}
+
+/**
+ * =========================================================
+ * @brief Work function, executes the items on a BC tx_queue
+ * @param work    The devices tx_work
+ *
+ * Each item is done with send_receive and its result queued
+ * as a TX_END event on the client that sent it. Items whose
+ * client has gone away have a NULL client and are dropped.
+ */
+
+static void tx_queue_work(struct work_struct *work)
+{
+	struct mil1553_device_s *mdev;
+	struct tx_queue_s *tx_queue;
+	struct tx_item_s tx_item;
+	struct rti_interrupt_s evt;
+	unsigned short rxbuf[RX_BUF_SIZE+1];
+	unsigned int wc, sa, tr;
+	int i, cc, received_wc;
+
+	mdev = container_of(work, struct mil1553_device_s, tx_work);
+	tx_queue = mdev->tx_queue;
+
+	while (1) {
+		spin_lock_irq(&tx_queue->lock);
+		if (tx_queue->rp == tx_queue->wp) {
+			spin_unlock_irq(&tx_queue->lock);
+			break;
+		}
+		tx_item = tx_queue->tx_item[tx_queue->rp];
+		tx_queue->rp = (tx_queue->rp + 1) % QSZ;
+		spin_unlock_irq(&tx_queue->lock);
+
+		if (!tx_item.client)
+			continue;
+
+		wc = get_wc(tx_item.txreg);
+		sa = (tx_item.txreg & TXREG_SUBA_MASK) >> TXREG_SUBA_SHIFT;
+		tr = (tx_item.txreg & TXREG_TR_MASK) >> TXREG_TR_SHIFT;
+
+		received_wc = 0;
+		memset(rxbuf, 0, sizeof(rxbuf));
+		cc = send_receive(mdev, tx_item.rti_number, wc, sa, tr,
+				  !tx_item.no_reply,
+				  rxbuf, tx_item.txbuf, &received_wc);
+		mdev->tx_count++;
+		if (tx_item.no_reply)
+			continue;
+
+		memset(&evt, 0, sizeof(evt));
+		evt.bc         = mdev->bc;
+		evt.rti_number = tx_item.rti_number;
+		evt.wc         = received_wc;
+		evt.packet_ok  = (cc == 0);
+		evt.status     = -cc;
+		evt.event      = TX_END;
+		if (received_wc)
+			evt.rxbuf_rti_stat = rxbuf[0];
+		for (i=0; i<RX_BUF_SIZE+1; i++)
+			evt.rxbuf[i] = rxbuf[i];
+		post_client_event(tx_item.client, &evt);
+	}
+}
+
+/**
+ * =========================================================
+ * @brief Put a clients tx items on the BC queues and start them
+ * @param client  The sending client
+ * @param send    Count and user space array of items
+ * @return 0 or negative error
+ *
+ * Returns at once, completions arrive on the clients queue.
+ * Either all the items are queued or none is, if a BC queue
+ * has no room for its items -EBUSY is returned, so a caller
+ * never has completions of a failed send coming. Only senders
+ * fill the queues and they hold send_lock, so the room found
+ * can't shrink before the items are queued.
+ */
+
+static int queue_send(struct client_s *client, struct mil1553_send_s *send)
+{
+	struct mil1553_tx_item_s *items;
+	struct mil1553_device_s *mdev;
+	struct tx_queue_s *tx_queue;
+	struct tx_item_s *tx_item;
+	int needed[MAX_DEVS];
+	int i, n, cc = 0;
+
+	if (send->item_count > MAX_DEVS * QSZ)
+		return -EBUSY;
+	n = send->item_count;
+	if (n == 0)
+		return 0;
+	items = kmalloc(n * sizeof(*items), GFP_KERNEL);
+	if (!items)
+		return -ENOMEM;
+	if (copy_from_user(items, send->tx_item_array, n * sizeof(*items))) {
+		cc = -EFAULT;
+		goto exit;
+	}
+
+	memset(needed, 0, sizeof(needed));
+	for (i=0; i<n; i++) {
+		if ((mdev = client_dev(client, items[i].bc)) == NULL) {
+			cc = -EFAULT;
+			goto exit;
+		}
+		needed[dev_index(mdev)]++;
+	}
+
+	if (mutex_lock_interruptible(&wa.send_lock)) {
+		cc = -EINTR;
+		goto exit;
+	}
+	for (i=0; i<wa.bcs; i++) {
+		tx_queue = wa.mil1553_dev[i].tx_queue;
+		spin_lock_irq(&tx_queue->lock);
+		if (needed[i]
+		&&  ((tx_queue->wp + QSZ - tx_queue->rp) % QSZ + needed[i] >= QSZ))
+			cc = -EBUSY;
+		spin_unlock_irq(&tx_queue->lock);
+	}
+	for (i=0; (i<n) && !cc; i++) {
+		mdev = client_dev(client, items[i].bc);
+		tx_queue = mdev->tx_queue;
+		spin_lock_irq(&tx_queue->lock);
+		tx_item = &tx_queue->tx_item[tx_queue->wp];
+		tx_item->no_reply   = items[i].no_reply;
+		tx_item->pk_type    = TX_END;
+		tx_item->client     = client;
+		tx_item->bc         = items[i].bc;
+		tx_item->rti_number = items[i].rti_number;
+		tx_item->txreg      = items[i].txreg;
+		memcpy(tx_item->txbuf, items[i].txbuf, sizeof(tx_item->txbuf));
+		tx_queue->wp = (tx_queue->wp + 1) % QSZ;
+		spin_unlock_irq(&tx_queue->lock);
+
+		schedule_work(&mdev->tx_work);
+	}
+	mutex_unlock(&wa.send_lock);
+exit:
+	kfree(items);
+	return cc;
+}
+
+/**
+ * =========================================================
+ * @brief Start one frame on each of several BCs together
+ * @param client  The sending client
+ * @param sync    Count and user space array of items, skew back
+ * @return 0 or negative error
+ *
+ * The BCs are locked in device order and armed: idle, TXBUF
+ * written. The TXREGs are then written back to back with local
+ * interrupts off and the completions queued as TX_END events,
+ * as for MIL1553_SEND. A frame is never repeated, the others
+ * have already started. If arming fails nothing is sent.
+ */
+
+static int sync_send(struct client_s *client, struct mil1553_sync_send_s *sync)
+{
+	struct mil1553_tx_item_s *items;
+	struct mil1553_device_s *mdev, *devs[MAX_DEVS];
+	struct rti_interrupt_s evt;
+	unsigned short rxbuf[RX_BUF_SIZE+1];
+	unsigned int wc, sa, tr, rti;
+	int order[MAX_DEVS], status[MAX_DEVS];
+	int i, j, k, n, cc = 0, armed = 0, received_wc;
+	unsigned long flags;
+	uint64_t first = 0, last = 0;
+
+	n = sync->item_count;
+	if ((n <= 0) || (n > MAX_DEVS))
+		return -EINVAL;
+	items = kmalloc(n * sizeof(*items), GFP_KERNEL);
+	if (!items)
+		return -ENOMEM;
+	if (copy_from_user(items, sync->tx_item_array, n * sizeof(*items))) {
+		cc = -EFAULT;
+		goto exit;
+	}
+
+	/* One item per BC, sorted by device so two callers can't deadlock */
+
+	for (i=0; i<n; i++) {
+		if ((devs[i] = client_dev(client, items[i].bc)) == NULL) {
+			cc = -EFAULT;
+			goto exit;
+		}
+		for (j=i; j>0; j--) {
+			if (devs[order[j-1]] == devs[i]) {
+				cc = -EINVAL;
+				goto exit;
+			}
+			if (dev_index(devs[order[j-1]]) < dev_index(devs[i]))
+				break;
+			order[j] = order[j-1];
+		}
+		order[j] = i;
+	}
+
+	for (armed=0; armed<n; armed++) {
+		k = order[armed];
+		mdev = devs[k];
+		if (mutex_lock_interruptible(&mdev->bcdev)) {
+			cc = -EINTR;
+			goto unlock;
+		}
+		wait_event_interruptible_timeout(mdev->int_complete,
+			!atomic_read(&mdev->int_busy), msecs_to_jiffies(busy_timeout));
+		if (atomic_read(&mdev->int_busy)
+		||  (ioread32be(&mdev->memory_map->hstat) & HSTAT_BUSY_BIT)) {
+			mutex_unlock(&mdev->bcdev);
+			cc = -EBUSY;
+			goto unlock;
+		}
+		wc = get_wc(items[k].txreg);
+		sa = (items[k].txreg & TXREG_SUBA_MASK) >> TXREG_SUBA_SHIFT;
+		tr = (items[k].txreg & TXREG_TR_MASK) >> TXREG_TR_SHIFT;
+		write_txbuf(mdev, items[k].txbuf, wc, sa, tr);
+		if (read_share_us)
+			read_share_forget(mdev, items[k].txreg);
+	}
+	udelay(rti_cooldown_us);
+
+	local_irq_save(flags);
+	for (i=0; i<n; i++) {
+		mdev = devs[order[i]];
+		atomic_set(&mdev->int_busy, 1);
+		iowrite32be(items[order[i]].txreg, &mdev->memory_map->txreg);
+		last = ktime_to_ns(ktime_get());
+		if (i == 0)
+			first = last;
+	}
+	local_irq_restore(flags);
+	sync->skew_ns = last - first;
+	udelay(8*TX_WAIT_US);
+
+	for (i=0; i<n; i++) {
+		k = order[i];
+		mdev = devs[k];
+		rti = (items[k].txreg & TXREG_RTI_MASK) >> TXREG_RTI_SHIFT;
+		mdev->tx_count++;
+		mdev->sync_frames++;
+		if (sync->skew_ns > mdev->sync_skew_max_ns)
+			mdev->sync_skew_max_ns = sync->skew_ns;
+
+		wait_event_interruptible_timeout(mdev->int_complete,
+			!atomic_read(&mdev->int_busy), msecs_to_jiffies(int_timeout));
+		received_wc = 0;
+		memset(rxbuf, 0, sizeof(rxbuf));
+		if (rti == RTI_BROADCAST) {
+			mdev->bcast_frames++;
+			atomic_set(&mdev->int_busy, 0);  /** Nobody answers */
+			status[k] = 0;
+		} else if (atomic_read(&mdev->int_busy)) {
+			mdev->checkpoints[rti].int_pending++;
+			status[k] = -EBUSY;
+		} else
+			status[k] = read_reply(mdev, rti, rxbuf, &received_wc);
+		frame_rti_status(mdev, rti, status[k]);
+
+		if (items[k].no_reply)
+			continue;
+		memset(&evt, 0, sizeof(evt));
+		evt.bc         = mdev->bc;
+		evt.rti_number = rti;
+		evt.wc         = received_wc;
+		evt.packet_ok  = (status[k] == 0);
+		evt.status     = -status[k];
+		evt.event      = TX_END;
+		if (received_wc)
+			evt.rxbuf_rti_stat = rxbuf[0];
+		for (j=0; j<RX_BUF_SIZE+1; j++)
+			evt.rxbuf[j] = rxbuf[j];
+		post_client_event(client, &evt);
+	}
+
+unlock:
+	while (armed-- > 0)
+		mutex_unlock(&devs[order[armed]]->bcdev);
+exit:
+	kfree(items);
 	return cc;
 }
 
+/**
+ * =========================================================
+ * @brief Forget a closing clients pending tx items
+ * @param client  The client being closed
+ *
+ * On return no work function is still using the client.
+ */
+
+static void purge_tx_items(struct client_s *client)
+{
+	struct mil1553_device_s *mdev;
+	struct tx_queue_s *tx_queue;
+	int i, rp;
+
+	for (i=0; i<wa.bcs; i++) {
+		mdev = &wa.mil1553_dev[i];
+		tx_queue = mdev->tx_queue;
+		spin_lock_irq(&tx_queue->lock);
+		for (rp = tx_queue->rp; rp != tx_queue->wp; rp = (rp + 1) % QSZ)
+			if (tx_queue->tx_item[rp].client == client)
+				tx_queue->tx_item[rp].client = NULL;
+		spin_unlock_irq(&tx_queue->lock);
+		flush_work(&mdev->tx_work);
+	}
+}
+
 int get_unused_bc(void)
 {
 
@@ -786,23 +1539,38 @@ int get_unused_bc(void)
  * Open
  * Allocate a client context and initialize it
  * Place pointer to client in the file private data pointer
+ * Minor zero is /dev/mil1553 for all BCs, minor <bc> is
+ * /dev/mil1553.<bc> and binds the client to that BC.
  */
 
 int mil1553_open(struct inode *inode, struct file *filp)
 {
 
 	struct client_s *client;
+	struct mil1553_device_s *mdev = NULL;
+	int minor = iminor(inode);
+
+	if (minor) {
+		mdev = get_dev(minor);
+		if (!mdev)
+			return -ENODEV;
+	}
 
 	client = kmalloc(sizeof(struct client_s),GFP_KERNEL);
 	if (client == NULL)
 		return -ENOMEM;
 
 	memset(client,0,sizeof(struct client_s));
+	client->mdev = mdev;
 
 	init_waitqueue_head(&client->wait_queue);
 	client->timeout = msecs_to_jiffies(RTI_TIMEOUT);
 	spin_lock_init(&client->rx_queue.lock);
 
+	spin_lock_irq(&wa.clients_lock);
+	list_add_tail(&client->list, &wa.clients);
+	spin_unlock_irq(&wa.clients_lock);
+
 	filp->private_data = client;
 	return 0;
 }
@@ -827,12 +1595,144 @@ int mil1553_close(struct inode *inode, struct file *filp)
 			if (mdev)
 				mutex_unlock(&mdev->bc_lock);
 		}
+		spin_lock_irq(&wa.clients_lock);
+		list_del(&client->list);
+		spin_unlock_irq(&wa.clients_lock);
+		purge_tx_items(client);
 		kfree(client);
 		filp->private_data = NULL;
 	}
 	return 0;
 }
 
+/**
+ * =========================================================
+ * @brief Number of events waiting on a clients queue
+ */
+
+static int rx_queue_count(struct client_s *client)
+{
+	struct rx_queue_s *rx_queue = &client->rx_queue;
+
+	return (rx_queue->wp + QSZ - rx_queue->rp) % QSZ;
+}
+
+/**
+ * =========================================================
+ * @brief Take the next event off a clients queue
+ * @param client  The calling client
+ * @param recv    Receives the event
+ * @return 0 or -EAGAIN if the queue is empty
+ */
+
+static int pop_client_event(struct client_s *client,
+			    struct mil1553_recv_s *recv)
+{
+	struct rx_queue_s *rx_queue = &client->rx_queue;
+	struct mil1553_rti_interrupt_s *uevt = &recv->interrupt;
+	struct rti_interrupt_s evt;
+	int i;
+
+	spin_lock_irq(&rx_queue->lock);
+	if (rx_queue->rp == rx_queue->wp) {
+		spin_unlock_irq(&rx_queue->lock);
+		return -EAGAIN;
+	}
+	evt = rx_queue->rti_interrupt[rx_queue->rp];
+	rx_queue->rp = (rx_queue->rp + 1) % QSZ;
+	spin_unlock_irq(&rx_queue->lock);
+
+	recv->pk_type    = evt.event;
+	recv->icnt       = client->icnt;
+	uevt->bc         = evt.bc;
+	uevt->rti_number = evt.rti_number;
+	uevt->wc         = evt.wc;
+	uevt->str        = evt.rxbuf_rti_stat;
+	uevt->status     = evt.status;
+	for (i=0; i<RX_BUF_SIZE+1; i++)
+		uevt->rxbuf[i] = evt.rxbuf[i];
+	return 0;
+}
+
+/**
+ * =========================================================
+ * @brief Wait for and read the next event on a clients queue
+ * @param client  The calling client
+ * @param recv    Receives the event, recv->timeout in msec or zero
+ * @return 0 or negative error
+ *
+ * A zero timeout uses the clients timeout, if that is zero
+ * too the call waits forever.
+ */
+
+static int recv_client_event(struct client_s *client,
+			     struct mil1553_recv_s *recv)
+{
+	unsigned long tmo;
+	int cc;
+
+	tmo = recv->timeout ? msecs_to_jiffies(recv->timeout) : client->timeout;
+	if (tmo) {
+		cc = wait_event_interruptible_timeout(client->wait_queue,
+				rx_queue_count(client), tmo);
+		if (cc == 0)
+			return -ETIME;
+	} else
+		cc = wait_event_interruptible(client->wait_queue,
+				rx_queue_count(client));
+	if (cc < 0)
+		return -EINTR;
+
+	return pop_client_event(client, recv);
+}
+
+/**
+ * =========================================================
+ * @brief Compact send/receive, only wc words cross to and from user
+ * @param client  The calling client
+ * @param xfer    Descriptor, already copied in by the ioctl
+ * @return 0 or negative error
+ */
+
+static int do_xfer(struct client_s *client, struct mil1553_xfer_s *xfer)
+{
+	struct mil1553_device_s *mdev;
+	unsigned short txbuf[TX_BUF_SIZE];
+	unsigned short rxbuf[RX_BUF_SIZE+1];
+	void __user *utxbuf = (void __user *) (unsigned long) xfer->txbuf;
+	void __user *urxbuf = (void __user *) (unsigned long) xfer->rxbuf;
+	int cc, wc, tx_wc, received_wc = 0;
+
+	if (xfer->version != MIL1553_XFER_VERSION)
+		return -EINVAL;
+	if ((mdev = client_dev(client, xfer->bc)) == NULL)
+		return -EFAULT;
+	wc = xfer->wc;
+	if ((wc <= 0) || (wc > TX_BUF_SIZE))
+		return -EINVAL;
+
+	memset(txbuf, 0, sizeof(txbuf));
+	tx_wc = tx_data_words(wc, xfer->sa, xfer->tr);
+	if (utxbuf && tx_wc
+	&&  copy_from_user(txbuf, utxbuf, tx_wc * sizeof(short)))
+		return -EFAULT;
+
+	memset(rxbuf, 0, sizeof(rxbuf));
+	cc = send_receive(mdev, xfer->rti, wc, xfer->sa, xfer->tr,
+			  xfer->flags & XFER_REPLY,
+			  rxbuf, txbuf, &received_wc);
+	xfer->received_wc = 0;
+	if (cc || !(xfer->flags & XFER_REPLY))
+		return cc;
+
+	if (received_wc > wc + 1)
+		received_wc = wc + 1;
+	if (urxbuf && copy_to_user(urxbuf, rxbuf, received_wc * sizeof(short)))
+		return -EFAULT;
+	xfer->received_wc = received_wc;
+	return 0;
+}
+
 /**
  * =========================================================
  * Ioctl
@@ -849,17 +1749,20 @@ int mil1553_ioctl(struct inode *inode, struct file *filp,
 
 	struct memory_map_s *memory_map;
 
-	int bc, cc = 0;
+	int i, bc, cc = 0;
 	unsigned int cnt, blen;
 
 	uint32_t reg, tp;
 
-	unsigned long *ularg;
+	unsigned long *ularg, flags;
 
 	struct mil1553_riob_s       *riob;
 	struct mil1553_device_s     *mdev;
 	struct mil1553_dev_info_s   *dev_info;
 	struct mil1553_send_recv_s  *sr;
+	struct mil1553_subscribe_s  *sub;
+	struct mil1553_rti_gen_s    *gen;
+	struct mil1553_bc_stats_s   *stats;
 
 	struct client_s   *client = (struct client_s *) filp->private_data;
 
@@ -923,7 +1826,7 @@ int mil1553_ioctl(struct inode *inode, struct file *filp,
 		case mil1553GET_STATUS:        /** Reads the status register */
 
 			bc = *ularg;
-			mdev = get_dev(bc);
+			mdev = client_dev(client, bc);
 			if (!mdev) {
 				cc = -EFAULT;
 				goto error_exit;
@@ -936,7 +1839,7 @@ int mil1553_ioctl(struct inode *inode, struct file *filp,
 		case mil1553RESET:             /** Reads the status register */
 
 			bc = *ularg;
-			mdev = get_dev(bc);
+			mdev = client_dev(client, bc);
 			if (!mdev) {
 				cc = -EFAULT;
 				goto error_exit;
@@ -945,13 +1848,16 @@ int mil1553_ioctl(struct inode *inode, struct file *filp,
 			iowrite32be(CMD_RESET,&memory_map->cmd);
 			init_device(mdev);
 			mdev->up_rtis = 0;
+			for (i = 0; i < 32; i++)
+				mdev->rti_gen[i]++;
 			wa.isrdebug = 0;
+			post_bc_event(mdev, 0, EVT_RESET);
 		break;
 
 		case mil1553GET_TEMPERATURE:
 
 			bc = *ularg;
-			mdev = get_dev(bc);
+			mdev = client_dev(client, bc);
 			if (!mdev) {
 				cc = -EFAULT;
 				goto error_exit;
@@ -963,7 +1869,7 @@ int mil1553_ioctl(struct inode *inode, struct file *filp,
 		case mil1553SET_TP:
 			bc = *ularg & MAX_DEVS_MASK;
 			tp = *ularg & CMD_TPS_MASK;
-			mdev = get_dev(bc);
+			mdev = client_dev(client, bc);
 			if (!mdev) {
 				cc = -EFAULT;
 				goto error_exit;
@@ -974,7 +1880,7 @@ int mil1553_ioctl(struct inode *inode, struct file *filp,
 
 		case mil1553GET_TP:
 			bc = *ularg & MAX_DEVS_MASK;
-			mdev = get_dev(bc);
+			mdev = client_dev(client, bc);
 			if (!mdev) {
 				cc = -EFAULT;
 				goto error_exit;
@@ -992,7 +1898,7 @@ int mil1553_ioctl(struct inode *inode, struct file *filp,
 
 			dev_info = mem;
 			bc = dev_info->bc;
-			mdev = get_dev(bc);
+			mdev = client_dev(client, bc);
 			if (!mdev) {
 				cc = -EFAULT;
 				goto error_exit;
@@ -1028,7 +1934,7 @@ int mil1553_ioctl(struct inode *inode, struct file *filp,
 		case mil1553RAW_READ:          /** Raw read PCI registers */
 
 			riob = mem;
-			mdev = get_dev(riob->bc);
+			mdev = client_dev(client, riob->bc);
 			if (!mdev) {
 				cc = -EFAULT;
 				goto error_exit;
@@ -1055,7 +1961,7 @@ int mil1553_ioctl(struct inode *inode, struct file *filp,
 		case mil1553RAW_WRITE:         /** Raw write PCI registers */
 
 			riob = mem;
-			mdev = get_dev(riob->bc);
+			mdev = client_dev(client, riob->bc);
 			if (!mdev) {
 				cc = -EFAULT;
 				goto error_exit;
@@ -1079,7 +1985,7 @@ int mil1553_ioctl(struct inode *inode, struct file *filp,
 
 		case mil1553GET_UP_RTIS:
 			bc = *ularg;
-			mdev = get_dev(bc);
+			mdev = client_dev(client, bc);
 			if (!mdev) {
 				cc = -EFAULT;
 				goto error_exit;
@@ -1090,7 +1996,7 @@ int mil1553_ioctl(struct inode *inode, struct file *filp,
 
 		case mil1553SEND_RECEIVE:
 			sr = mem;
-			if ((mdev = get_dev(sr->bc)) == NULL) {
+			if ((mdev = client_dev(client, sr->bc)) == NULL) {
 				cc = -EFAULT;
 				goto error_exit;
 			}
@@ -1101,11 +2007,83 @@ int mil1553_ioctl(struct inode *inode, struct file *filp,
 				&sr->received_wc);
 		break;
 
+		case mil1553XFER:
+			cc = do_xfer(client, mem);
+			if (cc)
+				goto error_exit;
+		break;
+
+		case mil1553GET_RTI_GEN:
+			gen = mem;
+			if ((mdev = client_dev(client, gen->bc)) == NULL) {
+				cc = -EFAULT;
+				goto error_exit;
+			}
+			if (gen->rti < 1 || gen->rti > 30) {
+				cc = -EINVAL;
+				goto error_exit;
+			}
+			gen->gen = mdev->rti_gen[gen->rti];
+		break;
+
+		case mil1553GET_BC_STATS:
+			stats = mem;
+			if (stats->version != MIL1553_BC_STATS_VERSION) {
+				cc = -EINVAL;
+				goto error_exit;
+			}
+			if ((mdev = client_dev(client, stats->bc)) == NULL) {
+				cc = -EFAULT;
+				goto error_exit;
+			}
+			stats->up_rtis = mdev->up_rtis;
+			stats->tx_mmio_saved = mdev->tx_mmio_saved;
+			stats->rd_attach_hits = mdev->rd_attach_hits;
+			stats->rd_fresh_hits = mdev->rd_fresh_hits;
+			stats->bcast_frames = mdev->bcast_frames;
+			stats->sync_frames = mdev->sync_frames;
+			stats->sync_skew_max_ns = mdev->sync_skew_max_ns;
+		break;
+
+		case mil1553SUBSCRIBE:
+			sub = mem;
+			if ((mdev = client_dev(client, sub->bc)) == NULL) {
+				cc = -EFAULT;
+				goto error_exit;
+			}
+			spin_lock_irqsave(&wa.clients_lock, flags);
+			client->rti_subs[dev_index(mdev)] = sub->events ? sub->rti_mask : 0;
+			client->events[dev_index(mdev)]   = sub->rti_mask ? sub->events : 0;
+			spin_unlock_irqrestore(&wa.clients_lock, flags);
+		break;
+
+		case mil1553RECV:
+			cc = recv_client_event(client, mem);
+			if (cc)
+				goto error_exit;
+		break;
+
+		case mil1553SEND:
+			cc = queue_send(client, mem);
+			if (cc)
+				goto error_exit;
+		break;
+
+		case mil1553SYNC_SEND:
+			cc = sync_send(client, mem);
+			if (cc)
+				goto error_exit;
+		break;
+
+		case mil1553QUEUE_SIZE:
+			*ularg = rx_queue_count(client);
+		break;
+
 		case mil1553LOCK_BC:
 		        cc = 0;
 			goto error_exit;
 			bc = *ularg;
-			mdev = get_dev(bc);
+			mdev = client_dev(client, bc);
 			if (!mdev) {
 				cc = -EFAULT;
 				goto error_exit;
@@ -1135,7 +2113,7 @@ int mil1553_ioctl(struct inode *inode, struct file *filp,
 		        cc = 0;
 			goto error_exit;
 			bc = *ularg;
-			mdev = get_dev(bc);
+			mdev = client_dev(client, bc);
 			if (!mdev) {
 				cc = -EFAULT;
 				goto error_exit;
@@ -1189,6 +2167,25 @@ long mil1553_ioctl_ulck(struct file *filp, unsigned int cmd, unsigned long arg)
 	return res;
 }
 
+/**
+ * =========================================================
+ * 32 bit callers on a 64 bit kernel, only the ioctls whose
+ * arguments have the same layout in both are accepted.
+ */
+
+long mil1553_ioctl_compat(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+	switch (_IOC_NR(cmd)) {
+		case mil1553XFER:
+		case mil1553SUBSCRIBE:
+		case mil1553RECV:
+		case mil1553GET_RTI_GEN:
+		case mil1553GET_BC_STATS:
+			return mil1553_ioctl_ulck(filp, cmd, arg);
+	}
+	return -ENOIOCTLCMD;
+}
+
 /**
  * =========================================================
  */
@@ -1202,12 +2199,70 @@ int mil1553_ioctl_lck(struct inode *inode, struct file *filp,
 	return res;
 }
 
+/**
+ * =========================================================
+ * @brief Read events from the clients queue
+ * @return Bytes read, a multiple of struct mil1553_recv_s
+ *
+ * Blocks until at least one event is there unless O_NONBLOCK
+ * is set, then returns as many as are waiting and fit.
+ */
+
+ssize_t mil1553_read(struct file *filp, char __user *buf,
+		     size_t count, loff_t *ppos)
+{
+	struct client_s *client = (struct client_s *) filp->private_data;
+	struct mil1553_recv_s recv;
+	size_t done = 0;
+	int cc;
+
+	if (count < sizeof(recv))
+		return -EINVAL;
+
+	if (!rx_queue_count(client)) {
+		if (filp->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		cc = wait_event_interruptible(client->wait_queue,
+					      rx_queue_count(client));
+		if (cc)
+			return -ERESTARTSYS;
+	}
+
+	while (count - done >= sizeof(recv)) {
+		memset(&recv, 0, sizeof(recv));
+		if (pop_client_event(client, &recv))
+			break;
+		if (copy_to_user(buf + done, &recv, sizeof(recv)))
+			return done ? done : -EFAULT;
+		done += sizeof(recv);
+	}
+	return done;
+}
+
+/**
+ * =========================================================
+ * @brief Readable when the clients queue is not empty
+ */
+
+unsigned int mil1553_poll(struct file *filp, poll_table *wait)
+{
+	struct client_s *client = (struct client_s *) filp->private_data;
+
+	poll_wait(filp, &client->wait_queue, wait);
+	if (rx_queue_count(client))
+		return POLLIN | POLLRDNORM;
+	return 0;
+}
+
 /**
  * =========================================================
  */
 struct file_operations mil1553_fops = {
 	.owner          = THIS_MODULE,
 	.unlocked_ioctl = mil1553_ioctl_ulck,
+	.compat_ioctl   = mil1553_ioctl_compat,
+	.read           = mil1553_read,
+	.poll           = mil1553_poll,
 	.open           = mil1553_open,
 	.release        = mil1553_close,
 };
@@ -1222,6 +2277,7 @@ static struct dentry *dbg_int_timeout;
 static struct dentry *dbg_busy_timeout;
 static struct dentry *dbg_clear_missed_int;
 static struct dentry *dbg_rti_cooldown_us;
+static struct dentry *dbg_read_share_us;
 
 static void create_debugfs_flags(void)
 {
@@ -1231,6 +2287,7 @@ static void create_debugfs_flags(void)
 	dbg_busy_timeout = debugfs_create_u32("busy_timeout", 0644, dir, &busy_timeout);
 	dbg_clear_missed_int = debugfs_create_u32("clear_missed_int", 0644, dir, &clear_missed_int);
 	dbg_rti_cooldown_us = debugfs_create_u32("rti_cooldown_delay", 0644, dir, &rti_cooldown_us);
+	dbg_read_share_us = debugfs_create_u32("read_share_us", 0644, dir, &read_share_us);
 	printk("creating debugfs entries: %p %p %p %p %p\n", dir,
 		dbg_int_timeout, dbg_busy_timeout, dbg_clear_missed_int, dbg_rti_cooldown_us);
 }
@@ -1238,6 +2295,7 @@ static void create_debugfs_flags(void)
 static void remove_debugfs_flags(void)
 {
 	debugfs_remove(dbg_rti_cooldown_us);
+	debugfs_remove(dbg_read_share_us);
 	debugfs_remove(dbg_int_timeout);
 	debugfs_remove(dbg_busy_timeout);
 	debugfs_remove(dbg_clear_missed_int);
@@ -1285,6 +2343,9 @@ int mil1553_install(void)
 
 	printk(KERN_INFO PFX "%s\n", version_signature);
 	memset(&wa, 0, sizeof(struct working_area_s));
+	spin_lock_init(&wa.clients_lock);
+	mutex_init(&wa.send_lock);
+	INIT_LIST_HEAD(&wa.clients);
 	create_debugfs_flags();
 
 	if (!check_args())
@@ -1301,7 +2362,10 @@ int mil1553_install(void)
 		spin_lock_init(&mdev->lock);
 		mdev->tx_queue = &wa.tx_queue[i];
 		spin_lock_init(&mdev->tx_queue->lock);
+		INIT_WORK(&mdev->tx_work, tx_queue_work);
 		mutex_init(&mdev->bc_lock);
+		spin_lock_init(&mdev->rd_lock);
+		init_waitqueue_head(&mdev->rd_wq);
 
 		mdev->pdev = add_next_dev(pdev,mdev);
 		if (!mdev->pdev)
@@ -1320,6 +2384,7 @@ int mil1553_install(void)
 		}
 
 		mdev->bc = bc;
+		wa.bc_dev[bc] = mdev;
 		iowrite32be(CMD_RESET, &mdev->memory_map->cmd);
 		init_device(mdev);
 		init_waitqueue_head(&mdev->int_complete);
@@ -1350,6 +2415,7 @@ void mil1553_uninstall(void)
 
 	for (i=0; i<wa.bcs; i++) {
 		mdev = &wa.mil1553_dev[i];
+		cancel_work_sync(&mdev->tx_work);
 		debugfs_clear_dev(mdev);
 		release_device(mdev);
 	}
@@ -30,6 +30,8 @@
 #define RX_BUF_SIZE (TX_BUF_SIZE +1)
 
 #define RTI_TIMEOUT 10
+
+#define RTI_BROADCAST 31  /** Every RTI on the bus listens, none replies */
 #define TX_START    0x01
 #define TX_END      0x02
 #define TX_ALL      0x04
@@ -127,6 +129,36 @@
 #define NB_WD_PARITY_ERROR     0x40000000
 #define NB_WD_TR_FLAG          0x80000000
 
+/**
+ * RTI status word, first word of every reply in the RX buffer.
+ * Only the bits the driver itself looks at are defined here,
+ * the complete list is in librti.h (STR_xxx).
+ */
+
+#define RTI_STR_TB        0x0020    /** Transmit buffer ready */
+#define RTI_STR_SR        0x0100    /** Service request */
+#define RTI_STR_RTI_SHIFT 11
+#define RTI_STR_RTI_MASK  (0x1F << RTI_STR_RTI_SHIFT)
+
+/**
+ * Events posted by the driver on a subscribed clients queue.
+ * They are returned in the pk_type field of mil1553_recv_s.
+ */
+
+#define EVT_SR      0x08            /** RTI status word had SR set */
+#define EVT_TB      0x10            /** RTI status word had TB set */
+#define EVT_STR     (EVT_SR | EVT_TB)
+#define EVT_RTI_UP   0x20           /** RTI started answering */
+#define EVT_RTI_DOWN 0x40           /** RTI stopped answering */
+#define EVT_RESET    0x80           /** BC was reset, rti_number is zero */
+
+/**
+ * Completions of MIL1553_SEND items are always queued on the
+ * sending client with pk_type TX_END, no subscription needed.
+ * The queue can be read with MIL1553_RECV or read(2), and
+ * poll(2) reports POLLIN while it is not empty.
+ */
+
 /**
  * Beware, on a 64-bit machine the size of these structures will change.
  * This issue must be addressed in the future when the driver is ported
@@ -152,25 +184,57 @@ struct mil1553_tx_item_s {
 	unsigned short txbuf[TX_BUF_SIZE];    /** Buffer */
 };
 
+/**
+ * MIL1553_SEND queues all the items or, when it fails, none of them.
+ */
+
 struct mil1553_send_s {
 	unsigned int item_count;
 	struct mil1553_tx_item_s *tx_item_array;
 };
 
+/**
+ * Frames started together on several BCs, at most one item per BC.
+ * Every BC is first armed (idle, TXBUF written), then all the TXREGs
+ * are written back to back with interrupts off. Completions are TX_END
+ * events as for MIL1553_SEND. skew_ns returns the time between the
+ * first and the last TXREG write.
+ */
+
+struct mil1553_sync_send_s {
+	unsigned int item_count;
+	unsigned int skew_ns;                 /** Returned start skew */
+	struct mil1553_tx_item_s *tx_item_array;
+};
+
 struct mil1553_rti_interrupt_s {
 	unsigned int bc;                      /** Bus controller */
 	unsigned int rti_number;              /** Rti that interrupted */
 	unsigned int wc;                      /** Buffer word count */
+	unsigned int str;                     /** RTI status word */
+	unsigned int status;                  /** TX_END: 0 or errno */
 	unsigned short rxbuf[RX_BUF_SIZE+1];  /** Receive buffer (32-bit access) */
 };
 
 struct mil1553_recv_s {
-	unsigned int pk_type;                 /** Type to wait for START, END, ALL */
+	unsigned int pk_type;                 /** Event received TX_END or EVT_xxx */
 	unsigned int timeout;                 /** Timeout msec or zero */
 	unsigned int icnt;                    /** Clients interrupt count */
 	struct mil1553_rti_interrupt_s interrupt;
 };
 
+/**
+ * Subscribe to driver events for a set of RTIs on one BC.
+ * Each BC keeps its own subscription, an empty rti_mask or events mask
+ * removes the one of that BC.
+ */
+
+struct mil1553_subscribe_s {
+	unsigned int bc;                      /** Bus controller */
+	unsigned int rti_mask;                /** Bit per RTI 1..30 */
+	unsigned int events;                  /** EVT_xxx mask */
+};
+
 struct mil1553_send_recv_s {
 	unsigned int bc;			/** bc to talk to */
 	unsigned int rti;			/** rti to talk to */
@@ -183,6 +247,44 @@ struct mil1553_send_recv_s {
 	unsigned int received_wc;		/** received wc */
 };
 
+/**
+ * Compact transfer descriptor, int and long long only so 32 and
+ * 64 bit user space share one layout. Only the words needed move across the
+ * user/kernel boundary: wc words from txbuf, and at most wc+1
+ * words (status word first) back into rxbuf.
+ * MIL1553_SEND_RECEIVE remains for code built against the old struct.
+ */
+
+#define MIL1553_XFER_VERSION 1
+
+#define XFER_REPLY 0x1                  /** Read the reply into rxbuf */
+
+struct mil1553_xfer_s {
+	unsigned int version;                 /** MIL1553_XFER_VERSION */
+	unsigned int bc;                      /** bc to talk to, zero on a bound handle */
+	unsigned int rti;                     /** rti to talk to */
+	unsigned int sa;                      /** subaddress */
+	unsigned int tr;                      /** transmit/receive bit */
+	unsigned int wc;                      /** word count 1..32 */
+	unsigned int flags;                   /** XFER_xxx */
+	unsigned int received_wc;             /** Words written to rxbuf */
+	unsigned long long txbuf;             /** User address of wc words to send */
+	unsigned long long rxbuf;             /** User address for wc+1 words */
+};
+
+/**
+ * Generation of an RTI, bumped each time the driver sees the RTI go
+ * down, at a scan or when a frame to it is not answered, and when its
+ * BC is reset. Anything cached about the RTI
+ * (signature, configuration) is stale once the generation changes.
+ */
+
+struct mil1553_rti_gen_s {
+	unsigned int bc;                      /** Bus controller, zero on a bound handle */
+	unsigned int rti;                     /** RTI 1..30 */
+	unsigned int gen;                     /** Returned generation */
+};
+
 struct mil1553_dev_info_s {
 	unsigned int bc;                      /** The BC you want to get info about */
 	unsigned int pci_bus_num;             /** PCI bus number */
@@ -209,6 +311,27 @@ struct mil1553_dev_info_s {
 	unsigned int quick_owner;	      /** owner of device */
 };
 
+/**
+ * Driver counters of a BC. They are kept out of mil1553_dev_info_s,
+ * whose size is part of the MIL1553_GET_BC_INFO number that old
+ * binaries were built with. A new layout gets a new version and the
+ * driver refuses versions it does not know.
+ */
+
+#define MIL1553_BC_STATS_VERSION 1
+
+struct mil1553_bc_stats_s {
+	unsigned int version;                 /** MIL1553_BC_STATS_VERSION */
+	unsigned int bc;                      /** Bus controller, zero on a bound handle */
+	unsigned int up_rtis;                 /** Up RTIs as last seen, reading it does not scan */
+	unsigned int tx_mmio_saved;           /** TXBUF writes skipped, no data on the wire */
+	unsigned int rd_attach_hits;          /** Reads answered by an identical frame in flight */
+	unsigned int rd_fresh_hits;           /** Reads answered by a recent identical frame */
+	unsigned int bcast_frames;            /** Broadcast frames sent */
+	unsigned int sync_frames;             /** Frames started by MIL1553_SYNC_SEND */
+	unsigned int sync_skew_max_ns;        /** Largest start skew seen by those */
+};
+
 /*
  * Enumerate IOCTL functions
  */
@@ -252,6 +375,11 @@ typedef enum {
 	mil1553SET_TP,            /** Set up test points */
 	mil1553GET_TP,            /** Get test points */
 	mil1553SEND_RECEIVE,	  /** do a send/receive transaction */
+	mil1553SUBSCRIBE,         /** Subscribe to RTI status events */
+	mil1553XFER,              /** Compact send/receive transaction */
+	mil1553GET_RTI_GEN,       /** Get the generation of an RTI */
+	mil1553SYNC_SEND,         /** Start frames on several BCs together */
+	mil1553GET_BC_STATS,      /** Get the driver counters of a BC */
 
 	mil1553LAST               /** For range checking (LAST - FIRST) */
 
@@ -291,5 +419,10 @@ typedef enum {
 #define MIL1553_SET_TP           PIOWR(mil1553SET_TP,          unsigned long)
 #define MIL1553_GET_TP           PIOWR(mil1553GET_TP,          unsigned long)
 #define MIL1553_SEND_RECEIVE	 PIOWR(mil1553SEND_RECEIVE,    struct mil1553_send_recv_s)
+#define MIL1553_SUBSCRIBE        PIOW(mil1553SUBSCRIBE,        struct mil1553_subscribe_s)
+#define MIL1553_XFER             PIOWR(mil1553XFER,            struct mil1553_xfer_s)
+#define MIL1553_GET_RTI_GEN      PIOWR(mil1553GET_RTI_GEN,     struct mil1553_rti_gen_s)
+#define MIL1553_SYNC_SEND        PIOWR(mil1553SYNC_SEND,       struct mil1553_sync_send_s)
+#define MIL1553_GET_BC_STATS     PIOWR(mil1553GET_BC_STATS,    struct mil1553_bc_stats_s)
 
 #endif
@@ -83,6 +83,8 @@ struct rti_interrupt_s {
 	uint32_t timeout;                 /** Interrupt timeout */
 	uint32_t packet_ok;               /** Bad packet received */
 	uint32_t rxbuf_rti_stat;          /** RTI status in RX buffer */
+	uint32_t event;                   /** EVT_xxx bits for client queues */
+	uint32_t status;                  /** Completion status, 0 or errno */
 	uint32_t rxbuf[RX_BUF_SIZE+1];      /** Receive  buffer */
 };
 
@@ -111,6 +113,10 @@ struct client_s {
 	struct rx_queue_s rx_queue;     /** Results of commands */
 	uint32_t bc_locked;             /** BC locked */
 	uint32_t bc;                    /** Last used bc */
+	struct mil1553_device_s *mdev;  /** Bound BC when opened on /dev/mil1553.<bc> */
+	uint32_t events[MAX_DEVS];      /** Subscribed EVT_xxx mask per BC */
+	uint32_t rti_subs[MAX_DEVS];    /** Subscribed RTIs mask per BC */
+	struct list_head list;          /** On the working area client list */
 };
 
 /**
@@ -124,7 +130,7 @@ struct tx_item_s {
 	uint32_t bc;                    /** Bus controller number */
 	uint32_t rti_number;            /** RTI number */
 	uint32_t txreg;                 /** Transmit register wc, sa, t/r bit, rti */
-	uint32_t txbuf[TX_BUF_SIZE];    /** Buffer */
+	uint16_t txbuf[TX_BUF_SIZE];    /** Buffer */
 };
 
 /**
@@ -165,6 +171,22 @@ struct tspoint {
 	uint64_t	end_tx;
 };
 
+/**
+ * A read frame whose reply other requesters may share, see send_receive.
+ */
+
+#define RD_SHARE_SLOTS 8
+
+struct rd_share_s {
+	uint32_t             txreg;       /** The frame, zero when unused */
+	uint32_t             busy;        /** Queued or in flight */
+	uint32_t             waiters;     /** Requesters attached to it */
+	uint32_t             gen;         /** Bumped when the frame ends */
+	uint64_t             claim_ns;    /** When it was queued */
+	int                  wc;          /** Received words */
+	unsigned short       rxbuf[RX_BUF_SIZE];
+};
+
 struct mil1553_device_s {
 	spinlock_t           lock;        /** To lock the queue */
 	uint32_t             bc;          /** Bus controller */
@@ -176,14 +198,26 @@ struct mil1553_device_s {
 	struct memory_map_s *memory_map;  /** Mapped BAR2 device memory */
 	uint32_t             busy_done;   /** Bus controller busy/done status */
 	uint32_t             up_rtis;     /** Last known up rtis mask */
+	uint32_t             str_events;  /** Status word events posted */
 	uint32_t             new_up_rtis; /** New mask */
+	uint32_t             rti_gen[32]; /** Bumped on RTI down and BC reset */
 	struct tx_queue_s   *tx_queue;    /** Transmit Queue pointer */
+	struct work_struct   tx_work;     /** Drains the tx_queue */
 	struct rti_interrupt_s
 			     rti_interrupt;
 	struct mutex         bc_lock;     /** Transaction lock mutex */
 	struct mutex         bcdev;	  /** Lock the device while accesing it*/
 	uint32_t             icnt;        /** Device interrupt count */
 	uint32_t             tx_count;    /** Device TX count */
+	uint32_t             tx_mmio_saved; /** TXBUF writes not needed */
+	spinlock_t           rd_lock;     /** Protects rd_share */
+	wait_queue_head_t    rd_wq;       /** Attached readers wait here */
+	struct rd_share_s    rd_share[RD_SHARE_SLOTS];
+	uint32_t             rd_attach_hits; /** Reads answered by a frame in flight */
+	uint32_t             rd_fresh_hits;  /** Reads answered by a recent frame */
+	uint32_t             bcast_frames;   /** Broadcast frames sent */
+	uint32_t             sync_frames;    /** Frames started by sync_send */
+	uint32_t             sync_skew_max_ns; /** Largest sync start skew */
 	wait_queue_head_t    int_complete;/** to wait for interrupt after TX */
 	atomic_t	     int_busy;	  /** busy during int transaction */
 	struct mutex         mutex;       /** protects device during send */
@@ -210,10 +244,14 @@ struct mil1553_device_s {
 struct working_area_s {
 	uint32_t bcs;                                  /** The number of BCs installed */
 	struct mil1553_device_s mil1553_dev[MAX_DEVS]; /** The BC device descriptions */
+	struct mil1553_device_s *bc_dev[MAX_DEVS];     /** BC number to device */
 	struct tx_queue_s tx_queue[MAX_DEVS];          /** Data and commands waiting to be transmitted */
 	uint32_t icnt;                                 /** Total interrupt count */
 	uint32_t isrdebug;                             /** Trace ISR */
 	unsigned long nopol;                           /** No polling flag */
+	spinlock_t clients_lock;                       /** Protects the client list */
+	struct list_head clients;                      /** All open clients */
+	struct mutex send_lock;                        /** One MIL1553_SEND queues at a time */
 };
 
 #endif
@@ -0,0 +1,262 @@
+/**
+ * Client side of the mil1553 bus arbiter, see libarbiter.h
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include <libarbiter.h>
+
+/* ===================================== */
+
+uint64_t arb_now_us(void) {
+
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void arb_futex_wait(volatile uint32_t *addr, uint32_t val, int timeout_ms) {
+
+	struct timespec ts;
+
+	ts.tv_sec  = timeout_ms / 1000;
+	ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+	syscall(SYS_futex, addr, FUTEX_WAIT, val, &ts, NULL, 0);
+}
+
+void arb_futex_wake(volatile uint32_t *addr) {
+
+	syscall(SYS_futex, addr, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+/* ===================================== */
+
+/**
+ * The segment is mapped once per process, each handle is a dup of its
+ * descriptor so that it is a real, unique file handle.
+ */
+
+#define ARB_FDS 1024
+#define ARB_WAIT_MS 100
+
+static struct arb_shm_s *arb_shm = NULL;
+static int arb_shm_fd = -1;
+static volatile int arb_map_lock = 0;
+static short arb_slot[ARB_FDS];       /** Slot + 1 by handle, zero if none */
+static uint32_t arb_seq[ARB_FDS];
+
+static int daemon_alive(void) {
+
+	int pid = arb_shm->daemon_pid;
+
+	return (pid > 0) && ((kill(pid, 0) == 0) || (errno == EPERM));
+}
+
+static int map_shm(void) {
+
+	int fd, cc = 0;
+	void *p;
+
+	while (__sync_lock_test_and_set(&arb_map_lock, 1))
+		usleep(100);
+	if (arb_shm)
+		goto exit;
+
+	fd = shm_open(ARB_SHM_NAME, O_RDWR, 0);
+	if (fd < 0) {
+		cc = errno;
+		goto exit;
+	}
+	p = mmap(NULL, sizeof(struct arb_shm_s), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		cc = errno;
+		close(fd);
+		goto exit;
+	}
+	if ((((struct arb_shm_s *) p)->magic != ARB_MAGIC)
+	||  (((struct arb_shm_s *) p)->version != ARB_VERSION)) {
+		cc = EPROTO;
+		munmap(p, sizeof(struct arb_shm_s));
+		close(fd);
+		goto exit;
+	}
+	arb_shm_fd = fd;
+	arb_shm = p;
+exit:
+	__sync_lock_release(&arb_map_lock);
+	return cc;
+}
+
+int arb_attach(int prio) {
+
+	struct arb_client_s *c;
+	int i, fn, cc;
+
+	cc = map_shm();
+	if (cc)
+		goto error_exit;
+	if (!daemon_alive()) {
+		cc = ENXIO;
+		goto error_exit;
+	}
+	fn = dup(arb_shm_fd);
+	if (fn < 0)
+		return -1;
+	if (fn >= ARB_FDS) {
+		close(fn);
+		cc = EMFILE;
+		goto error_exit;
+	}
+	for (i=0; i<ARB_CLIENTS; i++) {
+		c = &arb_shm->client[i];
+		if (__sync_bool_compare_and_swap(&c->pid, 0, getpid())) {
+			c->prio = prio;
+			c->requests = 0;
+			c->coalesced = 0;
+			c->ring.cq_head = c->ring.cq_tail;
+			c->ring.sq_tail = c->ring.sq_head;
+			arb_slot[fn] = i + 1;
+			arb_seq[fn] = 0;
+			return fn;
+		}
+	}
+	close(fn);
+	cc = EBUSY;
+
+error_exit:
+	errno = cc;
+	return -1;
+}
+
+void arb_detach(int fn) {
+
+	if (!arb_handle(fn))
+		return;
+	arb_shm->client[arb_slot[fn] - 1].pid = 0;
+	arb_slot[fn] = 0;
+	close(fn);
+}
+
+int arb_handle(int fn) {
+
+	return (fn >= 0) && (fn < ARB_FDS) && arb_slot[fn];
+}
+
+/* ===================================== */
+
+/**
+ * Submit one request and wait for its completion
+ */
+
+static int arb_call(int fn, struct arb_req_s *req, struct arb_cpl_s *cpl) {
+
+	struct arb_ring_s *r;
+	uint32_t tail, head;
+
+	if (!arb_handle(fn))
+		return EBADF;
+	r = &arb_shm->client[arb_slot[fn] - 1].ring;
+
+	while (r->sq_tail - r->sq_head >= ARB_RING) {
+		if (!daemon_alive())
+			return EPIPE;
+		arb_futex_wait(&r->cq_tail, r->cq_tail, ARB_WAIT_MS);
+	}
+	req->seq      = ++arb_seq[fn];
+	req->ticket   = __sync_fetch_and_add(&arb_shm->ticket, 1);
+	req->t_submit = arb_now_us();
+
+	tail = r->sq_tail;
+	memcpy(&r->sq[tail & (ARB_RING - 1)], req, sizeof(*req));
+	__sync_synchronize();
+	r->sq_tail = tail + 1;
+
+	__sync_fetch_and_add(&arb_shm->doorbell, 1);
+	arb_futex_wake(&arb_shm->doorbell);
+
+	for (;;) {
+		head = r->cq_head;
+		tail = r->cq_tail;
+		if (head == tail) {
+			if (!daemon_alive())
+				return EPIPE;
+			arb_futex_wait(&r->cq_tail, tail, ARB_WAIT_MS);
+			continue;
+		}
+		__sync_synchronize();
+		memcpy(cpl, &r->cq[head & (ARB_RING - 1)], sizeof(*cpl));
+		r->cq_head = head + 1;
+		if (cpl->seq == req->seq)
+			return cpl->cc;
+	}
+}
+
+int arb_send_receive(int fn, int bc, int rti, int wc, int sa, int tr,
+		     int reply, unsigned short *rxbuf, unsigned short *txbuf) {
+
+	struct arb_req_s req;
+	struct arb_cpl_s cpl;
+	int cc, n;
+
+	if ((wc <= 0) || (wc > ARB_WORDS))
+		return EINVAL;
+
+	memset(&req, 0, sizeof(req));
+	req.op    = ARB_XFER;
+	req.bc    = bc;
+	req.rti   = rti;
+	req.wc    = wc;
+	req.sa    = sa;
+	req.tr    = tr;
+	req.reply = reply;
+	if (txbuf)
+		memcpy(req.txbuf, txbuf, sizeof(unsigned short) * wc);
+
+	cc = arb_call(fn, &req, &cpl);
+	if (cc == 0 && reply && rxbuf) {
+		n = wc + 1;
+		memcpy(rxbuf, cpl.rxbuf, sizeof(unsigned short) * n);
+	}
+	return cc;
+}
+
+static int arb_bc_op(int fn, int bc, int op) {
+
+	struct arb_req_s req;
+	struct arb_cpl_s cpl;
+
+	if ((bc < 0) || (bc > 31))
+		return EINVAL;
+	memset(&req, 0, sizeof(req));
+	req.op = op;
+	req.bc = bc;
+	return arb_call(fn, &req, &cpl);
+}
+
+int arb_lock_bc(int fn, int bc) {
+
+	return arb_bc_op(fn, bc, ARB_LOCK_BC);
+}
+
+int arb_unlock_bc(int fn, int bc) {
+
+	return arb_bc_op(fn, bc, ARB_UNLOCK_BC);
+}
+
+int arb_get_stats(int fn, struct arb_stats_s *stats) {
+
+	if (!arb_handle(fn))
+		return EBADF;
+	memcpy(stats, &arb_shm->stats, sizeof(*stats));
+	return 0;
+}
@@ -0,0 +1,166 @@
+#ifndef _LIBARBITER_H
+#define _LIBARBITER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdint.h>
+
+/**
+ * Bus arbiter, optional.
+ *
+ * The mil1553arbd daemon opens /dev/mil1553 and executes the frames of
+ * local clients that attach to it instead of opening the driver. Each
+ * client owns a submission and a completion ring in a POSIX shared
+ * memory segment, both single producer / single consumer, so neither
+ * side takes a lock. A futex on the doorbell wakes the daemon, a futex
+ * on the completion tail wakes the client.
+ *
+ * The daemon serves clients by priority, then in submission order, and
+ * keeps the BC locks itself. Identical reads (bc, rti, sa, wc with the
+ * RTI transmitting) submitted no later than the coalescing window after
+ * a frame started are answered from that frame.
+ *
+ * Setting MIL1553_ARBITER in the environment makes
+ * mil1553_init_quickdriver attach, its value is the client priority.
+ * librti then sends everything through the daemon when given such a
+ * handle. Driver ioctls other than frames and BC locks are not served,
+ * they fail with ENOTTY on an arbiter handle.
+ */
+
+#define ARB_SHM_NAME  "/mil1553-arbiter"
+#define ARB_MAGIC     0x4D415242      /** "MARB" */
+#define ARB_VERSION   1
+#define ARB_CLIENTS   32              /** Attached handles at once */
+#define ARB_RING      16              /** Ring entries, power of two */
+#define ARB_WORDS     32              /** TX_BUF_SIZE */
+
+#define ARB_PRIO_ENV  "MIL1553_ARBITER"
+
+typedef enum {
+	ARB_XFER = 1,     /** One frame, see rtilib_send_receive */
+	ARB_LOCK_BC,      /** Wait for and take the BC lock */
+	ARB_UNLOCK_BC     /** Give the BC lock back */
+} arb_op_t;
+
+struct arb_req_s {
+	uint32_t seq;                 /** Client sequence number */
+	uint16_t op;                  /** arb_op_t */
+	uint16_t bc;
+	uint16_t rti;
+	uint16_t wc;
+	uint16_t sa;
+	uint16_t tr;
+	uint16_t reply;               /** Wants the reply */
+	uint16_t spare;
+	uint64_t ticket;              /** Global submission order */
+	uint64_t t_submit;            /** CLOCK_MONOTONIC in us */
+	uint16_t txbuf[ARB_WORDS];
+};
+
+struct arb_cpl_s {
+	uint32_t seq;                 /** From the request */
+	int32_t  cc;                  /** Zero or errno */
+	uint16_t coalesced;           /** Answered from another frame */
+	uint16_t spare;
+	uint16_t rxbuf[ARB_WORDS+1];  /** Status word then data */
+};
+
+struct arb_ring_s {
+	volatile uint32_t sq_head;    /** Daemon consumes */
+	volatile uint32_t sq_tail;    /** Client produces */
+	volatile uint32_t cq_head;    /** Client consumes */
+	volatile uint32_t cq_tail;    /** Daemon produces, futex */
+	struct arb_req_s sq[ARB_RING];
+	struct arb_cpl_s cq[ARB_RING];
+};
+
+struct arb_client_s {
+	volatile int32_t pid;         /** Owner, zero when free */
+	int32_t prio;                 /** Higher is served first */
+	uint32_t requests;            /** Requests completed */
+	uint32_t coalesced;           /** Of which without a frame */
+	struct arb_ring_s ring;
+};
+
+struct arb_stats_s {
+	uint32_t requests;            /** Requests completed */
+	uint32_t frames;              /** Frames sent on the bus */
+	uint32_t coalesced;           /** Reads answered from another frame */
+	uint32_t deferred;            /** Times a request waited for a BC lock */
+	uint32_t sweeps;              /** Daemon passes over the rings */
+	uint32_t clients;             /** Clients attached */
+};
+
+struct arb_shm_s {
+	uint32_t magic;
+	uint32_t version;
+	volatile int32_t daemon_pid;
+	volatile uint32_t doorbell;   /** Bumped on submit, futex */
+	volatile uint64_t ticket;
+	uint32_t window_us;           /** Coalescing window */
+	struct arb_stats_s stats;
+	struct arb_client_s client[ARB_CLIENTS];
+};
+
+/**
+ * @brief Attach to the daemon
+ * @param prio Client priority, the POW RT task should use the highest
+ * @return A handle usable with librti and libquick, or -1 and errno
+ */
+
+int arb_attach(int prio);
+
+/**
+ * @brief Detach a handle and close it
+ * @param fn Handle from arb_attach
+ *
+ * A handle that is just closed is freed when its process exits.
+ */
+
+void arb_detach(int fn);
+
+/**
+ * @brief Tell if a handle is attached to the daemon
+ * @return 1 if it is
+ */
+
+int arb_handle(int fn);
+
+/**
+ * @brief One frame through the daemon, same arguments as rtilib_send_receive
+ * @return Zero or errno
+ */
+
+int arb_send_receive(int fn, int bc, int rti, int wc, int sa, int tr,
+		     int reply, unsigned short *rxbuf, unsigned short *txbuf);
+
+/**
+ * @brief Take or give back a BC lock held by the daemon
+ * @return Zero or errno
+ */
+
+int arb_lock_bc(int fn, int bc);
+int arb_unlock_bc(int fn, int bc);
+
+/**
+ * @brief Copy the daemon statistics
+ * @return Zero or errno
+ */
+
+int arb_get_stats(int fn, struct arb_stats_s *stats);
+
+/**
+ * Futex helpers shared with the daemon
+ */
+
+uint64_t arb_now_us(void);
+void arb_futex_wait(volatile uint32_t *addr, uint32_t val, int timeout_ms);
+void arb_futex_wake(volatile uint32_t *addr);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _LIBARBITER_H */
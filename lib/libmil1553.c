@@ -21,6 +21,19 @@ int milib_handle_open() {
 	return cc;
 }
 
+/**
+ * Open a handle bound to one BC, ioctls on it may pass bc zero.
+ */
+
+int milib_handle_open_bc(int bc) {
+
+	int cc;
+	char path[32];
+	snprintf(path,sizeof(path),DEV_PATH_BC,bc);
+	cc = open(path,O_RDWR,0);
+	return cc;
+}
+
 int milib_set_polling(int fn, int flag) {
 
 	int cc;
@@ -154,6 +167,16 @@ int milib_get_bc_info(int fn, struct mil1553_dev_info_s *dev_info) {
 	return 0;
 }
 
+int milib_get_bc_stats(int fn, struct mil1553_bc_stats_s *stats) {
+
+	int cc;
+	stats->version = MIL1553_BC_STATS_VERSION;
+	cc = ioctl(fn,MIL1553_GET_BC_STATS,stats);
+	if (cc < 0)
+		return errno;
+	return 0;
+}
+
 int milib_raw_read(int fn, struct mil1553_riob_s *riob) {
 
 	int cc;
@@ -201,6 +224,26 @@ int milib_recv(int fn, struct mil1553_recv_s *recv) {
 	return 0;
 }
 
+/**
+ * Subscribe to RTI status word events (EVT_SR, EVT_TB) on a bc,
+ * rti_mask has bit n set for rti n, events zero unsubscribes.
+ * Events are then read with milib_recv, pk_type holds the event.
+ */
+
+int milib_subscribe(int fn, int bc, int rti_mask, int events) {
+
+	int cc;
+	struct mil1553_subscribe_s sub;
+
+	sub.bc = bc;
+	sub.rti_mask = rti_mask;
+	sub.events = events;
+	cc = ioctl(fn,MIL1553_SUBSCRIBE,&sub);
+	if (cc < 0)
+		return errno;
+	return 0;
+}
+
 int milib_get_queue_size(int fn, int *size) {
 
 	int cc;
@@ -15,8 +15,10 @@ extern "C" {
 
 #define DEV_NAME "mil1553"
 #define DEV_PATH "/dev/mil1553"
+#define DEV_PATH_BC "/dev/mil1553.%d"
 
 int milib_handle_open();
+int milib_handle_open_bc(int bc);
 int milib_set_timeout(int fn, int timeout_msec);
 int milib_get_timeout(int fn, int *timeout_msec);
 int milib_set_debug_level(int fn, int debug_level);
@@ -25,6 +27,7 @@ int milib_get_drv_version(int fn, int *version);
 int milib_get_status(int fn, int bc, int *status);
 int milib_get_bcs_count(int fn, int *bcs_count);
 int milib_get_bc_info(int fn, struct mil1553_dev_info_s *dev_info);
+int milib_get_bc_stats(int fn, struct mil1553_bc_stats_s *stats);
 int milib_raw_read(int fn, struct mil1553_riob_s *riob);
 int milib_raw_write(int fn, struct mil1553_riob_s *riob);
 int milib_get_up_rtis(int fn, int bc, int *up_rtis);
@@ -44,6 +47,7 @@ int milib_set_polling(int fn, int flag);
 int milib_set_test_point(int fn, int bc, int tp);
 int milib_get_test_point(int fn, int bc, int *tp);
 int milib_get_temperature(int fn, int bc, float *temp);
+int milib_subscribe(int fn, int bc, int rti_mask, int events);
 
 #ifdef __cplusplus
 }
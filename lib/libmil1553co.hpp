@@ -0,0 +1,637 @@
+#ifndef _LIBMIL1553CO_HPP
+#define _LIBMIL1553CO_HPP
+
+/**
+ * C++20 coroutines over the asynchronous driver interface, header only.
+ *
+ * A bus owns a /dev/mil1553 handle and an epoll executor. Each frame is
+ * queued with MIL1553_SEND and the coroutine that sent it is suspended
+ * until its TX_END event comes back, so frames to different BCs overlap
+ * from one thread without blocking:
+ *
+ *    mil1553co::bus bus;
+ *    bus.spawn([&]() -> mil1553co::task<> {
+ *        auto r = co_await bus.read_csr(bc, rti);
+ *        ...
+ *    }());
+ *    bus.run();
+ *
+ * Everything runs on the thread that calls run(), a bus must not be
+ * shared between threads. Errors are errno values as in librti, nothing
+ * throws. The frames don't go through librti, so its CSR shadow and
+ * static data cache don't see them. Arbiter handles (libarbiter.h) are
+ * not supported, the bus always opens the driver.
+ *
+ * Build with -std=c++20 (g++ 10 also needs -fcoroutines).
+ */
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <type_traits>
+#include <utility>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+
+#include <mil1553.h>
+#include <librti.h>
+#include <libquick.h>
+
+namespace mil1553co {
+
+/* ===================================== */
+
+/**
+ * Move only file handle, closed when it goes
+ */
+
+class handle {
+public:
+	handle() noexcept = default;
+	explicit handle(int fd) noexcept : fd_(fd) {}
+	handle(handle &&o) noexcept : fd_(std::exchange(o.fd_, -1)) {}
+	handle &operator=(handle &&o) noexcept {
+		if (this != &o) {
+			reset();
+			fd_ = std::exchange(o.fd_, -1);
+		}
+		return *this;
+	}
+	handle(const handle &) = delete;
+	handle &operator=(const handle &) = delete;
+	~handle() { reset(); }
+
+	int get() const noexcept { return fd_; }
+	explicit operator bool() const noexcept { return fd_ >= 0; }
+	void reset() noexcept {
+		if (fd_ >= 0)
+			::close(fd_);
+		fd_ = -1;
+	}
+
+private:
+	int fd_ = -1;
+};
+
+/* ===================================== */
+
+/**
+ * Lazy coroutine returning T, it starts when awaited or spawned and
+ * resumes its awaiter when done. Move only, destroys its frame.
+ */
+
+template <typename T = void> class task;
+
+namespace detail {
+
+struct promise_base {
+	std::coroutine_handle<> cont;
+	std::exception_ptr err;
+
+	struct final_awaiter {
+		bool await_ready() noexcept { return false; }
+		template <typename P>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+			if (h.promise().cont)
+				return h.promise().cont;
+			return std::noop_coroutine();
+		}
+		void await_resume() noexcept {}
+	};
+
+	std::suspend_always initial_suspend() noexcept { return {}; }
+	final_awaiter final_suspend() noexcept { return {}; }
+	void unhandled_exception() noexcept { err = std::current_exception(); }
+};
+
+template <typename T> struct promise : promise_base {
+	T value{};
+	task<T> get_return_object() noexcept;
+	void return_value(T v) { value = std::move(v); }
+};
+
+template <> struct promise<void> : promise_base {
+	task<void> get_return_object() noexcept;
+	void return_void() noexcept {}
+};
+
+/** Fire and forget frame for spawned tasks, frees itself */
+
+struct detached {
+	struct promise_type {
+		detached get_return_object() noexcept { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() noexcept {}
+		void unhandled_exception() noexcept { std::terminate(); }
+	};
+};
+
+} /* namespace detail */
+
+template <typename T> class task {
+public:
+	using promise_type = detail::promise<T>;
+
+	task(task &&o) noexcept : h_(std::exchange(o.h_, {})) {}
+	task &operator=(task &&o) noexcept {
+		if (this != &o) {
+			if (h_)
+				h_.destroy();
+			h_ = std::exchange(o.h_, {});
+		}
+		return *this;
+	}
+	task(const task &) = delete;
+	task &operator=(const task &) = delete;
+	~task() {
+		if (h_)
+			h_.destroy();
+	}
+
+	bool await_ready() const noexcept { return !h_ || h_.done(); }
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> c) noexcept {
+		h_.promise().cont = c;
+		return h_;
+	}
+	T await_resume() {
+		if (h_.promise().err)
+			std::rethrow_exception(h_.promise().err);
+		if constexpr (!std::is_void_v<T>)
+			return std::move(h_.promise().value);
+	}
+
+private:
+	friend promise_type;
+	explicit task(std::coroutine_handle<promise_type> h) noexcept : h_(h) {}
+	std::coroutine_handle<promise_type> h_;
+};
+
+namespace detail {
+
+template <typename T> inline task<T> promise<T>::get_return_object() noexcept {
+	return task<T>(std::coroutine_handle<promise<T>>::from_promise(*this));
+}
+
+inline task<void> promise<void>::get_return_object() noexcept {
+	return task<void>(std::coroutine_handle<promise<void>>::from_promise(*this));
+}
+
+} /* namespace detail */
+
+/* ===================================== */
+
+/**
+ * Results, cc is zero or an errno
+ */
+
+struct reply {
+	int cc;
+	int wc;                               /** Words in rxbuf */
+	unsigned short rxbuf[RX_BUF_SIZE+1];  /** Status word then data */
+};
+
+struct csr_reply {
+	int cc;
+	unsigned short csr;
+	unsigned short str;
+};
+
+struct str_reply {
+	int cc;
+	unsigned short str;
+};
+
+/* ===================================== */
+
+/**
+ * Counts spawned tasks, co_await gives back control once all are done
+ */
+
+class join {
+public:
+	bool await_ready() const noexcept { return count_ == 0; }
+	void await_suspend(std::coroutine_handle<> h) noexcept { waiter_ = h; }
+	void await_resume() const noexcept {}
+
+	void add() noexcept { count_++; }
+	void done() noexcept {
+		if ((--count_ == 0) && waiter_)
+			std::exchange(waiter_, {}).resume();
+	}
+
+private:
+	int count_ = 0;
+	std::coroutine_handle<> waiter_;
+};
+
+/* ===================================== */
+
+class bus {
+public:
+
+	/** Epoll tags, anything else is a sleeper */
+
+	static constexpr uint64_t DEV_TAG = 0;
+
+	/**
+	 * One frame, see rtilib_send_receive. co_await gives a reply.
+	 */
+
+	class frame_awaiter {
+	public:
+		frame_awaiter(bus &b, int bc, int rti, int wc, int sa, int tr,
+			      const unsigned short *txbuf) noexcept
+			: bus_(b), bc_(bc) {
+			std::memset(&item_, 0, sizeof(item_));
+			std::memset(&reply_, 0, sizeof(reply_));
+			item_.bc         = bc;
+			item_.rti_number = rti;
+			item_.txreg      = txreg(wc, sa, tr, rti);
+			if (txbuf && (tr == TR_WRITE) && (wc > 0) && (wc <= TX_BUF_SIZE))
+				std::memcpy(item_.txbuf, txbuf, sizeof(unsigned short) * wc);
+		}
+
+		bool await_ready() noexcept {
+			if ((bc_ <= 0) || (bc_ >= BCS)) {
+				reply_.cc = EINVAL;
+				return true;
+			}
+			return false;
+		}
+		bool await_suspend(std::coroutine_handle<> h) noexcept {
+			struct mil1553_send_s send;
+
+			h_ = h;
+			send.item_count    = 1;
+			send.tx_item_array = &item_;
+			if (::ioctl(bus_.dev_.get(), MIL1553_SEND, &send) < 0) {
+				reply_.cc = errno;
+				return false;
+			}
+			bus_.pending_[bc_].push_back(this);
+			bus_.frames_++;
+			return true;
+		}
+		reply await_resume() noexcept { return reply_; }
+
+	private:
+		friend class bus;
+
+		static constexpr unsigned int txreg(int wc, int sa, int tr, int rti) noexcept {
+			if (wc >= 32)
+				wc = 0;
+			return RTI_CMD_TXREG(RTI_CMD(wc, sa, tr), rti);
+		}
+
+		bus &bus_;
+		int bc_;
+		struct mil1553_tx_item_s item_;
+		reply reply_;
+		std::coroutine_handle<> h_;
+	};
+
+	/**
+	 * Suspend for us microseconds on a timerfd, co_await gives zero or errno
+	 */
+
+	class sleep_awaiter {
+	public:
+		sleep_awaiter(bus &b, unsigned int us) noexcept : bus_(b), us_(us) {}
+
+		bool await_ready() const noexcept { return us_ == 0; }
+		bool await_suspend(std::coroutine_handle<> h) noexcept {
+			struct itimerspec its;
+			struct epoll_event ev;
+
+			h_ = h;
+			tfd_ = handle(::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC));
+			if (!tfd_) {
+				cc_ = errno;
+				return false;
+			}
+			std::memset(&its, 0, sizeof(its));
+			its.it_value.tv_sec  = us_ / 1000000;
+			its.it_value.tv_nsec = (us_ % 1000000) * 1000;
+			ev.events   = EPOLLIN;
+			ev.data.u64 = reinterpret_cast<uint64_t>(this);
+			if ((::timerfd_settime(tfd_.get(), 0, &its, NULL) < 0)
+			||  (::epoll_ctl(bus_.ep_.get(), EPOLL_CTL_ADD, tfd_.get(), &ev) < 0)) {
+				cc_ = errno;
+				return false;
+			}
+			bus_.sleepers_++;
+			return true;
+		}
+		int await_resume() noexcept { return cc_; }
+
+	private:
+		friend class bus;
+
+		void fire() noexcept {
+			::epoll_ctl(bus_.ep_.get(), EPOLL_CTL_DEL, tfd_.get(), NULL);
+			tfd_.reset();
+			bus_.sleepers_--;
+			h_.resume();
+		}
+
+		bus &bus_;
+		unsigned int us_;
+		int cc_ = 0;
+		handle tfd_;
+		std::coroutine_handle<> h_;
+	};
+
+	/**
+	 * @brief Open the driver and the executor
+	 * @param path Device, a bound /dev/mil1553.<bc> is not supported
+	 *
+	 * error() tells if it worked.
+	 */
+
+	explicit bus(const char *path = "/dev/mil1553") {
+		struct epoll_event ev;
+
+		dev_ = handle(::open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC));
+		if (!dev_) {
+			error_ = errno;
+			return;
+		}
+		ep_ = handle(::epoll_create1(EPOLL_CLOEXEC));
+		ev.events   = EPOLLIN;
+		ev.data.u64 = DEV_TAG;
+		if (!ep_ || (::epoll_ctl(ep_.get(), EPOLL_CTL_ADD, dev_.get(), &ev) < 0))
+			error_ = errno;
+	}
+
+	bus(const bus &) = delete;
+	bus &operator=(const bus &) = delete;
+
+	int error() const noexcept { return error_; }
+	int fd() const noexcept { return dev_.get(); }
+	unsigned long frames() const noexcept { return frames_; }
+
+	/* ===================================== */
+
+	frame_awaiter frame(int bc, int rti, int wc, int sa, int tr,
+			    const unsigned short *txbuf = nullptr) noexcept {
+		return frame_awaiter(*this, bc, rti, wc, sa, tr, txbuf);
+	}
+
+	sleep_awaiter sleep_us(unsigned int us) noexcept {
+		return sleep_awaiter(*this, us);
+	}
+
+	/**
+	 * @brief Start a task now, run() returns once all are done
+	 * @param t The task, owned by the bus from now on
+	 * @param j Optional join told when it is done
+	 */
+
+	void spawn(task<void> t, join *j = nullptr) {
+		if (j)
+			j->add();
+		live_++;
+		run_detached(std::move(t), j);
+	}
+
+	/**
+	 * @brief Serve driver completions and timers until no task is left
+	 * @return Zero or errno, pending frames are then failed with it
+	 */
+
+	int run() {
+		struct epoll_event evs[EVENTS];
+		int i, n;
+
+		while (live_ > 0) {
+			if (!pending() && !sleepers_)
+				return fail_all(EDEADLK);     /** Nothing can wake anyone */
+			n = ::epoll_wait(ep_.get(), evs, EVENTS, -1);
+			if (n < 0) {
+				if (errno == EINTR)
+					continue;
+				return fail_all(errno);
+			}
+			for (i = 0; i < n; i++) {
+				if (evs[i].data.u64 == DEV_TAG) {
+					if (drain() < 0)
+						return fail_all(errno);
+				} else
+					reinterpret_cast<sleep_awaiter *>(evs[i].data.u64)->fire();
+			}
+		}
+		return 0;
+	}
+
+	/* ===================================== */
+
+	/**
+	 * RTI register access, same frames as librti
+	 */
+
+	task<csr_reply> read_csr(int bc, int rti) {
+		reply r = co_await frame(bc, rti, 1, SA_CSR, TR_READ);
+		co_return csr_reply{r.cc, r.rxbuf[1], r.rxbuf[0]};
+	}
+
+	task<str_reply> read_str(int bc, int rti) {
+		reply r = co_await frame(bc, rti, MODE_READ_STR, SA_MODE, TR_READ);
+		co_return str_reply{r.cc, r.rxbuf[0]};
+	}
+
+	task<int> set_csr(int bc, int rti, unsigned short csr) {
+		reply r = co_await frame(bc, rti, 1, SA_SET_CSR, TR_WRITE, &csr);
+		co_return r.cc;
+	}
+
+	task<int> clear_csr(int bc, int rti, unsigned short csr) {
+		reply r = co_await frame(bc, rti, 1, SA_CLEAR_CSR, TR_WRITE, &csr);
+		co_return r.cc;
+	}
+
+	/**
+	 * @brief Read the TXBUF of an RTI once TB is set, see rtilib_recv_eqp_seg
+	 * @param rxbuf Status word of the first frame then wc words
+	 * @return Zero or errno, negative ETIMEDOUT if TB never came
+	 */
+
+	task<int> recv_eqp(int bc, int rti, int wc, unsigned short *rxbuf) {
+		str_reply s;
+		reply r;
+		int i, cc, off, fwc;
+
+		if ((wc <= 0) || (wc > RTI_EQP_WORDS))
+			co_return EINVAL;
+
+		for (i = 0; i < WAIT_POLLS; i++) {
+			if (i)
+				co_await sleep_us(WAIT_TB_us);
+			s = co_await read_str(bc, rti);
+			if (s.cc)
+				co_return s.cc;
+			if (s.str & STR_TB)
+				break;
+		}
+		if (i == WAIT_POLLS)
+			co_return -ETIMEDOUT;
+
+		cc = co_await set_csr(bc, rti, CSR_RTP);
+		if (cc)
+			co_return cc;
+		for (off = 0; off < wc; off += fwc) {
+			fwc = wc - off;
+			if (fwc > TX_BUF_SIZE)
+				fwc = TX_BUF_SIZE;
+			r = co_await frame(bc, rti, fwc, SA_TXBUF, TR_READ);
+			if (r.cc)
+				co_return r.cc;
+			if (off == 0)
+				rxbuf[0] = r.rxbuf[0];
+			std::memcpy(&rxbuf[1 + off], &r.rxbuf[1], sizeof(unsigned short) * fwc);
+		}
+		co_return co_await clear_csr(bc, rti, CSR_TB | CSR_INT);
+	}
+
+	/**
+	 * @brief Acquisition of a quick data chain, as mil1553_get_raw_quick_data_net
+	 * @return Zero, or EINPROGRESS if some buffer has its error set
+	 *
+	 * All the buffers are read at the same time, one coroutine each.
+	 */
+
+	task<int> read_acq(struct quick_data_buffer *chain) {
+		struct quick_data_buffer *q;
+		join j;
+		int occ = 0;
+
+		for (q = chain; q; q = q->next)
+			spawn(read_one(q), &j);
+		co_await j;
+		for (q = chain; q; q = q->next)
+			if (q->error)
+				occ = EINPROGRESS;
+		co_return occ;
+	}
+
+private:
+	static constexpr int BCS = 32;
+	static constexpr int EVENTS = 16;
+	static constexpr int RECVS = 16;
+	static constexpr int WAIT_POLLS = 3;             /** As librti */
+	static constexpr unsigned int WAIT_TB_us = 1000;
+	static constexpr int HEADER_SIZE = 8;            /** As libquick */
+	static constexpr int QDP_WORDS = QDP_USZ / 2;
+
+	void run_detached(task<void> t, join *j) {
+		[](bus *b, task<void> t, join *j) -> detail::detached {
+			co_await t;
+			b->live_--;
+			if (j)
+				j->done();
+		}(this, std::move(t), j);
+	}
+
+	task<void> read_one(struct quick_data_buffer *q) {
+		unsigned short rxbuf[RTI_EQP_WORDS+1], str;
+		int cc, wc;
+
+		wc = (q->pktcnt + 1) / 2;
+		if (wc > QDP_WORDS)
+			wc = QDP_WORDS;
+		wc += HEADER_SIZE;
+
+		cc = co_await recv_eqp(q->bc, q->rt, wc, rxbuf);
+		str = rxbuf[0];
+		if (cc)
+			q->error = (short) cc;
+		else if (str & STR_TIM)
+			q->error = ETIMEDOUT;
+		else if (str & STR_ME)
+			q->error = EPROTO;
+		else if (str & STR_BUY)
+			q->error = EBUSY;
+		else if (q->rt != ((str & STR_RTI_MASK) >> STR_RTI_SHIFT))
+			q->error = ENODEV;
+		else {
+			swab(&rxbuf[HEADER_SIZE+1], q->pkt, (wc - HEADER_SIZE) * sizeof(short));
+			q->error = 0;
+		}
+	}
+
+	bool pending() const noexcept {
+		for (int bc = 0; bc < BCS; bc++)
+			if (!pending_[bc].empty())
+				return true;
+		return false;
+	}
+
+	/**
+	 * Read the waiting events, each TX_END completes the oldest frame
+	 * of its BC, the driver runs a BC queue in order.
+	 */
+
+	int drain() {
+		struct mil1553_recv_s recv[RECVS];
+		struct mil1553_rti_interrupt_s *e;
+		frame_awaiter *fa;
+		ssize_t got;
+		int i, n, wc;
+
+		for (;;) {
+			got = ::read(dev_.get(), recv, sizeof(recv));
+			if (got < 0)
+				return (errno == EAGAIN) ? 0 : -1;
+			n = got / sizeof(recv[0]);
+			for (i = 0; i < n; i++) {
+				e = &recv[i].interrupt;
+				if ((recv[i].pk_type != TX_END)
+				||  (e->bc >= (unsigned int) BCS) || pending_[e->bc].empty())
+					continue;       /** Subscribed events, not ours */
+				fa = pending_[e->bc].front();
+				pending_[e->bc].pop_front();
+				wc = e->wc;
+				if (wc > RX_BUF_SIZE + 1)
+					wc = RX_BUF_SIZE + 1;
+				fa->reply_.cc = e->status;
+				fa->reply_.wc = wc;
+				std::memcpy(fa->reply_.rxbuf, e->rxbuf, sizeof(unsigned short) * wc);
+				fa->h_.resume();
+			}
+			if (n < RECVS)
+				return 0;
+		}
+	}
+
+	int fail_all(int cc) {
+		frame_awaiter *fa;
+
+		for (int bc = 0; bc < BCS; bc++) {
+			while (!pending_[bc].empty()) {
+				fa = pending_[bc].front();
+				pending_[bc].pop_front();
+				fa->reply_.cc = cc;
+				fa->h_.resume();
+			}
+		}
+		return cc;
+	}
+
+	handle dev_;
+	handle ep_;
+	int error_ = 0;
+	int live_ = 0;
+	int sleepers_ = 0;
+	unsigned long frames_ = 0;
+	std::deque<frame_awaiter *> pending_[BCS];
+};
+
+} /* namespace mil1553co */
+
+#endif /* _LIBMIL1553CO_HPP */
@@ -12,6 +12,7 @@
  */
 
 #include <libquick-serial.h>
+#include <libarbiter.h>
 #include <stdlib.h>
 #include <time.h>
 #include <sys/time.h>
@@ -27,6 +28,7 @@
 
 #define HEADER_SIZE 8
 #define MESS_SIZE (TX_BUF_SIZE - HEADER_SIZE -1)
+#define QDP_WORDS (QDP_USZ / 2)
 
 struct msg_header_s {
 	short packet_size;
@@ -73,6 +75,25 @@ static void build_message_header(struct quick_data_buffer *quick_pt,
 		dest_transport = 0x8000;
 }
 
+/**
+ * Payloads longer than MESS_SIZE words are sent and read back as one
+ * QDP packet spread over consecutive frames, see rtilib_send_eqp_seg.
+ */
+
+static int send_eqp(int fn, int bc, int rt, int wc, unsigned short *txbuf) {
+
+	if (wc > MESS_SIZE + HEADER_SIZE)
+		return rtilib_send_eqp_seg(fn,bc,rt,wc,txbuf);
+	return rtilib_send_eqp(fn,bc,rt,wc,txbuf);
+}
+
+static int recv_eqp(int fn, int bc, int rt, int wc, unsigned short *rxbuf) {
+
+	if (wc > MESS_SIZE + HEADER_SIZE)
+		return rtilib_recv_eqp_seg(fn,bc,rt,wc,rxbuf);
+	return rtilib_recv_eqp(fn,bc,rt,wc,rxbuf);
+}
+
 #ifdef DEBUG
 void mil1553_print_message_header(struct msg_header_s *msh) {
 
@@ -108,6 +129,15 @@ void mil1553_print_message_header(struct msg_header_s *msh) {
 
 int mil1553_init_quickdriver(void) {
 	int cc;
+	char *prio;
+
+	/* Go through the bus arbiter if asked to and it is running */
+
+	if ((prio = getenv(ARB_PRIO_ENV))) {
+		cc = arb_attach(atoi(prio));
+		if (cc >= 0)
+			return cc;
+	}
 	cc = open(MIL1553_DEV_PATH, O_RDWR, 0);
 	return cc;
 }
@@ -128,7 +158,7 @@ short mil1553_send_raw_quick_data(int fn, struct quick_data_buffer *quick_pt) {
 	struct quick_data_buffer *qptr;
 	unsigned short *wptr;
 	int i, j, cc, wc, occ;
-	unsigned short txbuf[TX_BUF_SIZE];
+	unsigned short txbuf[RTI_EQP_WORDS];
 
 	occ = 0;    /* Clear overall completion code */
 
@@ -142,15 +172,15 @@ short mil1553_send_raw_quick_data(int fn, struct quick_data_buffer *quick_pt) {
 			txbuf[i] = wptr[i];
 
 		wc = (qptr->pktcnt + 1)/2;
-		if (wc > MESS_SIZE)
-			wc = MESS_SIZE;
+		if (wc > QDP_WORDS)
+			wc = QDP_WORDS;
 		wc += HEADER_SIZE;
 
 		wptr = (unsigned short *) qptr->pkt;
 		for (i=HEADER_SIZE, j=0; i<wc; i++,j++)
 			txbuf[i] = wptr[j];
 
-		cc = rtilib_send_eqp(fn,qptr->bc,qptr->rt,wc,txbuf);
+		cc = send_eqp(fn,qptr->bc,qptr->rt,wc,txbuf);
 		if (cc) {
 			qptr->error = (short) cc;
 			occ = EINPROGRESS;  /* Overall cc error, continue with next */
@@ -178,7 +208,7 @@ short mil1553_get_raw_quick_data(int fn, struct quick_data_buffer *quick_pt) {
 	struct quick_data_buffer *qptr;
 	unsigned short *wptr;
 	int i, j, cc, wc, occ;
-	unsigned short rxbuf[RX_BUF_SIZE], str, rti;
+	unsigned short rxbuf[RTI_EQP_WORDS+1], str, rti;
 
 	occ = 0;    /* Clear overall completion code */
 
@@ -186,11 +216,11 @@ short mil1553_get_raw_quick_data(int fn, struct quick_data_buffer *quick_pt) {
 	while (qptr) {
 
 		wc = (qptr->pktcnt + 1)/2;
-		if (wc > MESS_SIZE)
-			wc = MESS_SIZE;
+		if (wc > QDP_WORDS)
+			wc = QDP_WORDS;
 		wc += HEADER_SIZE;
 
-		cc = rtilib_recv_eqp(fn,qptr->bc,qptr->rt,wc,rxbuf);
+		cc = recv_eqp(fn,qptr->bc,qptr->rt,wc,rxbuf);
 		if (cc) {
 			qptr->error = (short) cc;
 			occ = EINPROGRESS;  /* Overall cc error, continue with next */
@@ -220,7 +250,7 @@ short mil1553_get_raw_quick_data(int fn, struct quick_data_buffer *quick_pt) {
 		}
 		msh = (struct msg_header_s *) &rxbuf[1];
 		wptr = (unsigned short *) qptr->pkt;
-		for (i=0,j=HEADER_SIZE+1; i<wc; i++,j++)
+		for (i=0,j=HEADER_SIZE+1; i<wc-HEADER_SIZE; i++,j++)
 			wptr[i] = rxbuf[j];
 
 		qptr->error = 0;
@@ -245,22 +275,22 @@ Next_qp:        qptr = qptr->next;
  *     But the read back byte order is big endian so you must byte swap.
  */
 
-/* (1) Swap words in a float */
+/* (1) Swap words in a 32 bit field, floats and integers alike */
 
-static void FloatWordSwap(float *f) {
+static inline void SwapWords(void *p) {
 
-	unsigned short *wp, w;
-	wp = (unsigned short *) f;
-	w = *wp;
-	*wp = wp[1];
-	wp[1] = w;
+	unsigned int v;
+	memcpy(&v, p, sizeof(v));
+	v = (v << 16) | (v >> 16);
+	memcpy(p, &v, sizeof(v));
 }
 
 /* (2) Swap consecutive char fields */
 
-static void FieldSwap(unsigned char *cp) {
+static inline void SwapChars(void *p) {
 
-	char c = *cp;
+	unsigned char *cp = p;
+	unsigned char c = *cp;
 	*cp = cp[1];
 	cp[1] = c;
 }
@@ -288,19 +318,12 @@ void FloatPrint(float f) {
 /*     where there is a bug in the way floats are returned out of */
 /*     network order. */
 
-static float FloatByteSwap(float f) {
-  union {
-    float f;
-    unsigned char b[4];
-  } dat1, dat2;
-
-  dat1.f = f;
-  dat2.b[0] = dat1.b[1];
-  dat2.b[1] = dat1.b[0];
-  dat2.b[2] = dat1.b[3];
-  dat2.b[3] = dat1.b[2];
+static inline void SwapBytes(void *p) {
 
-  return dat2.f;
+	unsigned int v;
+	memcpy(&v, p, sizeof(v));
+	v = ((v & 0x00FF00FF) << 8) | ((v >> 8) & 0x00FF00FF);
+	memcpy(p, &v, sizeof(v));
 }
 
 /* (4) Swap words in 32 bit integers */
@@ -322,69 +345,64 @@ unsigned int l, r;
  * power supply and requires special handling (See: mil1553_old_power_supply).
  * In general floats are just word swapped. You don't need to call these
  * functions if you are not using the raw send/receive routines.
+ *
+ * They are generated from the XXX_MSG_LAYOUT tables in pow_messages_serial.h,
+ * each one is straight line code with one swap per listed field. The _MSG
+ * variants convert the request header and the specific part in one go.
+ * Only layouts with QS_FLOAT fields look at byte_floats.
  */
 
+#define QS_CHARS(p, byte_floats) SwapChars(p)
+#define QS_WORDS(p, byte_floats) SwapWords(p)
+#define QS_FLOAT(p, byte_floats) ((byte_floats) ? SwapBytes(p) : SwapWords(p))
+
+#define QS_FIELD(field, kind) kind(&msg->field, byte_floats);
+
+#define QS_SERIALIZER(name, type, LAYOUT)                                  \
+static void name(type *msg, __attribute__((unused)) int byte_floats) {     \
+	LAYOUT(QS_FIELD)                                                   \
+}
+
+#define QS_SERIALIZER_MSG(name, type, LAYOUT)                              \
+static void name(type *msg, __attribute__((unused)) int byte_floats) {     \
+	REQ_MSG_LAYOUT(QS_FIELD)                                           \
+	LAYOUT(QS_FIELD)                                                   \
+}
+
+QS_SERIALIZER(qs_req,  req_msg,  REQ_MSG_LAYOUT)
+QS_SERIALIZER(qs_ctrl, ctrl_msg, CTRL_MSG_LAYOUT)
+QS_SERIALIZER(qs_acq,  acq_msg,  ACQ_MSG_LAYOUT)
+QS_SERIALIZER(qs_conf, conf_msg, CONF_MSG_LAYOUT)
+
+QS_SERIALIZER_MSG(qs_ctrl_msg, ctrl_msg, CTRL_MSG_LAYOUT)
+QS_SERIALIZER_MSG(qs_acq_msg,  acq_msg,  ACQ_MSG_LAYOUT)
+QS_SERIALIZER_MSG(qs_conf_msg, conf_msg, CONF_MSG_LAYOUT)
+
 void serialize_req_msg(req_msg  *req_p) {
 
-	FieldSwap((unsigned char *) &req_p->type);
-	WordSwap(&req_p->protocol_date.sec);
-	WordSwap(&req_p->protocol_date.usec);
+	qs_req(req_p,0);
 }
 
 int mil1553_old_power_supply = 0;
 
 void serialize_read_ctrl_msg(ctrl_msg *ctrl_p) {
 
-	FieldSwap((unsigned char *) &ctrl_p->ccsact_change);
-
-	if (mil1553_old_power_supply) {
-		ctrl_p->ccv  = FloatByteSwap(ctrl_p->ccv);
-		ctrl_p->ccv1 = FloatByteSwap(ctrl_p->ccv1);
-		ctrl_p->ccv2 = FloatByteSwap(ctrl_p->ccv2);
-		ctrl_p->ccv3 = FloatByteSwap(ctrl_p->ccv3);
-	} else {
-		FloatWordSwap(&ctrl_p->ccv);
-		FloatWordSwap(&ctrl_p->ccv1);
-		FloatWordSwap(&ctrl_p->ccv2);
-		FloatWordSwap(&ctrl_p->ccv3);
-	}
-
-	FieldSwap((unsigned char *) &ctrl_p->ccv_change);
-	FieldSwap((unsigned char *) &ctrl_p->ccv2_change);
+	qs_ctrl(ctrl_p,mil1553_old_power_supply);
 }
 
 void serialize_write_ctrl_msg(ctrl_msg *ctrl_p) {
 
-	FieldSwap((unsigned char *) &ctrl_p->ccsact_change);
-
-	FloatWordSwap(&ctrl_p->ccv);
-	FloatWordSwap(&ctrl_p->ccv1);
-	FloatWordSwap(&ctrl_p->ccv2);
-	FloatWordSwap(&ctrl_p->ccv3);
-
-	FieldSwap((unsigned char *) &ctrl_p->ccv_change);
-	FieldSwap((unsigned char *) &ctrl_p->ccv2_change);
+	qs_ctrl(ctrl_p,0);
 }
 
 void serialize_acq_msg(acq_msg *acq_p) {
 
-	FieldSwap((unsigned char *) &acq_p->phys_status);
-	FieldSwap((unsigned char *) &acq_p->ext_aspect);
-
-	FloatWordSwap(&acq_p->aqn);
-	FloatWordSwap(&acq_p->aqn1);
-	FloatWordSwap(&acq_p->aqn2);
-	FloatWordSwap(&acq_p->aqn3);
+	qs_acq(acq_p,0);
 }
 
 void serialize_conf_msg(conf_msg *conf_p) {
 
-	FloatWordSwap(&conf_p->i_nominal);
-	FloatWordSwap(&conf_p->resolution);
-	FloatWordSwap(&conf_p->i_max);
-	FloatWordSwap(&conf_p->i_min);
-	FloatWordSwap(&conf_p->di_dt);
-	FloatWordSwap(&conf_p->mode);
+	qs_conf(conf_p,0);
 }
 
 /**
@@ -402,27 +420,26 @@ void serialize(struct quick_data_buffer *quick_pt, int rflag) {
 
 		req_msg *req_p = (req_msg *) qdp->pkt;
 
-		serialize_req_msg(req_p);
-
 		switch (req_p->service) {
 
 			case RS_REF:
 				if (!rflag)
-					serialize_write_ctrl_msg((ctrl_msg *) quick_pt->pkt);
+					qs_ctrl_msg((ctrl_msg *) qdp->pkt,0);
 				else
-					serialize_acq_msg((acq_msg *) quick_pt->pkt);
+					qs_acq_msg((acq_msg *) qdp->pkt,0);
 			break;
 
 			case RS_ECHO:
-				serialize_read_ctrl_msg((ctrl_msg*)quick_pt->pkt);
+				qs_ctrl_msg((ctrl_msg *) qdp->pkt,mil1553_old_power_supply);
 			break;
 
 			case RS_CONF:
-				serialize_conf_msg((conf_msg*)quick_pt->pkt);
+				qs_conf_msg((conf_msg *) qdp->pkt,0);
 			break;
 
 			default:
-				/* Just send it the way it is, no conversion */
+				/* Just the header, the rest goes the way it is */
+				qs_req(req_p,0);
 			break;
 		}
 
@@ -737,6 +754,8 @@ static int lock_bc(int fn, int bc)
 {
 	int cc = 0;
 	unsigned long reg = bc;
+	if (arb_handle(fn))
+		return arb_lock_bc(fn, bc);
 	cc = ioctl(fn, MIL1553_LOCK_BC, &reg);
 	if (cc < 0)
 		return errno;
@@ -747,6 +766,8 @@ static int unlock_bc(int fn, int bc) {
 
 	int cc = 0;
 	unsigned long reg = bc;
+	if (arb_handle(fn))
+		return arb_unlock_bc(fn, bc);
 	cc = ioctl(fn, MIL1553_UNLOCK_BC, &reg);
 	if (cc < 0)
 		return errno;
@@ -767,6 +788,14 @@ static int unlock_bc(int fn, int bc) {
 
 #define RETRIES 2
 
+/* Configuration messages by (bc, rti), see rtilib_cache_gen */
+
+static struct {
+	unsigned int gen;
+	int valid;
+	conf_msg conf;
+} cfg_cache[CACHE_BCS][32];
+
 int mil1553_read_cfg_msg(int fn, int bc, int rti, conf_msg *conf_ptr) {
 
 struct quick_data_buffer send_buf = { 0 },
@@ -776,9 +805,16 @@ struct quick_data_buffer send_buf = { 0 },
 req_msg *req_ptr;
 conf_msg *loc_conf_ptr;
 short mbno = 1;
-int cc, retries;
+int cc, retries, cached;
+unsigned int gen = 0;
 struct timeval cur_time = { 0 };
 
+   cached = (rtilib_cache_gen(fn,bc,rti,&gen) == 0);
+   if (cached && cfg_cache[bc][rti].valid && (cfg_cache[bc][rti].gen == gen)) {
+      memcpy(conf_ptr,&cfg_cache[bc][rti].conf,sizeof(conf_msg));
+      return 0;
+   }
+
    retries = 0;
 
    /* Wait for the BC lock */
@@ -848,6 +884,11 @@ retry:
 
    memcpy(conf_ptr,loc_conf_ptr,sizeof(conf_msg));
 
+   if (cached && (cc == 0)) {
+      memcpy(&cfg_cache[bc][rti].conf,loc_conf_ptr,sizeof(conf_msg));
+      cfg_cache[bc][rti].gen   = gen;
+      cfg_cache[bc][rti].valid = 1;
+   }
    return cc;
 }
 
@@ -1120,8 +1161,8 @@ short mil1553_send_raw_quick_data_net(int fn, struct quick_data_buffer *quick_pt
 	struct msg_header_s msh;
 	struct quick_data_buffer *qptr;
 	unsigned short *wptr;
-	int i, j, cc, wc, occ;
-	unsigned short txbuf[TX_BUF_SIZE];
+	int i, cc, wc, occ;
+	unsigned short txbuf[RTI_EQP_WORDS];
 
 	occ = 0;    /* Clear overall completion code */
 
@@ -1134,15 +1175,14 @@ short mil1553_send_raw_quick_data_net(int fn, struct quick_data_buffer *quick_pt
 			txbuf[i] = wptr[i];
 
 		wc = (qptr->pktcnt + 1)/2;
-		if (wc > MESS_SIZE)
-			wc = MESS_SIZE;
+		if (wc > QDP_WORDS)
+			wc = QDP_WORDS;
 		wc += HEADER_SIZE;
 
 		wptr = (unsigned short *) qptr->pkt;
-		for (i=HEADER_SIZE, j=0; i<wc; i++,j++)
-			swab(&wptr[j],&txbuf[i],sizeof(short));
+		swab(wptr,&txbuf[HEADER_SIZE],(wc - HEADER_SIZE) * sizeof(short));
 
-		cc = rtilib_send_eqp(fn,qptr->bc,qptr->rt,wc,txbuf);
+		cc = send_eqp(fn,qptr->bc,qptr->rt,wc,txbuf);
 		if (cc) {
 			qptr->error = (short) cc;
 			occ = EINPROGRESS;  /* Overall cc error, continue with next */
@@ -1169,8 +1209,8 @@ short mil1553_get_raw_quick_data_net(int fn, struct quick_data_buffer *quick_pt)
 	struct msg_header_s *msh;
 	struct quick_data_buffer *qptr;
 	unsigned short *wptr;
-	int i, j, cc, wc, occ;
-	unsigned short rxbuf[RX_BUF_SIZE], str, rti;
+	int cc, wc, occ;
+	unsigned short rxbuf[RTI_EQP_WORDS+1], str, rti;
 
 	occ = 0;    /* Clear overall completion code */
 
@@ -1178,11 +1218,11 @@ short mil1553_get_raw_quick_data_net(int fn, struct quick_data_buffer *quick_pt)
 	while (qptr) {
 
 		wc = (qptr->pktcnt + 1)/2;
-		if (wc > MESS_SIZE)
-			wc = MESS_SIZE;
+		if (wc > QDP_WORDS)
+			wc = QDP_WORDS;
 		wc += HEADER_SIZE;
 
-		cc = rtilib_recv_eqp(fn,qptr->bc,qptr->rt,wc,rxbuf);
+		cc = recv_eqp(fn,qptr->bc,qptr->rt,wc,rxbuf);
 		if (cc) {
 			qptr->error = (short) cc;
 			occ = EINPROGRESS;  /* Overall cc error, continue with next */
@@ -1212,8 +1252,7 @@ short mil1553_get_raw_quick_data_net(int fn, struct quick_data_buffer *quick_pt)
 		}
 		msh = (struct msg_header_s *) &rxbuf[1];
 		wptr = (unsigned short *) qptr->pkt;
-		for (i=0,j=HEADER_SIZE+1; i<wc; i++,j++)
-			swab(&rxbuf[j],&wptr[i],sizeof(short));
+		swab(&rxbuf[HEADER_SIZE+1],wptr,(wc - HEADER_SIZE) * sizeof(short));
 
 		qptr->error = 0;
 Next_qp:        qptr = qptr->next;
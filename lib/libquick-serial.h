@@ -69,6 +69,8 @@ struct quick_data_buffer {
  * Every thread should obtain its own file handle, there is no limit to the
  * number of concurrent threads that can use the library.
  * This is now thread safe, sorry I changed the API.
+ * When MIL1553_ARBITER is set and the arbiter daemon runs, the handle
+ * is attached to it instead of the driver, see libarbiter.h.
  */
 
 int mil1553_init_quickdriver(void);
@@ -15,6 +15,7 @@
 #define __USE_XOPEN
 #include <unistd.h>
 #include "libquick.h"
+#include "libarbiter.h"
 
 
 /**
@@ -27,6 +28,7 @@
 #define RX_BUF_SIZE	(TX_BUF_SIZE+1)
 #define HEADER_SIZE 8
 #define MESS_SIZE (TX_BUF_SIZE - HEADER_SIZE -1)
+#define QDP_WORDS (QDP_USZ / 2)
 
 struct msg_header_s {
 	short packet_size;
@@ -52,6 +54,8 @@ struct msg_header_s {
 #define QDP_SINGLE_PACKET 3
 #define QDP_QUICK_TYPE 31
 
+#define WAIT_TB_us 1000
+
 static void build_message_header(struct quick_data_buffer *quick_pt,
 						 struct msg_header_s *msh) {
 
@@ -73,6 +77,25 @@ static void build_message_header(struct quick_data_buffer *quick_pt,
 		dest_transport = 0x8000;
 }
 
+/**
+ * Payloads longer than MESS_SIZE words are sent and read back as one
+ * QDP packet spread over consecutive frames, see rtilib_send_eqp_seg.
+ */
+
+static int send_eqp(int fn, int bc, int rt, int wc, unsigned short *txbuf) {
+
+	if (wc > MESS_SIZE + HEADER_SIZE)
+		return rtilib_send_eqp_seg(fn,bc,rt,wc,txbuf);
+	return rtilib_send_eqp(fn,bc,rt,wc,txbuf);
+}
+
+static int recv_eqp(int fn, int bc, int rt, int wc, unsigned short *rxbuf) {
+
+	if (wc > MESS_SIZE + HEADER_SIZE)
+		return rtilib_recv_eqp_seg(fn,bc,rt,wc,rxbuf);
+	return rtilib_recv_eqp(fn,bc,rt,wc,rxbuf);
+}
+
 /**
  * @brief Open the mil1553 driver and initialize library
  * @return File handle greater than zero if successful, or zero on error
@@ -87,6 +110,15 @@ static void build_message_header(struct quick_data_buffer *quick_pt,
 
 int mil1553_init_quickdriver(void) {
 	int cc;
+	char *prio;
+
+	/* Go through the bus arbiter if asked to and it is running */
+
+	if ((prio = getenv(ARB_PRIO_ENV))) {
+		cc = arb_attach(atoi(prio));
+		if (cc >= 0)
+			return cc;
+	}
 	cc = open(MIL1553_DEV_PATH, O_RDWR, 0);
 	return cc;
 }
@@ -176,34 +208,76 @@ void mil1553_print_error(int cc) {
   * need to be serialized. EXPERTS ONLY
   */
 
-short mil1553_send_raw_quick_data_net(int fn, struct quick_data_buffer *quick_pt) {
+/* Header then packet in network order, returns the word count */
+
+static int build_eqp_net(struct quick_data_buffer *qptr, unsigned short *txbuf) {
 
 	struct msg_header_s msh;
-	struct quick_data_buffer *qptr;
 	unsigned short *wptr;
-	int i, j, cc, wc, occ;
-	unsigned short txbuf[RX_BUF_SIZE];
+	int i, wc;
+
+	build_message_header(qptr,&msh);
+	wptr = (unsigned short *) &msh;
+	for (i=0; i<HEADER_SIZE; i++)
+		txbuf[i] = wptr[i];
+
+	wc = (qptr->pktcnt + 1)/2;
+	if (wc > QDP_WORDS)
+		wc = QDP_WORDS;
+	wc += HEADER_SIZE;
+
+	wptr = (unsigned short *) qptr->pkt;
+	swab(wptr,&txbuf[HEADER_SIZE],(wc - HEADER_SIZE) * sizeof(short));
+	return wc;
+}
+
+short mil1553_send_raw_quick_data_net(int fn, struct quick_data_buffer *quick_pt) {
+
+	struct quick_data_buffer *qptr;
+	int cc, wc, occ;
+	unsigned short txbuf[RTI_EQP_WORDS];
 
 	occ = 0;    /* Clear overall completion code */
 
 	qptr = quick_pt;
 	while (qptr) {
 
-		build_message_header(qptr,&msh);
-		wptr = (unsigned short *) &msh;
-		for (i=0; i<HEADER_SIZE; i++)
-			txbuf[i] = wptr[i];
+		wc = build_eqp_net(qptr,txbuf);
+		cc = send_eqp(fn,qptr->bc,qptr->rt,wc,txbuf);
+		if (cc) {
+			qptr->error = (short) cc;
+			occ = EINPROGRESS;  /* Overall cc error, continue with next */
+		} else
+			qptr->error = 0;
 
-		wc = (qptr->pktcnt + 1)/2;
-		if (wc > MESS_SIZE)
-			wc = MESS_SIZE;
-		wc += HEADER_SIZE;
+		qptr = qptr->next;
+	}
+	return occ;
+}
 
-		wptr = (unsigned short *) qptr->pkt;
-		for (i=HEADER_SIZE, j=0; i<wc; i++,j++)
-			swab(&wptr[j],&txbuf[i],sizeof(short));
+/**
+  * @brief stage a quick data buffer chain in network order
+  * @param file handle returned from the init routine
+  * @param pointer to data buffer chain
+  * @return 0 success, else standard system error
+  *
+  * Each message is written to its RTI but RB is not set, so the equipment
+  * doesn't see it until mil1553_commit_quick_data.
+  */
+
+short mil1553_stage_quick_data_net(int fn, struct quick_data_buffer *quick_pt) {
 
-		cc = rtilib_send_eqp(fn,qptr->bc,qptr->rt,wc,txbuf);
+	struct quick_data_buffer *qptr;
+	int cc, wc, occ;
+	unsigned short txbuf[RTI_EQP_WORDS];
+
+	occ = 0;    /* Clear overall completion code */
+
+	qptr = quick_pt;
+	while (qptr) {
+
+		wc = build_eqp_net(qptr,txbuf);
+		cc = rtilib_stage_eqp(fn,qptr->bc,qptr->rt,wc,txbuf);
 		if (cc) {
 			qptr->error = (short) cc;
 			occ = EINPROGRESS;  /* Overall cc error, continue with next */
@@ -215,6 +289,44 @@ short mil1553_send_raw_quick_data_net(int fn, struct quick_data_buffer *quick_pt
 	return occ;
 }
 
+/**
+  * @brief commit a staged quick data buffer chain
+  * @param file handle returned from the init routine
+  * @param pointer to data buffer chain
+  * @return 0 success, else standard system error
+  *
+  * The buffers staged without error are handed to their equipment, per BC
+  * with one broadcast when possible, those broadcasts started together on
+  * all the BCs, see rtilib_commit_eqp_sync.
+  */
+
+short mil1553_commit_quick_data(int fn, struct quick_data_buffer *quick_pt) {
+
+	struct quick_data_buffer *qptr;
+	unsigned int mask[CACHE_BCS], failed[CACHE_BCS];
+	int occ;
+
+	occ = 0;    /* Clear overall completion code */
+	memset(mask, 0, sizeof(mask));
+	memset(failed, 0, sizeof(failed));
+
+	for (qptr = quick_pt; qptr; qptr = qptr->next)
+		if ((qptr->error == 0) && (qptr->bc > 0) && (qptr->bc < CACHE_BCS))
+			mask[(int) qptr->bc] |= 1 << qptr->rt;
+
+	rtilib_commit_eqp_sync(fn,mask,failed,NULL);
+
+	for (qptr = quick_pt; qptr; qptr = qptr->next) {
+		if ((qptr->bc <= 0) || (qptr->bc >= CACHE_BCS))
+			continue;
+		if (failed[(int) qptr->bc] & (1 << qptr->rt)) {
+			qptr->error = EIO;
+			occ = EINPROGRESS;
+		}
+	}
+	return occ;
+}
+
 /**
   * @brief get a raw quick data buffer network order
   * @param file handle returned from the init routine
@@ -230,8 +342,8 @@ short mil1553_get_raw_quick_data_net(int fn, struct quick_data_buffer *quick_pt)
 	struct msg_header_s *msh;
 	struct quick_data_buffer *qptr;
 	unsigned short *wptr;
-	int i, j, cc, wc, occ;
-	unsigned short rxbuf[RX_BUF_SIZE], str, rti;
+	int cc, wc, occ;
+	unsigned short rxbuf[RTI_EQP_WORDS+1], str, rti;
 
 	occ = 0;    /* Clear overall completion code */
 
@@ -239,11 +351,11 @@ short mil1553_get_raw_quick_data_net(int fn, struct quick_data_buffer *quick_pt)
 	while (qptr) {
 
 		wc = (qptr->pktcnt + 1)/2;
-		if (wc > MESS_SIZE)
-			wc = MESS_SIZE;
+		if (wc > QDP_WORDS)
+			wc = QDP_WORDS;
 		wc += HEADER_SIZE;
 
-		cc = rtilib_recv_eqp(fn,qptr->bc,qptr->rt,wc,rxbuf);
+		cc = recv_eqp(fn,qptr->bc,qptr->rt,wc,rxbuf);
 		if (cc) {
 			qptr->error = (short) cc;
 			occ = EINPROGRESS;  /* Overall cc error, continue with next */
@@ -273,11 +385,48 @@ short mil1553_get_raw_quick_data_net(int fn, struct quick_data_buffer *quick_pt)
 		}
 		msh = (struct msg_header_s *) &rxbuf[1];
 		wptr = (unsigned short *) qptr->pkt;
-		for (i=0,j=HEADER_SIZE+1; i<wc; i++,j++)
-			swab(&rxbuf[j],&wptr[i],sizeof(short));
+		swab(&rxbuf[HEADER_SIZE+1],wptr,(wc - HEADER_SIZE) * sizeof(short));
 
 		qptr->error = 0;
 Next_qp:        qptr = qptr->next;
 	}
 	return occ;
 }
+
+/**
+  * @brief wait until the RTIs of a quick data chain have a reply ready
+  * @param file handle returned from the init routine
+  * @param pointer to data buffer chain
+  * @param timeout in micro seconds for the whole chain
+  * @return 0 when every TB bit is set, ETIMEDOUT if one is still clear
+  *
+  * Polls the TB bit in the STR of each RTI in turn, sleeping only while
+  * the current one is not ready, so a chain costs one timeout at most.
+  * The TB bits are left set for the get call. Bus errors are not
+  * reported here, the get call will see them on the buffer.
+  */
+
+short mil1553_wait_quick_data(int fn, struct quick_data_buffer *quick_pt, int timeout_us) {
+
+	struct quick_data_buffer *qptr;
+	struct timeval start, now;
+	unsigned short str;
+	int cc;
+
+	gettimeofday(&start, NULL);
+
+	qptr = quick_pt;
+	while (qptr) {
+		cc = rtilib_read_str(fn,qptr->bc,qptr->rt,&str);
+		if ((cc == 0) && ((str & STR_TB) == 0)) {
+			gettimeofday(&now, NULL);
+			if ((now.tv_sec - start.tv_sec) * 1000000LL
+			 +  (now.tv_usec - start.tv_usec) >= timeout_us)
+				return ETIMEDOUT;
+			usleep(WAIT_TB_us);
+			continue;
+		}
+		qptr = qptr->next;
+	}
+	return 0;
+}
@@ -69,6 +69,8 @@ struct quick_data_buffer {
  * Every thread should obtain its own file handle, there is no limit to the
  * number of concurrent threads that can use the library.
  * This is now thread safe, sorry I changed the API.
+ * When MIL1553_ARBITER is set and the arbiter daemon runs, the handle
+ * is attached to it instead of the driver, see libarbiter.h.
  */
 
 int mil1553_init_quickdriver(void);
@@ -89,6 +91,20 @@ void mil1553_print_error(int cc);
 
 short mil1553_send_raw_quick_data_net(int fn, struct quick_data_buffer *quick_pt);
 
+/**
+  * @brief two phase send of a quick data chain in network order
+  * @param file handle returned from the init routine
+  * @param pointer to data buffer chain
+  * @return 0 success, else standard system error
+  *
+  * Stage writes every message without handing it to the equipment, commit
+  * then hands them all over at once, with one broadcast frame per BC when
+  * the chain covers all the RTIs on it. Buffer errors are as for send.
+  */
+
+short mil1553_stage_quick_data_net(int fn, struct quick_data_buffer *quick_pt);
+short mil1553_commit_quick_data(int fn, struct quick_data_buffer *quick_pt);
+
 /**
   * @brief get a raw quick data buffer network order
   * @param file handle returned from the init routine
@@ -101,6 +117,18 @@ short mil1553_send_raw_quick_data_net(int fn, struct quick_data_buffer *quick_pt
 
 short mil1553_get_raw_quick_data_net(int fn, struct quick_data_buffer *quick_pt);
 
+/**
+  * @brief wait until the RTIs of a quick data chain have a reply ready
+  * @param file handle returned from the init routine
+  * @param pointer to data buffer chain
+  * @param timeout in micro seconds for the whole chain
+  * @return 0 success, ETIMEDOUT if some RTI has no reply ready
+  *
+  * Use between a request and its get instead of a fixed sleep.
+  */
+
+short mil1553_wait_quick_data(int fn, struct quick_data_buffer *quick_pt, int timeout_us);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
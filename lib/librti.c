@@ -1,10 +1,15 @@
 #include <mil1553.h>
 #include <librti.h>
+#include <libarbiter.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <time.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 
 #define DEBUG
 
@@ -93,74 +98,414 @@ char *rtilib_str_to_str(unsigned short str) {
 
 /* ===================================== */
 
-int rtilib_read_csr(int fn, int bc, int rti, unsigned short *csr, unsigned short *str) {
+/**
+ * Bus traffic capture, see librti.h.
+ * The ring is a file mapped MAP_SHARED, the kernel writes it back on
+ * its own so a crash still leaves the last frames on disk.
+ * Threads sending at the same time reserve their records by adding to
+ * head, then write them between capture_open and capture_close which
+ * clear and set the record seq. rtilib_capture_start and _stop must
+ * not run while other threads send.
+ */
 
-	unsigned short rxbuf[RX_BUF_SIZE];
-	unsigned short txbuf[TX_BUF_SIZE];
-	int cc, wc, sa, tr;
+#define CAP_NONE (~0ULL)
 
-	memset(rxbuf, 0, sizeof(unsigned short) * RX_BUF_SIZE);
-	memset(txbuf, 0, sizeof(unsigned short) * TX_BUF_SIZE);
+static struct rti_capture_hdr_s *cap_hdr = NULL;
+static struct rti_capture_rec_s *cap_recs = NULL;
+static size_t cap_len = 0;
+static int cap_env_done = 0;
 
-	wc = 1; sa = SA_CSR; tr = TR_READ;
-	cc = rtilib_send_receive(fn,bc,rti,wc,sa,tr,REPLY,rxbuf,txbuf);
-	*str = rxbuf[0];
-	*csr = rxbuf[1];
-	return cc;
+static unsigned long long cap_now(void) {
+
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int rtilib_capture_start(const char *path, unsigned int frames) {
+
+	struct rti_capture_hdr_s *hdr;
+	size_t len;
+	void *map;
+	int fd, cc;
+
+	rtilib_capture_stop();
+	cap_env_done = 1;
+	if (frames == 0)
+		frames = RTI_CAPTURE_FRAMES;
+	len = sizeof(*cap_hdr) + (size_t) frames * sizeof(*cap_recs);
+
+	fd = open(path,O_RDWR | O_CREAT | O_TRUNC,0644);
+	if (fd < 0)
+		return errno;
+	if (ftruncate(fd,len) < 0) {
+		cc = errno;
+		close(fd);
+		return cc;
+	}
+	map = mmap(NULL,len,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+	cc = errno;
+	close(fd);
+	if (map == MAP_FAILED)
+		return cc;
+
+	hdr = map;
+	hdr->magic     = RTI_CAPTURE_MAGIC;
+	hdr->version   = RTI_CAPTURE_VERSION;
+	hdr->rec_size  = sizeof(*cap_recs);
+	hdr->frames    = frames;
+	hdr->head      = 0;
+	hdr->t0_ns     = cap_now();
+	hdr->start_sec = time(NULL);
+	hdr->pid       = getpid();
+	cap_recs = (struct rti_capture_rec_s *) (hdr + 1);
+	cap_len  = len;
+	__atomic_store_n(&cap_hdr, hdr, __ATOMIC_RELEASE);
+	return 0;
+}
+
+void rtilib_capture_stop(void) {
+
+	if (cap_hdr) {
+		msync(cap_hdr,cap_len,MS_ASYNC);
+		munmap(cap_hdr,cap_len);
+	}
+	cap_hdr  = NULL;
+	cap_recs = NULL;
+	cap_len  = 0;
+}
+
+/* The first frame looks for RTI_CAPTURE_ENV */
+
+static int capture_on(void) {
+
+	char *path;
+
+	if (!__atomic_exchange_n(&cap_env_done, 1, __ATOMIC_ACQ_REL)) {
+		if ((path = getenv(RTI_CAPTURE_ENV)))
+			rtilib_capture_start(path,0);
+	}
+	return __atomic_load_n(&cap_hdr, __ATOMIC_ACQUIRE) != NULL;
+}
+
+/* Data words the BC sends and reply words, as the driver counts them */
+
+static void capture_words(int wc, int sa, int tr, int reply, int *tx_wc, int *rx_wc) {
+
+	int data;
+
+	if ((sa == 0) || (sa == SA_MODE))
+		data = (wc >= 16) ? 1 : 0;      /* Mode codes 16..31 carry a word */
+	else
+		data = wc;
+	if (data < 0)
+		data = 0;
+	if (data > TX_BUF_SIZE)
+		data = TX_BUF_SIZE;
+	*tx_wc = tr ? 0 : data;
+	*rx_wc = reply ? 1 + (tr ? data : 0) : 0;
+}
+
+/* Take n records, returns the number of the first */
+
+static unsigned long long capture_reserve(int n) {
+
+	return __atomic_fetch_add(&cap_hdr->head, n, __ATOMIC_ACQ_REL);
+}
+
+/* A record being written has seq 0, readers skip it */
+
+static struct rti_capture_rec_s *capture_open(unsigned long long seq) {
+
+	struct rti_capture_rec_s *rec = &cap_recs[seq % cap_hdr->frames];
+
+	__atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	return rec;
+}
+
+static void capture_close(unsigned long long seq, struct rti_capture_rec_s *rec) {
+
+	__atomic_store_n(&rec->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+/* Record a batch as sent, capture_end fills in each reply */
+
+static unsigned long long capture_items(struct mil1553_tx_item_s *items, int n,
+					unsigned long long t0, int flags, int status) {
+
+	struct rti_capture_rec_s *rec;
+	unsigned long long seq;
+	int i, wc, sa, tr, tx_wc, rx_wc;
+
+	if (!cap_hdr)
+		return CAP_NONE;
+	seq = capture_reserve(n);
+	for (i=0; i<n; i++) {
+		wc = (items[i].txreg & TXREG_WC_MASK) >> TXREG_WC_SHIFT;
+		sa = (items[i].txreg & TXREG_SUBA_MASK) >> TXREG_SUBA_SHIFT;
+		tr = (items[i].txreg & TXREG_TR_MASK) >> TXREG_TR_SHIFT;
+		if ((wc == 0) && (sa != 0) && (sa != SA_MODE))
+			wc = TX_BUF_SIZE;
+		capture_words(wc,sa,tr,0,&tx_wc,&rx_wc);
+
+		rec = capture_open(seq + i);
+		rec->ts_ns      = t0;
+		rec->latency_ns = 0;
+		rec->bc         = items[i].bc;
+		rec->txreg      = RTI_CMD_TXREG(items[i].txreg,items[i].rti_number);
+		rec->flags      = flags | (items[i].no_reply ? 0 : CAP_REPLY);
+		rec->status     = status;
+		rec->tx_wc      = tx_wc;
+		rec->rx_wc      = 0;
+		memcpy(rec->txbuf, items[i].txbuf, sizeof(unsigned short) * tx_wc);
+		capture_close(seq + i, rec);
+	}
+	return seq;
+}
+
+static void capture_end(unsigned long long seq, struct mil1553_rti_interrupt_s *end) {
+
+	struct rti_capture_rec_s *rec;
+	unsigned int rx_wc;
+
+	if ((seq == CAP_NONE) || !cap_hdr)
+		return;
+	rec = capture_open(seq);
+	rx_wc = end->wc;
+	if (rx_wc > RX_BUF_SIZE)
+		rx_wc = RX_BUF_SIZE;
+	rec->latency_ns = cap_now() - rec->ts_ns;
+	rec->status     = end->status;
+	rec->rx_wc      = rx_wc;
+	memcpy(rec->rxbuf, end->rxbuf, sizeof(unsigned short) * rx_wc);
+	capture_close(seq, rec);
 }
 
 /* ===================================== */
 
-int rtilib_clear_csr(int fn, int bc, int rti, unsigned short csr) {
+static int xfer_unsupported = 0;
 
-	unsigned short rxbuf[RX_BUF_SIZE];
-	unsigned short txbuf[TX_BUF_SIZE];
-	int cc, wc, sa, tr;
+/* *received_wc gets the reply words the driver saw, through the */
+/* arbiter it can't tell and gets -1 */
 
-	memset(rxbuf, 0, sizeof(unsigned short) * RX_BUF_SIZE);
-	memset(txbuf, 0, sizeof(unsigned short) * TX_BUF_SIZE);
+static int send_receive(int fn,
+			int bc,
+			int rti,
+			int wc,
+			int sa,
+			int tr,
+			int nreply,
+			unsigned short *rxbuf,
+			unsigned short *txbuf,
+			int *received_wc) {
 
-	wc = 1; sa = SA_CLEAR_CSR; tr = TR_WRITE;
-	txbuf[0] = csr;
-	cc = rtilib_send_receive(fn,bc,rti,wc,sa,tr,REPLY,rxbuf,txbuf);
+	struct mil1553_xfer_s xfer;
+	struct mil1553_send_recv_s sr;
+	int cc;
+
+	*received_wc = 0;
+	if (arb_handle(fn)) {
+		*received_wc = -1;
+		return arb_send_receive(fn,bc,rti,wc,sa,tr,nreply != NO_REPLY,rxbuf,txbuf);
+	}
+
+	if (!xfer_unsupported) {
+		memset(&xfer, 0, sizeof(xfer));
+		xfer.version = MIL1553_XFER_VERSION;
+		xfer.bc      = bc;
+		xfer.rti     = rti;
+		xfer.sa      = sa;
+		xfer.tr      = tr;
+		xfer.wc      = wc;
+		xfer.flags   = (nreply == NO_REPLY) ? 0 : XFER_REPLY;
+		xfer.txbuf   = (unsigned long) txbuf;
+		xfer.rxbuf   = (unsigned long) rxbuf;
+
+		cc = ioctl(fn,MIL1553_XFER,&xfer);
+		if (cc == 0) {
+			*received_wc = xfer.received_wc;
+			return 0;
+		}
+		if (errno != ENOTTY)
+			return errno;
+		xfer_unsupported = 1;
+	}
+
+	if (wc > TX_BUF_SIZE)
+		wc = TX_BUF_SIZE;
+	memset(&sr, 0, sizeof(sr));
+	sr.bc          = bc;
+	sr.rti         = rti;
+	sr.wc          = wc;
+	sr.sa          = sa;
+	sr.tr          = tr;
+	sr.wants_reply = (nreply == NO_REPLY) ? 0 : 1;
+	if (txbuf)
+		memcpy(sr.txbuf, txbuf, sizeof(unsigned short) * wc);
+
+	cc = ioctl(fn,MIL1553_SEND_RECEIVE,&sr);
+	if (cc < 0)
+		return errno;
+	if (sr.wants_reply && rxbuf)
+		memcpy(rxbuf, sr.rxbuf, sizeof(unsigned short) * (wc + 1));
+	if (sr.wants_reply)
+		*received_wc = (sr.received_wc > wc + 1) ? wc + 1 : sr.received_wc;
+	return 0;
+}
+
+/**
+ * Do one BC/RTI transaction.
+ * Uses the compact MIL1553_XFER ioctl so only the words in use are
+ * copied, and falls back to MIL1553_SEND_RECEIVE on drivers that
+ * don't know it. rxbuf gets the status word followed by the data.
+ * Handles attached to the bus arbiter go through the daemon.
+ * Returns zero or errno.
+ */
+
+int rtilib_send_receive(int fn,
+			int bc,
+			int rti,
+			int wc,
+			int sa,
+			int tr,
+			int nreply,
+			unsigned short *rxbuf,
+			unsigned short *txbuf) {
+
+	unsigned short cap_rxbuf[RX_BUF_SIZE];
+	struct rti_capture_rec_s *rec;
+	unsigned long long t0, seq;
+	int cc, tx_wc, rx_wc, received_wc;
+
+	if (!capture_on())
+		return send_receive(fn,bc,rti,wc,sa,tr,nreply,rxbuf,txbuf,&received_wc);
+
+	if (!rxbuf && (nreply != NO_REPLY))
+		rxbuf = memset(cap_rxbuf, 0, sizeof(cap_rxbuf));     /* Still record the status word */
+	t0 = cap_now();
+	cc = send_receive(fn,bc,rti,wc,sa,tr,nreply,rxbuf,txbuf,&received_wc);
+
+	/* Record the reply as it came, the expected words only if unknown */
+
+	capture_words(wc,sa,tr,nreply != NO_REPLY,&tx_wc,&rx_wc);
+	if (!txbuf)
+		tx_wc = 0;
+	if (received_wc >= 0)
+		rx_wc = received_wc;
+	if (rx_wc > RX_BUF_SIZE)
+		rx_wc = RX_BUF_SIZE;
+	if (cc || !rxbuf)
+		rx_wc = 0;
+
+	seq = capture_reserve(1);
+	rec = capture_open(seq);
+	rec->ts_ns      = t0;
+	rec->latency_ns = cap_now() - t0;
+	rec->bc         = bc;
+	rec->txreg      = RTI_CMD_TXREG(RTI_CMD(wc,sa,tr),rti);
+	rec->flags      = (nreply != NO_REPLY) ? CAP_REPLY : 0;
+	rec->status     = cc;
+	rec->tx_wc      = tx_wc;
+	rec->rx_wc      = rx_wc;
+	if (tx_wc)
+		memcpy(rec->txbuf, txbuf, sizeof(unsigned short) * tx_wc);
+	if (rx_wc)
+		memcpy(rec->rxbuf, rxbuf, sizeof(unsigned short) * rx_wc);
+	capture_close(seq, rec);
 	return cc;
 }
 
 /* ===================================== */
 
-int rtilib_set_csr(int fn, int bc, int rti, unsigned short csr) {
+/**
+ * The fields are masked out of the constant, a word count of zero in
+ * the TXREG is 32 words except for a mode code.
+ */
 
-	unsigned short rxbuf[RX_BUF_SIZE];
-	unsigned short txbuf[TX_BUF_SIZE];
-	int cc, wc, sa, tr;
+int rtilib_send_cmd(int fn, int bc, int rti, unsigned int cmd, int nreply,
+		    unsigned short *rxbuf, unsigned short *txbuf) {
 
-	memset(rxbuf, 0, sizeof(unsigned short) * RX_BUF_SIZE);
-	memset(txbuf, 0, sizeof(unsigned short) * TX_BUF_SIZE);
+	int wc, sa, tr;
 
-	wc = 1; sa = SA_SET_CSR; tr = TR_WRITE;
-	txbuf[0] = csr;
-	cc = rtilib_send_receive(fn,bc,rti,wc,sa,tr,REPLY,rxbuf,txbuf);
+	wc = (cmd & TXREG_WC_MASK) >> TXREG_WC_SHIFT;
+	sa = (cmd & TXREG_SUBA_MASK) >> TXREG_SUBA_SHIFT;
+	tr = (cmd & TXREG_TR_MASK) >> TXREG_TR_SHIFT;
+	if ((wc == 0) && (sa != SA_MODE) && (sa != 0))
+		wc = TX_BUF_SIZE;
+	return rtilib_send_receive(fn,bc,rti,wc,sa,tr,nreply,rxbuf,txbuf);
+}
+
+/* ===================================== */
+
+/**
+ * Driver generation of an RTI, moves on when the RTI goes down or
+ * the BC is reset. Returns zero or errno.
+ */
+
+static int gen_unsupported = 0;
+
+static int rti_gen(int fn, int bc, int rti, unsigned int *gen) {
+
+	struct mil1553_rti_gen_s rg;
+
+	if (gen_unsupported)
+		return ENOTTY;
+	if ((bc < 0) || (bc >= CACHE_BCS) || (rti < 1) || (rti > 30))
+		return EINVAL;
+
+	memset(&rg, 0, sizeof(rg));
+	rg.bc  = bc;
+	rg.rti = rti;
+	if (ioctl(fn, MIL1553_GET_RTI_GEN, &rg) < 0) {
+		if (errno == ENOTTY)
+			gen_unsupported = 1;
+		return errno;
+	}
+	*gen = rg.gen;
+	return 0;
+}
+
+/* ===================================== */
+
+int rtilib_read_csr(int fn, int bc, int rti, unsigned short *csr, unsigned short *str) {
+
+	unsigned short rxbuf[RX_BUF_SIZE];
+	int cc;
+
+	rxbuf[0] = rxbuf[1] = 0;
+	cc = rtilib_send_cmd(fn,bc,rti,RTI_CMD_READ_CSR,REPLY,rxbuf,NULL);
+	*str = rxbuf[0];
+	*csr = rxbuf[1];
 	return cc;
 }
 
 /* ===================================== */
 
+int rtilib_clear_csr(int fn, int bc, int rti, unsigned short csr) {
+
+	return rtilib_send_cmd(fn,bc,rti,RTI_CMD_CLEAR_CSR,REPLY,NULL,&csr);
+}
+
+/* ===================================== */
+
+int rtilib_set_csr(int fn, int bc, int rti, unsigned short csr) {
+
+	return rtilib_send_cmd(fn,bc,rti,RTI_CMD_SET_CSR,REPLY,NULL,&csr);
+}
+
+/* ===================================== */
+
 /**
  * This is just for debugging the RTI
  */
 
 int rtilib_read_rxbuf(int fn, int bc, int rti, int wc, unsigned short *rxbuf) {
 
-	unsigned short txbuf[TX_BUF_SIZE];
-	int cc, sa, tr;
-
-	memset(txbuf, 0, sizeof(unsigned short) * TX_BUF_SIZE);
-
 	rtilib_clear_csr(fn,bc,rti,CSR_RRP);
 
-	sa = SA_RXBUF; tr = TR_READ;
-	cc = rtilib_send_receive(fn,bc,rti,wc,sa,tr,REPLY,rxbuf,txbuf);
-	return cc;
+	return rtilib_send_receive(fn,bc,rti,wc,SA_RXBUF,TR_READ,REPLY,rxbuf,NULL);
 }
 
 /* ===================================== */
@@ -171,18 +516,13 @@ int rtilib_read_rxbuf(int fn, int bc, int rti, int wc, unsigned short *rxbuf) {
 
 int rtilib_write_rxbuf(int fn, int bc, int rti, int wc, unsigned short *txbuf) {
 
-	unsigned short rxbuf[RX_BUF_SIZE];
-	int cc, sa, tr;
-
-	memset(rxbuf, 0, sizeof(unsigned short) * RX_BUF_SIZE);
+	int cc;
 
 	cc = rtilib_set_csr(fn,bc,rti,CSR_RRP);
 	if (cc)
 		return cc;
 
-	sa = SA_RXBUF; tr = TR_WRITE;
-	cc = rtilib_send_receive(fn,bc,rti,wc,sa,tr,REPLY,rxbuf,txbuf);
-	return cc;
+	return rtilib_send_receive(fn,bc,rti,wc,SA_RXBUF,TR_WRITE,REPLY,NULL,txbuf);
 }
 
 /* ===================================== */
@@ -228,17 +568,13 @@ int rtilib_send_eqp(int fn, int bc, int rti, int wc, unsigned short *txbuf) {
 
 int rtilib_read_txbuf(int fn, int bc, int rti, int wc, unsigned short *rxbuf) {
 
-	unsigned short txbuf[TX_BUF_SIZE];
-	int cc, sa, tr;
-
-	memset(txbuf, 0, sizeof(unsigned short) * TX_BUF_SIZE);
+	int cc;
 
 	cc = rtilib_set_csr(fn,bc,rti,CSR_RTP);
 	if (cc)
 		return cc;
 
-	sa = SA_TXBUF; tr = TR_READ;
-	return rtilib_send_receive(fn,bc,rti,wc,sa,tr,REPLY,rxbuf,txbuf);
+	return rtilib_send_receive(fn,bc,rti,wc,SA_TXBUF,TR_READ,REPLY,rxbuf,NULL);
 }
 
 /* ===================================== */
@@ -260,25 +596,36 @@ int rtilib_read_txbuf(int fn, int bc, int rti, int wc, unsigned short *rxbuf) {
 #define WAIT_POLLS 3
 #define WAIT_TB_us 1000
 
-int rtilib_recv_eqp(int fn, int bc, int rti, int wc, unsigned short *rxbuf) {
+static int wait_tb(int fn, int bc, int rti, unsigned short *str) {
 
-	unsigned short str, tb;
+	unsigned short tb;
 	int i, cc;
 
 	/* Poll the TB bit WAIT_POLL times waiting WAIT_TB_us between tests */
 
 	tb = 0;
 	for (i=0; i<WAIT_POLLS; i++) {
-		cc = rtilib_read_str(fn,bc,rti,&str);
+		cc = rtilib_read_str(fn,bc,rti,str);
 		if (cc)
 			return cc;
-		tb = str & STR_TB;
+		tb = *str & STR_TB;
 		if (tb) break;
 		usleep(WAIT_TB_us); /* According to the man page this is thread safe */
 	}
 
 	if (!tb)
 		return -ETIMEDOUT;
+	return 0;
+}
+
+int rtilib_recv_eqp(int fn, int bc, int rti, int wc, unsigned short *rxbuf) {
+
+	unsigned short str;
+	int cc;
+
+	cc = wait_tb(fn,bc,rti,&str);
+	if (cc)
+		return cc;
 
 	cc = rtilib_read_txbuf(fn,bc,rti,wc,rxbuf);
 	if (cc)
@@ -289,38 +636,472 @@ int rtilib_recv_eqp(int fn, int bc, int rti, int wc, unsigned short *rxbuf) {
 
 /* ===================================== */
 
+/**
+ * Queue n frames on the BC work queue with one MIL1553_SEND and collect
+ * their TX_END events, in order, into ends (may be NULL). The frames go
+ * out back to back without a round trip to user space between them.
+ * Handles attached to the bus arbiter do the frames one by one.
+ * Returns zero or the errno of the first frame that failed.
+ */
+
+#define BATCH_TMO_ms 100
+
+static unsigned int batch_txreg(int wc, int sa, int tr, int rti) {
+
+	if (wc >= 32)
+		wc = 0;
+	return RTI_CMD_TXREG(RTI_CMD(wc,sa,tr),rti);
+}
+
+static void batch_item(struct mil1553_tx_item_s *item, int bc, int rti,
+		       int wc, int sa, int tr, unsigned short *txbuf) {
+
+	memset(item, 0, sizeof(*item));
+	item->bc         = bc;
+	item->rti_number = rti;
+	item->txreg      = batch_txreg(wc,sa,tr,rti);
+	if (txbuf && (tr == TR_WRITE))
+		memcpy(item->txbuf, txbuf, sizeof(unsigned short) * wc);
+}
+
+/**
+ * Collect the TX_END events of the items that want one. They come in
+ * item order, or in BC order with by_bc when each BC has one item.
+ *
+ * When the wait times out the frames left are still queued in the
+ * driver and their events turn up later, where the next batch would
+ * take them for its own. They are counted by handle and BC in
+ * batch_owed and dropped as they come, the driver keeps the events of
+ * a BC in order so they come before those of the next batch. A BC not
+ * heard from during a whole timeout has lost what it owed.
+ */
+
+#define BATCH_FDS 256
+
+static unsigned short batch_owed[BATCH_FDS][CACHE_BCS];
+
+static int batch_ends(int fn, struct mil1553_tx_item_s *items, int n,
+		      struct mil1553_rti_interrupt_s *ends, int by_bc,
+		      unsigned long long seq) {
+
+	struct mil1553_recv_s recv;
+	unsigned short *owed = NULL;
+	unsigned short pending[CACHE_BCS];
+	unsigned int heard = 0;
+	int i, j, bc, want, cc, occ = 0;
+
+	if ((fn >= 0) && (fn < BATCH_FDS))
+		owed = batch_owed[fn];
+	memset(pending, 0, sizeof(pending));
+	for (i=0, want=0; i<n; i++) {
+		if (items[i].no_reply)
+			continue;
+		if (items[i].bc < CACHE_BCS)
+			pending[items[i].bc]++;
+		want++;
+	}
+
+	for (i=0, j=-1; i<want; ) {
+		memset(&recv, 0, sizeof(recv));
+		recv.timeout = BATCH_TMO_ms;
+		if (ioctl(fn,MIL1553_RECV,&recv) < 0) {
+			cc = errno;
+			for (bc=0; owed && (bc<CACHE_BCS); bc++) {
+				if ((heard & (1U << bc)) == 0)
+					owed[bc] = 0;
+				owed[bc] += pending[bc];
+			}
+			return cc;
+		}
+		if (recv.pk_type != TX_END)
+			continue;               /* Not ours, subscribed events */
+
+		bc = recv.interrupt.bc;
+		if ((bc >= 0) && (bc < CACHE_BCS)) {
+			heard |= 1U << bc;
+			if (owed && owed[bc]) {
+				owed[bc]--;     /* Late end of an earlier batch */
+				continue;
+			}
+			if (pending[bc])
+				pending[bc]--;
+		}
+		if (by_bc)
+			for (j=0; (j<n) && (items[j].bc != recv.interrupt.bc); j++);
+		else
+			while (items[++j].no_reply);
+		if (ends && (j < n))
+			memcpy(&ends[j], &recv.interrupt, sizeof(ends[j]));
+		if (j < n)
+			capture_end(seq + j, &recv.interrupt);
+		if (recv.interrupt.status && !occ)
+			occ = recv.interrupt.status;
+		i++;
+	}
+	return occ;
+}
+
+int rtilib_send_batch(int fn, struct mil1553_tx_item_s *items, int n,
+		      struct mil1553_rti_interrupt_s *ends) {
+
+	struct mil1553_send_s send;
+	unsigned short rxbuf[RX_BUF_SIZE+1];
+	unsigned long long t0, seq;
+	int i, wc, sa, tr, cc, occ = 0;
+
+	if (arb_handle(fn)) {
+		for (i=0; i<n; i++) {
+			wc = (items[i].txreg & TXREG_WC_MASK) >> TXREG_WC_SHIFT;
+			sa = (items[i].txreg & TXREG_SUBA_MASK) >> TXREG_SUBA_SHIFT;
+			tr = (items[i].txreg & TXREG_TR_MASK) >> TXREG_TR_SHIFT;
+			if (wc == 0)
+				wc = 32;
+			memset(rxbuf, 0, sizeof(rxbuf));
+			cc = rtilib_send_receive(fn,items[i].bc,items[i].rti_number,
+						 wc,sa,tr,REPLY,rxbuf,items[i].txbuf);
+			if (ends) {
+				memset(&ends[i], 0, sizeof(ends[i]));
+				ends[i].bc         = items[i].bc;
+				ends[i].rti_number = items[i].rti_number;
+				ends[i].wc         = cc ? 0 : wc + 1;
+				ends[i].str        = rxbuf[0];
+				ends[i].status     = cc;
+				memcpy(ends[i].rxbuf, rxbuf, sizeof(rxbuf));
+			}
+			if (cc && !occ)
+				occ = cc;
+		}
+		return occ;
+	}
+
+	t0 = capture_on() ? cap_now() : 0;
+	send.item_count    = n;
+	send.tx_item_array = items;
+	if (ioctl(fn,MIL1553_SEND,&send) < 0) {
+		occ = errno;           /* Nothing was queued, no ends to wait for */
+		capture_items(items,n,t0,CAP_BATCH,occ);
+		return occ;
+	}
+
+	seq = capture_items(items,n,t0,CAP_BATCH,0);
+	return batch_ends(fn,items,n,ends,0,seq);
+}
+
+/* ===================================== */
+
+/**
+ * One frame on each of several BCs, started together by the driver
+ * with MIL1553_SYNC_SEND, see mil1553.h. At most one item per BC, ends
+ * are returned in item order and skew_ns (may be NULL) gets the time
+ * between the first and the last frame start. Not served by the bus
+ * arbiter. Returns zero or the errno of the first frame that failed.
+ */
+
+int rtilib_send_sync(int fn, struct mil1553_tx_item_s *items, int n,
+		     struct mil1553_rti_interrupt_s *ends, unsigned int *skew_ns) {
+
+	struct mil1553_sync_send_s sync;
+	unsigned long long t0, seq;
+
+	if (arb_handle(fn))
+		return ENOTTY;
+
+	t0 = capture_on() ? cap_now() : 0;
+	sync.item_count    = n;
+	sync.skew_ns       = 0;
+	sync.tx_item_array = items;
+	if (ioctl(fn,MIL1553_SYNC_SEND,&sync) < 0)
+		return errno;          /* Nothing was sent */
+	if (skew_ns)
+		*skew_ns = sync.skew_ns;
+	seq = capture_items(items,n,t0,CAP_SYNC,0);
+	return batch_ends(fn,items,n,ends,1,seq);
+}
+
+/* ===================================== */
+
+/**
+ * Segmented equipment messages.
+ * A quick data packet of up to RTI_EQP_WORDS words (header included) is
+ * one QDP packet for the equipment but more than one bus frame. After
+ * one RB check the pointer reset, the TX_BUF_SIZE word frames and the
+ * final RB set are sent as one batch; the RTI buffer pointer moves on
+ * from frame to frame. Reading back is the same with TB, RTP and the
+ * TXBUF. rxbuf gets the status word of the first frame then all data.
+ * Both work for short messages too, they are then a single frame.
+ */
+
+static int send_eqp_frames(int fn, int bc, int rti, int wc,
+			   unsigned short *txbuf, int set_rb) {
+
+	struct mil1553_tx_item_s items[RTI_EQP_FRAMES + 2];
+	unsigned short str, csr;
+	int cc, n, off, fwc;
+
+	if ((wc <= 0) || (wc > RTI_EQP_WORDS))
+		return EINVAL;
+
+	cc = rtilib_read_str(fn,bc,rti,&str);
+	if (cc)
+		return cc;
+	if (STR_RB & str)
+		return -EBUSY;
+
+	n = 0;
+	csr = CSR_RRP;
+	batch_item(&items[n++],bc,rti,1,SA_SET_CSR,TR_WRITE,&csr);
+	for (off=0; off<wc; off+=fwc) {
+		fwc = wc - off;
+		if (fwc > TX_BUF_SIZE)
+			fwc = TX_BUF_SIZE;
+		batch_item(&items[n++],bc,rti,fwc,SA_RXBUF,TR_WRITE,&txbuf[off]);
+	}
+	if (set_rb) {
+		csr = CSR_RB | CSR_INT | CSR_INE;
+		batch_item(&items[n++],bc,rti,1,SA_SET_CSR,TR_WRITE,&csr);
+	}
+
+	cc = rtilib_send_batch(fn,items,n,NULL);
+	return cc;
+}
+
+int rtilib_send_eqp_seg(int fn, int bc, int rti, int wc, unsigned short *txbuf) {
+
+	return send_eqp_frames(fn,bc,rti,wc,txbuf,1);
+}
+
+int rtilib_recv_eqp_seg(int fn, int bc, int rti, int wc, unsigned short *rxbuf) {
+
+	struct mil1553_tx_item_s items[RTI_EQP_FRAMES + 2];
+	struct mil1553_rti_interrupt_s ends[RTI_EQP_FRAMES + 2];
+	unsigned short str, csr;
+	int i, cc, n, off, fwc;
+
+	if ((wc <= 0) || (wc > RTI_EQP_WORDS))
+		return EINVAL;
+
+	cc = wait_tb(fn,bc,rti,&str);
+	if (cc)
+		return cc;
+
+	n = 0;
+	csr = CSR_RTP;
+	batch_item(&items[n++],bc,rti,1,SA_SET_CSR,TR_WRITE,&csr);
+	for (off=0; off<wc; off+=fwc) {
+		fwc = wc - off;
+		if (fwc > TX_BUF_SIZE)
+			fwc = TX_BUF_SIZE;
+		batch_item(&items[n++],bc,rti,fwc,SA_TXBUF,TR_READ,NULL);
+	}
+	csr = CSR_TB | CSR_INT;
+	batch_item(&items[n++],bc,rti,1,SA_CLEAR_CSR,TR_WRITE,&csr);
+
+	cc = rtilib_send_batch(fn,items,n,ends);
+	if (cc)
+		return cc;
+
+	rxbuf[0] = ends[1].rxbuf[0];
+	for (i=1, off=0; i<n-1; i++, off+=fwc) {
+		fwc = wc - off;
+		if (fwc > TX_BUF_SIZE)
+			fwc = TX_BUF_SIZE;
+		memcpy(&rxbuf[1+off], &ends[i].rxbuf[1], sizeof(unsigned short) * fwc);
+	}
+	return 0;
+}
+
+/* ===================================== */
+
+/**
+ * Broadcast a frame to every RTI of a BC, nobody replies.
+ */
+
+int rtilib_broadcast(int fn, int bc, int wc, int sa, unsigned short *txbuf) {
+
+	return rtilib_send_receive(fn,bc,RTI_BROADCAST,wc,sa,TR_WRITE,NO_REPLY,NULL,txbuf);
+}
+
+/* ===================================== */
+
+/**
+ * Two phase send of equipment messages.
+ * rtilib_stage_eqp writes a message into the RXBUF of an RTI, after the
+ * usual RB check, but doesn't set RB. rtilib_commit_eqp then sets RB,
+ * INT and INE on every staged RTI of the BC at once with one broadcast
+ * CSR write, so all the equipment gets its message at the same time.
+ * That is only safe if no other RTI is on the bus. The up mask of the
+ * driver says which are: it follows every frame sent to an RTI as well
+ * as its scans, and reading it through MIL1553_GET_BC_STATS costs no
+ * bus time. An RTI that came up since and that nobody has talked to is
+ * not in it, after powering equipment on call milib_get_up_rtis to scan.
+ * If the mask has any RTI outside the staged set, or the driver can't
+ * give it, RB is set on each staged RTI in turn.
+ */
+
+int rtilib_stage_eqp(int fn, int bc, int rti, int wc, unsigned short *txbuf) {
+
+	return send_eqp_frames(fn,bc,rti,wc,txbuf,0);
+}
+
+#define COMMIT_CSR (CSR_RB | CSR_INT | CSR_INE)
+
+/* Tell if the staged RTIs are all the RTIs the driver knows are up */
+
+static int commit_bcast(int fn, int bc, unsigned int rti_mask) {
+
+	struct mil1553_bc_stats_s stats;
+
+	memset(&stats, 0, sizeof(stats));
+	stats.version = MIL1553_BC_STATS_VERSION;
+	stats.bc = bc;
+	if (ioctl(fn, MIL1553_GET_BC_STATS, &stats) < 0)
+		return 0;
+	return (stats.up_rtis & ~rti_mask) == 0;
+}
+
+int rtilib_commit_eqp(int fn, int bc, unsigned int rti_mask, unsigned int *failed) {
+
+	unsigned short csr = COMMIT_CSR;
+	int rti, cc, occ = 0;
+
+	*failed = 0;
+	if ((bc < 0) || (bc >= CACHE_BCS))
+		return EINVAL;
+	rti_mask &= ~((1U << 0) | (1U << RTI_BROADCAST));
+	if (rti_mask == 0)
+		return 0;
+
+	if (commit_bcast(fn,bc,rti_mask)) {
+		cc = rtilib_broadcast(fn,bc,1,SA_SET_CSR,&csr);
+		if (cc == 0)
+			return 0;
+	}
+
+	for (rti=1; rti<RTI_BROADCAST; rti++) {
+		if ((rti_mask & (1 << rti)) == 0)
+			continue;
+		cc = rtilib_set_csr(fn,bc,rti,csr);
+		if (cc) {
+			*failed |= 1 << rti;
+			if (!occ)
+				occ = cc;
+		}
+	}
+	return occ;
+}
+
+/**
+ * Commit on several BCs, rti_masks and failed are indexed by BC. The
+ * broadcast CSR frames of the BCs that can take one are started
+ * together with rtilib_send_sync, skew_ns (may be NULL) gets their
+ * start skew. Any other BC, or all of them if the driver can't do it,
+ * is committed on its own with rtilib_commit_eqp.
+ */
+
+int rtilib_commit_eqp_sync(int fn, unsigned int *rti_masks, unsigned int *failed,
+			   unsigned int *skew_ns) {
+
+	struct mil1553_tx_item_s items[CACHE_BCS];
+	struct mil1553_rti_interrupt_s ends[CACHE_BCS];
+	unsigned short csr = COMMIT_CSR;
+	unsigned int mask, done = 0;
+	int i, bc, n = 0, cc, occ = 0;
+
+	if (skew_ns)
+		*skew_ns = 0;
+	for (bc=1; bc<CACHE_BCS; bc++) {
+		failed[bc] = 0;
+		mask = rti_masks[bc] & ~((1U << 0) | (1U << RTI_BROADCAST));
+		if (mask && commit_bcast(fn,bc,mask))
+			batch_item(&items[n++],bc,RTI_BROADCAST,1,SA_SET_CSR,TR_WRITE,&csr);
+	}
+
+	if ((n > 1) && (rtilib_send_sync(fn,items,n,ends,skew_ns) == 0)) {
+		for (i=0; i<n; i++)
+			if (ends[i].status == 0)
+				done |= 1U << items[i].bc;
+	}
+
+	for (bc=1; bc<CACHE_BCS; bc++) {
+		if ((rti_masks[bc] == 0) || (done & (1U << bc)))
+			continue;
+		cc = rtilib_commit_eqp(fn,bc,rti_masks[bc],&failed[bc]);
+		if (cc && !failed[bc])
+			failed[bc] = rti_masks[bc];
+		if (cc && !occ)
+			occ = cc;
+	}
+	return occ;
+}
+
+/* ===================================== */
+
 /**
  * This is just for debugging the RTI
  */
 
 int rtilib_write_txbuf(int fn, int bc, int rti, int wc, unsigned short *txbuf) {
 
-	unsigned short rxbuf[RX_BUF_SIZE];
-	int cc, sa, tr;
+	rtilib_clear_csr(fn,bc,rti,CSR_RTP);
 
-	memset(rxbuf, 0, sizeof(unsigned short) * RX_BUF_SIZE);
+	return rtilib_send_receive(fn,bc,rti,wc,SA_TXBUF,TR_WRITE,REPLY,NULL,txbuf);
+}
 
-	rtilib_clear_csr(fn,bc,rti,CSR_RTP);
+/* ===================================== */
 
-	sa = SA_TXBUF; tr = TR_WRITE;
-	cc = rtilib_send_receive(fn,bc,rti,wc,sa,tr,REPLY,rxbuf,txbuf);
-	return cc;
+/**
+ * Static data cache.
+ * Signatures and configuration messages only change when the equipment
+ * is replaced, so they are kept per (bc, rti) in the process together
+ * with the driver generation of the RTI, which moves on whenever the
+ * driver sees the RTI go down or the BC is reset.
+ */
+
+static int cache_bypass = 0;
+
+void rtilib_cache_bypass(int bypass) {
+
+	cache_bypass = bypass;
+}
+
+/* ===================================== */
+
+int rtilib_cache_gen(int fn, int bc, int rti, unsigned int *gen) {
+
+	if (cache_bypass)
+		return EPERM;
+	return rti_gen(fn,bc,rti,gen);
 }
 
 /* ===================================== */
 
+static struct {
+	unsigned int gen;
+	unsigned short sig;
+	unsigned short valid;
+} sig_cache[CACHE_BCS][32];
+
 int rtilib_read_signature(int fn, int bc, int rti, unsigned short *sig) {
 
 	unsigned short rxbuf[RX_BUF_SIZE];
-	unsigned short txbuf[TX_BUF_SIZE];
-	int cc, wc, sa, tr;
+	int cc, cached;
+	unsigned int gen = 0;
 
-	memset(rxbuf, 0, sizeof(unsigned short) * RX_BUF_SIZE);
-	memset(txbuf, 0, sizeof(unsigned short) * TX_BUF_SIZE);
+	cached = (rtilib_cache_gen(fn,bc,rti,&gen) == 0);
+	if (cached && sig_cache[bc][rti].valid && (sig_cache[bc][rti].gen == gen)) {
+		*sig = sig_cache[bc][rti].sig;
+		return 0;
+	}
 
-	wc = 1; sa = SA_SIGNATURE; tr = TR_READ;
-	cc = rtilib_send_receive(fn,bc,rti,wc,sa,tr,REPLY,rxbuf,txbuf);
+	rxbuf[1] = 0;
+	cc = rtilib_send_cmd(fn,bc,rti,RTI_CMD_READ_SIGNATURE,REPLY,rxbuf,NULL);
 	*sig = rxbuf[1];
+
+	if (cached && (cc == 0)) {
+		sig_cache[bc][rti].sig   = *sig;
+		sig_cache[bc][rti].gen   = gen;
+		sig_cache[bc][rti].valid = 1;
+	}
 	return cc;
 }
 
@@ -329,14 +1110,10 @@ int rtilib_read_signature(int fn, int bc, int rti, unsigned short *sig) {
 int rtilib_read_str(int fn, int bc, int rti, unsigned short *str) {
 
 	unsigned short rxbuf[RX_BUF_SIZE];
-	unsigned short txbuf[TX_BUF_SIZE];
-	int cc, wc, sa, tr;
-
-	memset(rxbuf, 0, sizeof(unsigned short) * RX_BUF_SIZE);
-	memset(txbuf, 0, sizeof(unsigned short) * TX_BUF_SIZE);
+	int cc;
 
-	wc = MODE_READ_STR; sa = SA_MODE; tr = TR_READ;
-	cc = rtilib_send_receive(fn,bc,rti,wc,sa,tr,REPLY,rxbuf,txbuf);
+	rxbuf[0] = 0;
+	cc = rtilib_send_cmd(fn,bc,rti,RTI_CMD_READ_STR,REPLY,rxbuf,NULL);
 	*str = rxbuf[0];
 	return cc;
 }
@@ -346,14 +1123,10 @@ int rtilib_read_str(int fn, int bc, int rti, unsigned short *str) {
 int rtilib_read_last_str(int fn, int bc, int rti, unsigned short *str) {
 
 	unsigned short rxbuf[RX_BUF_SIZE];
-	unsigned short txbuf[TX_BUF_SIZE];
-	int cc, wc, sa, tr;
-
-	memset(rxbuf, 0, sizeof(unsigned short) * RX_BUF_SIZE);
-	memset(txbuf, 0, sizeof(unsigned short) * TX_BUF_SIZE);
+	int cc;
 
-	wc = MODE_READ_LAST_STR; sa = SA_MODE; tr = TR_READ;
-	cc = rtilib_send_receive(fn,bc,rti,wc,sa,tr,REPLY,rxbuf,txbuf);
+	rxbuf[0] = 0;
+	cc = rtilib_send_cmd(fn,bc,rti,RTI_CMD_READ_LAST_STR,REPLY,rxbuf,NULL);
 	*str = rxbuf[0];
 	return cc;
 }
@@ -362,15 +1135,9 @@ int rtilib_read_last_str(int fn, int bc, int rti, unsigned short *str) {
 
 int rtilib_master_reset(int fn, int bc, int rti) {
 
-	unsigned short rxbuf[RX_BUF_SIZE];
-	unsigned short txbuf[TX_BUF_SIZE];
-	int cc, wc, sa, tr;
-
-	memset(rxbuf, 0, sizeof(unsigned short) * RX_BUF_SIZE);
-	memset(txbuf, 0, sizeof(unsigned short) * TX_BUF_SIZE);
+	int cc;
 
-	wc = MODE_MASTER_RESET; sa = SA_MODE; tr = TR_READ;
-	cc = rtilib_send_receive(fn,bc,rti,wc,sa,tr,1,rxbuf,txbuf);
+	cc = rtilib_send_cmd(fn,bc,rti,RTI_CMD_MASTER_RESET,NO_REPLY,NULL,NULL);
 	return cc;
 }
 
@@ -379,14 +1146,10 @@ int rtilib_master_reset(int fn, int bc, int rti) {
 int rtilib_read_last_cmd(int fn, int bc, int rti, unsigned short *cmd) {
 
 	unsigned short rxbuf[RX_BUF_SIZE];
-	unsigned short txbuf[TX_BUF_SIZE];
-	int cc, wc, sa, tr;
-
-	memset(rxbuf, 0, sizeof(unsigned short) * RX_BUF_SIZE);
-	memset(txbuf, 0, sizeof(unsigned short) * TX_BUF_SIZE);
+	int cc;
 
-	wc = MODE_READ_LAST_CMD; sa = SA_MODE; tr = TR_READ;
-	cc = rtilib_send_receive(fn,bc,rti,wc,sa,tr,REPLY,rxbuf,txbuf);
+	rxbuf[0] = 0;
+	cc = rtilib_send_cmd(fn,bc,rti,RTI_CMD_READ_LAST_CMD,REPLY,rxbuf,NULL);
 	*cmd = rxbuf[0];
 	return cc;
 }
@@ -62,6 +62,32 @@ static __attribute__((unused)) char version[] = "librti version: " GIT_VERSION;
 #define TR_READ 1
 #define TR_WRITE 0
 
+/**
+ * Command catalogue. An RTI_CMD is the TXREG of a frame less the RTI
+ * number, worked out by the compiler, so a polling loop can keep one
+ * and hand it to rtilib_send_cmd with only the payload. RTI_CMD_TXREG
+ * adds the RTI, as in mil1553_tx_item_s. Needs mil1553.h.
+ */
+
+#define RTI_CMD(wc,sa,tr) ((((wc) << TXREG_WC_SHIFT)   & TXREG_WC_MASK)   \
+			 | (((sa) << TXREG_SUBA_SHIFT) & TXREG_SUBA_MASK) \
+			 | (((tr) << TXREG_TR_SHIFT)   & TXREG_TR_MASK))
+
+#define RTI_CMD_TXREG(cmd,rti) ((cmd) | (((rti) << TXREG_RTI_SHIFT) & TXREG_RTI_MASK))
+
+#define RTI_CMD_READ_CSR          RTI_CMD(1,SA_CSR,TR_READ)
+#define RTI_CMD_SET_CSR           RTI_CMD(1,SA_SET_CSR,TR_WRITE)
+#define RTI_CMD_CLEAR_CSR         RTI_CMD(1,SA_CLEAR_CSR,TR_WRITE)
+#define RTI_CMD_READ_SIGNATURE    RTI_CMD(1,SA_SIGNATURE,TR_READ)
+#define RTI_CMD_READ_RXBUF(wc)    RTI_CMD(wc,SA_RXBUF,TR_READ)
+#define RTI_CMD_WRITE_RXBUF(wc)   RTI_CMD(wc,SA_RXBUF,TR_WRITE)
+#define RTI_CMD_READ_TXBUF(wc)    RTI_CMD(wc,SA_TXBUF,TR_READ)
+#define RTI_CMD_WRITE_TXBUF(wc)   RTI_CMD(wc,SA_TXBUF,TR_WRITE)
+#define RTI_CMD_READ_STR          RTI_CMD(MODE_READ_STR,SA_MODE,TR_READ)
+#define RTI_CMD_READ_LAST_STR     RTI_CMD(MODE_READ_LAST_STR,SA_MODE,TR_READ)
+#define RTI_CMD_MASTER_RESET      RTI_CMD(MODE_MASTER_RESET,SA_MODE,TR_READ)
+#define RTI_CMD_READ_LAST_CMD     RTI_CMD(MODE_READ_LAST_CMD,SA_MODE,TR_READ)
+
 char *rtilib_csr_to_str(unsigned short csr);
 char *rtilib_str_to_str(unsigned short str);
 char *rtilib_sig_to_str(unsigned short sig);
@@ -79,6 +105,16 @@ int rtilib_send_receive(int fn,
 			unsigned short *rxbuf,
 			unsigned short *txbuf);
 
+/**
+ * Send one frame of the catalogue. rxbuf, RX_BUF_SIZE words, gets the
+ * status word and data of the reply, txbuf the data words of a write.
+ * Either may be NULL when not needed and neither is cleared first.
+ * Returns zero or errno.
+ */
+
+int rtilib_send_cmd(int fn, int bc, int rti, unsigned int cmd, int nreply,
+		    unsigned short *rxbuf, unsigned short *txbuf);
+
 
 int rtilib_read_csr(int fn, int bc, int rti, unsigned short *csr, unsigned short *str);
 int rtilib_clear_csr(int fn, int bc, int rti, unsigned short csr);
@@ -88,6 +124,19 @@ int rtilib_write_rxbuf(int fn, int bc, int rti, int wc, unsigned short *txbuf);
 int rtilib_read_txbuf(int fn, int bc, int rti, int wc, unsigned short *rxbuf);
 int rtilib_write_txbuf(int fn, int bc, int rti, int wc, unsigned short *txbuf);
 int rtilib_read_signature(int fn, int bc, int rti, unsigned short *sig);
+
+/**
+ * rtilib_read_signature and mil1553_read_cfg_msg answer from a per
+ * process cache while the driver generation of the RTI (see
+ * MIL1553_GET_RTI_GEN) is unchanged. rtilib_cache_bypass(1) sends every
+ * read to the bus. rtilib_cache_gen returns zero and the current
+ * generation when the cache may be used for (bc, rti).
+ */
+
+#define CACHE_BCS 32
+
+void rtilib_cache_bypass(int bypass);
+int rtilib_cache_gen(int fn, int bc, int rti, unsigned int *gen);
 int rtilib_read_str(int fn, int bc, int rti, unsigned short *str);
 int rtilib_read_last_str(int fn, int bc, int rti, unsigned short *str);
 int rtilib_master_reset(int fn, int bc, int rti);
@@ -95,6 +144,97 @@ int rtilib_read_last_cmd(int fn, int bc, int rti, unsigned short *cmd);
 int rtilib_send_eqp(int fn, int bc, int rti, int wc, unsigned short *txbuf);
 int rtilib_recv_eqp(int fn, int bc, int rti, int wc, unsigned short *rxbuf);
 
+/**
+ * Frames queued with one MIL1553_SEND, TX_END events returned in order.
+ * Equipment messages longer than a frame, up to RTI_EQP_WORDS words,
+ * sent or received as consecutive frames in one batch.
+ */
+
+#define RTI_EQP_WORDS 128
+#define RTI_EQP_FRAMES (RTI_EQP_WORDS / 32)
+
+struct mil1553_tx_item_s;
+struct mil1553_rti_interrupt_s;
+
+int rtilib_send_batch(int fn, struct mil1553_tx_item_s *items, int n,
+		      struct mil1553_rti_interrupt_s *ends);
+int rtilib_send_eqp_seg(int fn, int bc, int rti, int wc, unsigned short *txbuf);
+int rtilib_recv_eqp_seg(int fn, int bc, int rti, int wc, unsigned short *rxbuf);
+
+/**
+ * Broadcast frames (RTI_BROADCAST) get no reply.
+ * rtilib_stage_eqp writes an equipment message without setting RB,
+ * rtilib_commit_eqp then sets RB on all the staged RTIs of a BC, with
+ * one broadcast when they are all the RTIs the driver has seen up.
+ * failed gets the RTIs whose commit went wrong.
+ */
+
+int rtilib_broadcast(int fn, int bc, int wc, int sa, unsigned short *txbuf);
+int rtilib_stage_eqp(int fn, int bc, int rti, int wc, unsigned short *txbuf);
+int rtilib_commit_eqp(int fn, int bc, unsigned int rti_mask, unsigned int *failed);
+
+/**
+ * One frame per BC started together on several BCs, see MIL1553_SYNC_SEND.
+ * rtilib_commit_eqp_sync commits on all BCs at once, masks indexed by BC.
+ */
+
+int rtilib_send_sync(int fn, struct mil1553_tx_item_s *items, int n,
+		     struct mil1553_rti_interrupt_s *ends, unsigned int *skew_ns);
+int rtilib_commit_eqp_sync(int fn, unsigned int *rti_masks, unsigned int *failed,
+			   unsigned int *skew_ns);
+
+/**
+ * Bus traffic capture. Between rtilib_capture_start and _stop every
+ * frame sent through librti is written to a ring of frames records in
+ * a file, mapped so recording costs a clock read and a copy and no
+ * system call. Setting RTI_CAPTURE_ENV to a file name captures from the
+ * first frame on without changing the program, one file per process.
+ * Records are in send order, frames of one MIL1553_SEND or SYNC_SEND
+ * share the start time. The file holds the last frames records from
+ * record head % frames on. Threads take their records from head
+ * atomically, and a record is whole once its seq is its number plus
+ * one, readers skip the others. test/mil1553replay prints and replays
+ * it.
+ */
+
+#define RTI_CAPTURE_ENV     "MIL1553_CAPTURE"
+#define RTI_CAPTURE_FRAMES  65536
+#define RTI_CAPTURE_MAGIC   0x4D313535          /* "M155" */
+#define RTI_CAPTURE_VERSION 2
+
+#define CAP_REPLY 0x1                           /** The frame wanted a reply */
+#define CAP_BATCH 0x2                           /** Queued with MIL1553_SEND */
+#define CAP_SYNC  0x4                           /** Started with MIL1553_SYNC_SEND */
+
+struct rti_capture_hdr_s {
+	unsigned int magic;                     /** RTI_CAPTURE_MAGIC */
+	unsigned int version;                   /** RTI_CAPTURE_VERSION */
+	unsigned int rec_size;                  /** Bytes per record */
+	unsigned int frames;                    /** Records in the ring */
+	unsigned long long head;                /** Records written */
+	unsigned long long t0_ns;               /** CLOCK_MONOTONIC at start */
+	unsigned long long start_sec;           /** Wall clock at start */
+	unsigned int pid;                       /** Capturing process */
+	unsigned int spare[5];
+};
+
+struct rti_capture_rec_s {
+	unsigned long long ts_ns;               /** Frame start, CLOCK_MONOTONIC */
+	unsigned long long latency_ns;          /** Start to completion */
+	unsigned long long seq;                 /** Record number + 1 once written, else 0 */
+	int status;                             /** Zero or errno */
+	unsigned short bc;                      /** Bus controller */
+	unsigned short txreg;                   /** wc, sa, t/r and rti */
+	unsigned short flags;                   /** CAP_xxx */
+	unsigned short tx_wc;                   /** Data words sent */
+	unsigned short rx_wc;                   /** Reply words, status first */
+	unsigned short txbuf[32];               /** TX_BUF_SIZE */
+	unsigned short rxbuf[33];               /** RX_BUF_SIZE */
+};
+
+int rtilib_capture_start(const char *path, unsigned int frames);
+void rtilib_capture_stop(void);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -206,4 +206,99 @@ typedef struct {
 	char  ccv3_change;
 } ppm_ctrl_msg;
 
+/**
+ * Wire layout of the messages, one line per field that needs converting.
+ * Fields not listed go over the cable as they are.
+ *   QS_CHARS  Char pair, the two bytes are swapped
+ *   QS_WORDS  32 bit integer, the two words are swapped
+ *   QS_FLOAT  Float, words swapped, or bytes swapped on the old
+ *             power supplies when a control message is read back
+ * The serializers in libquick-serial.c are generated from these.
+ */
+
+#define REQ_MSG_LAYOUT(X)                \
+	X(type,               QS_CHARS)  \
+	X(protocol_date.sec,  QS_WORDS)  \
+	X(protocol_date.usec, QS_WORDS)
+
+#define CTRL_MSG_LAYOUT(X)               \
+	X(ccsact_change,      QS_CHARS)  \
+	X(ccv,                QS_FLOAT)  \
+	X(ccv1,               QS_FLOAT)  \
+	X(ccv2,               QS_FLOAT)  \
+	X(ccv3,               QS_FLOAT)  \
+	X(ccv_change,         QS_CHARS)  \
+	X(ccv2_change,        QS_CHARS)
+
+#define ACQ_MSG_LAYOUT(X)                \
+	X(phys_status,        QS_CHARS)  \
+	X(ext_aspect,         QS_CHARS)  \
+	X(aqn,                QS_WORDS)  \
+	X(aqn1,               QS_WORDS)  \
+	X(aqn2,               QS_WORDS)  \
+	X(aqn3,               QS_WORDS)
+
+#define CONF_MSG_LAYOUT(X)               \
+	X(i_nominal,          QS_WORDS)  \
+	X(resolution,         QS_WORDS)  \
+	X(i_max,              QS_WORDS)  \
+	X(i_min,              QS_WORDS)  \
+	X(di_dt,              QS_WORDS)  \
+	X(mode,               QS_WORDS)
+
+/**
+ * Every field of the messages as it sits in the raw, not serialized,
+ * packet: accessor name, field, C type and how it is reached.
+ *   QV_PLAIN  As it is
+ *   QV_CHAR   Char of a QS_CHARS pair, at the other byte of the pair
+ *   QV_WORDS  As QS_WORDS
+ *   QV_FLOAT  As QS_FLOAT
+ * The accessors in pow_messages_view.h are generated from these, they
+ * must agree with the XXX_MSG_LAYOUT tables above.
+ */
+
+#define REQ_MSG_VIEW(X)                                    \
+	X(family,        family,             short, QV_PLAIN)  \
+	X(type,          type,               char,  QV_CHAR)   \
+	X(sub_family,    sub_family,         char,  QV_CHAR)   \
+	X(member,        member,             short, QV_PLAIN)  \
+	X(service,       service,            short, QV_PLAIN)  \
+	X(machine,       cycle.machine,      short, QV_PLAIN)  \
+	X(pls_line,      cycle.pls_line,     short, QV_PLAIN)  \
+	X(sec,           protocol_date.sec,  int,   QV_WORDS)  \
+	X(usec,          protocol_date.usec, int,   QV_WORDS)  \
+	X(specialist,    specialist,         short, QV_PLAIN)
+
+#define CTRL_MSG_VIEW(X)                                          \
+	X(ccsact_change, ccsact_change, char,          QV_CHAR)   \
+	X(ccsact,        ccsact,        unsigned char, QV_CHAR)   \
+	X(ccv,           ccv,           float,         QV_FLOAT)  \
+	X(ccv1,          ccv1,          float,         QV_FLOAT)  \
+	X(ccv2,          ccv2,          float,         QV_FLOAT)  \
+	X(ccv3,          ccv3,          float,         QV_FLOAT)  \
+	X(ccv_change,    ccv_change,    char,          QV_CHAR)   \
+	X(ccv1_change,   ccv1_change,   char,          QV_CHAR)   \
+	X(ccv2_change,   ccv2_change,   char,          QV_CHAR)   \
+	X(ccv3_change,   ccv3_change,   char,          QV_CHAR)
+
+#define ACQ_MSG_VIEW(X)                                           \
+	X(phys_status,   phys_status,   unsigned char, QV_CHAR)   \
+	X(static_status, static_status, unsigned char, QV_CHAR)   \
+	X(ext_aspect,    ext_aspect,    unsigned char, QV_CHAR)   \
+	X(status_qualif, status_qualif, unsigned char, QV_CHAR)   \
+	X(busytime,      busytime,      short,         QV_PLAIN)  \
+	X(aqn,           aqn,           float,         QV_WORDS)  \
+	X(aqn1,          aqn1,          float,         QV_WORDS)  \
+	X(aqn2,          aqn2,          float,         QV_WORDS)  \
+	X(aqn3,          aqn3,          float,         QV_WORDS)
+
+#define CONF_MSG_VIEW(X)                                          \
+	X(dummy,         dummy,         short,         QV_PLAIN)  \
+	X(i_nominal,     i_nominal,     float,         QV_WORDS)  \
+	X(resolution,    resolution,    float,         QV_WORDS)  \
+	X(i_max,         i_max,         float,         QV_WORDS)  \
+	X(i_min,         i_min,         float,         QV_WORDS)  \
+	X(di_dt,         di_dt,         float,         QV_WORDS)  \
+	X(mode,          mode,          float,         QV_WORDS)
+
 #endif /* _POW_MESSAGES_H_INCLUDE_ */
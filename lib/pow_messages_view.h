@@ -0,0 +1,130 @@
+#ifndef _POW_MESSAGES_VIEW_H
+#define _POW_MESSAGES_VIEW_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <pow_messages_serial.h>
+
+/**
+ * Typed views of power supply messages.
+ *
+ * mil1553_get_raw_quick_data leaves the packet as it came off the cable
+ * and mil1553_get_quick_data then converts all of it with serialize.
+ * These accessors read or write one field straight in the raw packet
+ * instead, the conversion is done for that field only and its offset is
+ * a compile time constant, so a consumer that needs aqn and phys_status
+ * pays for two fields and not for the whole message.
+ *
+ *    float aqn = acq_msg_get_aqn(qptr->pkt);
+ *    ctrl_msg_set_ccv(qptr->pkt, ccv);
+ *
+ * There is a get and a set per field of REQ_MSG_VIEW plus the fields of
+ * the message, named <message>_get_<name> and <message>_set_<name>. A
+ * packet written with the setters is sent with mil1553_send_raw_quick_data.
+ * Control message floats read back follow mil1553_old_power_supply as
+ * serialize_read_ctrl_msg does.
+ */
+
+extern int mil1553_old_power_supply;
+
+typedef enum {
+	QV_PLAIN,
+	QV_CHAR,
+	QV_WORDS,
+	QV_FLOAT
+} qv_kind_t;
+
+static inline uint32_t qv_swap_words(uint32_t v) {
+
+	return (v << 16) | (v >> 16);
+}
+
+static inline uint32_t qv_swap_bytes(uint32_t v) {
+
+	return ((v & 0x00FF00FF) << 8) | ((v >> 8) & 0x00FF00FF);
+}
+
+/* ===================================== */
+
+static inline void qv_load(const void *pkt, size_t off, size_t size,
+			   qv_kind_t kind, int byte_floats, void *val) {
+
+	const unsigned char *cp = (const unsigned char *) pkt;
+	uint32_t v;
+
+	switch (kind) {
+		case QV_CHAR:
+			*(unsigned char *) val = cp[off ^ 1];
+		break;
+
+		case QV_WORDS:
+		case QV_FLOAT:
+			memcpy(&v, cp + off, sizeof(v));
+			if ((kind == QV_FLOAT) && byte_floats)
+				v = qv_swap_bytes(v);
+			else
+				v = qv_swap_words(v);
+			memcpy(val, &v, sizeof(v));
+		break;
+
+		default:
+			memcpy(val, cp + off, size);
+		break;
+	}
+}
+
+static inline void qv_store(void *pkt, size_t off, size_t size,
+			    qv_kind_t kind, const void *val) {
+
+	unsigned char *cp = (unsigned char *) pkt;
+	uint32_t v;
+
+	switch (kind) {
+		case QV_CHAR:
+			cp[off ^ 1] = *(const unsigned char *) val;
+		break;
+
+		case QV_WORDS:
+		case QV_FLOAT:
+			memcpy(&v, val, sizeof(v));
+			v = qv_swap_words(v);
+			memcpy(cp + off, &v, sizeof(v));
+		break;
+
+		default:
+			memcpy(cp + off, val, size);
+		break;
+	}
+}
+
+/* ===================================== */
+
+#define QV_ACCESSORS(msg, name, field, ctype, kind, byte_floats)        \
+static inline ctype msg##_get_##name(const void *pkt) {                 \
+	ctype v;                                                        \
+	qv_load(pkt, offsetof(msg, field), sizeof(v), kind, byte_floats, &v); \
+	return v;                                                       \
+}                                                                       \
+static inline void msg##_set_##name(void *pkt, ctype v) {               \
+	qv_store(pkt, offsetof(msg, field), sizeof(v), kind, &v);       \
+}
+
+#define QV_REQ(name, field, ctype, kind)  QV_ACCESSORS(req_msg,  name, field, ctype, kind, 0)
+#define QV_CTRL(name, field, ctype, kind) QV_ACCESSORS(ctrl_msg, name, field, ctype, kind, mil1553_old_power_supply)
+#define QV_ACQ(name, field, ctype, kind)  QV_ACCESSORS(acq_msg,  name, field, ctype, kind, 0)
+#define QV_CONF(name, field, ctype, kind) QV_ACCESSORS(conf_msg, name, field, ctype, kind, 0)
+
+REQ_MSG_VIEW(QV_REQ)
+
+REQ_MSG_VIEW(QV_CTRL)
+CTRL_MSG_VIEW(QV_CTRL)
+
+REQ_MSG_VIEW(QV_ACQ)
+ACQ_MSG_VIEW(QV_ACQ)
+
+REQ_MSG_VIEW(QV_CONF)
+CONF_MSG_VIEW(QV_CONF)
+
+#endif /* _POW_MESSAGES_VIEW_H */
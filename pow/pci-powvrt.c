@@ -28,6 +28,8 @@ static char __attribute__ ((unused)) rcsid[] = "$Id: pci-powvrt.c,v 2.2 2012/05/
 
 /* Conditionnal compilation for POW-V included */
 
+#define _GNU_SOURCE		/* for pthread_setaffinity_np */
+
 /* include files searched in /usr/local/include or /usr/include */
 #include <unistd.h>
 #include <stdlib.h>
@@ -38,6 +40,8 @@ static char __attribute__ ((unused)) rcsid[] = "$Id: pci-powvrt.c,v 2.2 2012/05/
 #include <time.h>
 #include <errno.h>
 #include <math.h>
+#include <pthread.h>
+#include <signal.h>
 
 #include <tgm/con.h>
 #include <tgm/tgm.h>		/* telegram access routines */
@@ -118,6 +122,44 @@ static short get_quick_data (struct quick_data_buffer *p)
     return 0;
 }
 
+/* Wait for the replies of a request, at most the old fixed 40 ms gap */
+#define REPLY_TMO_us 40000
+
+static short wait_quick_data (struct quick_data_buffer *p)
+{
+    if (mil1533_init_done == 0) {
+	if ((mil1533_fh = mil1553_init_quickdriver ()) < 0) {
+	    perror ("mil1553_init_quickdriver");
+	    return (-1);
+	}
+	mil1533_init_done = 1;
+    }
+    return mil1553_wait_quick_data (mil1533_fh, p, REPLY_TMO_us);
+}
+
+/* -commit: stage the messages, or hand all the staged ones over at once */
+static short stage_quick_data (struct quick_data_buffer *p, int commit)
+{
+    int cc;
+
+    if (mil1533_init_done == 0) {
+	if ((mil1533_fh = mil1553_init_quickdriver ()) < 0) {
+	    perror ("mil1553_init_quickdriver");
+	    return (-1);
+	}
+	mil1533_init_done = 1;
+    }
+    if (commit)
+	cc = mil1553_commit_quick_data (mil1533_fh, p);
+    else
+	cc = mil1553_stage_quick_data_net (mil1533_fh, p);
+    if ((cc) && (cc != EINPROGRESS)) {
+	mil1553_print_error (cc);
+	return cc;
+    }
+    return 0;
+}
+
 /*--------------------------------------------------------------------------*/
 /* CONSTANTS:                                                               */
 /*--------------------------------------------------------------------------*/
@@ -143,7 +185,7 @@ static int tgm_last_line = 24;
     data_desc.type = EQM_TYP_INT;\
     data_desc.size = mx;\
     for(i = 0; i <= mx; i++) co[i] = 0;\
-    eqm_dtr_iv(blsx, col, &data_desc, 1, el, mx+1, 0, co, mx+1);\
+    EQM_CALL(eqm_dtr_iv(blsx, col, &data_desc, 1, el, mx+1, 0, co, mx+1));\
 }
 
 #define DTARS(val, col) {\
@@ -151,7 +193,7 @@ static int tgm_last_line = 24;
     data_desc.type = EQM_TYP_INT;\
     data_desc.size = act->nb;\
     for(k = 0; k <= act->nb; k++) act->co[k] = 0;\
-    eqm_dtr_iv(blsx, col, &data_desc, 1, act->el, act->nb+1, 0, act->co, act->nb+1);\
+    EQM_CALL(eqm_dtr_iv(blsx, col, &data_desc, 1, act->el, act->nb+1, 0, act->co, act->nb+1));\
 }
 
 #define RDT(val, sz, colref, pls) {\
@@ -159,7 +201,7 @@ static int tgm_last_line = 24;
     data_desc.type = EQM_TYP_INT;\
     data_desc.size = sz * cact->nb;\
     for(k = 0; k <= cact->nb; k++) cact->co[k] = 0;\
-    eqm_rtr_iv(blsx, &colref, &data_desc, sz, cact->el, cact->nb+1, pls, cact->co, cact->nb+1);\
+    EQM_CALL(eqm_rtr_iv(blsx, &colref, &data_desc, sz, cact->el, cact->nb+1, pls, cact->co, cact->nb+1));\
 }
 
 #define WDT(val, sz, colref, pls) {\
@@ -167,7 +209,7 @@ static int tgm_last_line = 24;
     data_desc.type = EQM_TYP_INT;\
     data_desc.size = sz * cact->nb;\
     for(k = 0; k <= cact->nb; k++) cact->co[k] = 0;\
-    eqm_rtw_iv(blsx, &colref, &data_desc, sz, cact->el, cact->nb+1, pls, cact->co, cact->nb+1);\
+    EQM_CALL(eqm_rtw_iv(blsx, &colref, &data_desc, sz, cact->el, cact->nb+1, pls, cact->co, cact->nb+1));\
 }
 
 #define WDTD(val, sz, colref, pls) {\
@@ -175,7 +217,7 @@ static int tgm_last_line = 24;
     data_desc.type = EQM_TYP_DOUBLE;\
     data_desc.size = sz * cact->nb;\
     for(k = 0; k <= cact->nb; k++) cact->co[k] = 0;\
-    eqm_rtw_iv(blsx, &colref, &data_desc, sz, cact->el, cact->nb+1, pls, cact->co, cact->nb+1);\
+    EQM_CALL(eqm_rtw_iv(blsx, &colref, &data_desc, sz, cact->el, cact->nb+1, pls, cact->co, cact->nb+1));\
 }
 
 #define RDTD(val, sz, colref, pls) {\
@@ -183,9 +225,27 @@ static int tgm_last_line = 24;
     data_desc.type = EQM_TYP_DOUBLE;\
     data_desc.size = sz * cact->nb;\
     for(k = 0; k <= cact->nb; k++) cact->co[k] = 0;\
-    eqm_rtr_iv(blsx, &colref, &data_desc, sz, cact->el, cact->nb+1, pls, cact->co, cact->nb+1);\
+    EQM_CALL(eqm_rtr_iv(blsx, &colref, &data_desc, sz, cact->el, cact->nb+1, pls, cact->co, cact->nb+1));\
+}
+
+/* Same as RDT but with its own completion array, for the control prep. thread */
+#define RDTP(val, sz, colref, pls, cop) {\
+    int k; data_desc.data = val;\
+    data_desc.type = EQM_TYP_INT;\
+    data_desc.size = sz * cact->nb;\
+    for(k = 0; k <= cact->nb; k++) cop[k] = 0;\
+    EQM_CALL(eqm_rtr_iv(blsx, &colref, &data_desc, sz, cact->el, cact->nb+1, pls, cop, cact->nb+1));\
 }
 
+#define MAX_BC 31		/* BC numbers are 1..MAX_BC */
+
+/* Bus operations done on a quick data chain */
+#define QIO_SEND 0
+#define QIO_GET 1
+#define QIO_WAIT 2
+#define QIO_STAGE 3
+#define QIO_COMMIT 4
+
 #define MyCalloc(a) CheckedAlloc(a, sizeof(int))
 #define MyCallocd(a) CheckedAllocd(a, sizeof(double))
 #define UPW(a) ((a >> 16) & 0x0ffff)
@@ -211,6 +271,7 @@ typedef struct action {
     int *el;			/* List of elements (internal nr.) per kind of PPM */
     int *eqn;			/* List of elements (equipment nr.) per kind of PPM */
     int *co;			/* Completion codes      */
+    int *pco;			/* Completion codes of control preparation */
     int *er;			/* Error codes from 1553 */
     int *tc;			/* Data column for current (present) telegram */
     int *tn;			/* Data column for next telegram */
@@ -228,6 +289,10 @@ typedef struct action {
     int *hwmx;			/* hw max values */
     int *erres;			/* errors corresponding to hw min/max values */
     int lst_ctr_da[MAX_PPM + 1];	/* Last control date = f(user) */
+    struct quick_data_buffer *ctl_bc[MAX_BC + 1];	/* -bcthreads: per BC control sub-chains */
+    struct quick_data_buffer *acq_bc[MAX_BC + 1];	/* -bcthreads: per BC acqn. sub-chains */
+    int prepared;		/* control chain already built for this cycle */
+    int ctl_user;		/* user index of the built control chain */
 
     /* now follow the data for multiple acquisition power converters */
     int its;			/* interrupt marking the begin of multiple acquisitions, resetting the data table */
@@ -237,6 +302,7 @@ typedef struct action {
     double *dmn;		/* minimum value of acquisitions, stored in DMN */
     double *dmx;		/* maximum value of acquisitions, sored in DMX */
     double *acqv;		/* acquisition value */
+    unsigned int *aqraw;	/* aqn fields of the chain, packed for batch decode */
     double *sum;		/* running sum of acqv */
     double *sumsq;		/* running sum of squares of acqv */
     double *aq_ac;		/* array containing the multiple acquisitions */
@@ -304,6 +370,83 @@ static int trace_gbelm = 0;	/* global elem nb to be traced */
 
 static int trace_elm = 0;	/* local elem nb corresponding to glob. elem. */
 static int int_flg = FALSE;	/* interrupt to trace */
+static int prep_usec = 0;	/* message preparation time this cycle */
+static int pipe_flg = FALSE;	/* prepare control messages in a helper thread */
+static int bc_flg = FALSE;	/* one worker thread per BC */
+static int stats_flg = FALSE;	/* per cycle phase timing histograms */
+static int commit_flg = FALSE;	/* stage the controls, then commit them together */
+
+/*--------------------------------------------------------------------------*/
+/* Control preparation thread (-pipe): started with the interrupt number    */
+/* once the user groups are known, it builds the control chains of that     */
+/* interrupt while the main thread does the acquisitions.                   */
+/*--------------------------------------------------------------------------*/
+static pthread_mutex_t pipe_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pipe_cond = PTHREAD_COND_INITIALIZER;
+static int pipe_irpt = 0;	/* interrupt to prepare for, 0 when idle */
+static int pipe_usec = 0;	/* preparation time spent by the thread */
+
+/* Nothing says the EM library is reentrant, so its data table accesses */
+/* are serialised between the main thread and the preparation thread.   */
+static pthread_mutex_t eqm_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define EQM_CALL(call) {\
+    pthread_mutex_lock (&eqm_lock);\
+    call;\
+    pthread_mutex_unlock (&eqm_lock);\
+}
+
+/*--------------------------------------------------------------------------*/
+/* Per BC worker threads (-bcthreads): each one has its own driver handle   */
+/* and runs the sub-chain of an Action on its BC, so that the BCs of a      */
+/* crate work in parallel. The main thread waits for all of them.           */
+/*--------------------------------------------------------------------------*/
+typedef struct bc_worker {
+    int on;			/* thread started for this BC */
+    int fh;			/* own quick data driver handle */
+    int op;			/* QIO_SEND, QIO_GET, QIO_WAIT ... */
+    short cc;			/* completion of the last job */
+    struct quick_data_buffer *job;	/* sub-chain to run, NULL when idle */
+    pthread_t thread;
+} BcWorker;
+
+static BcWorker bcw[MAX_BC + 1];
+static pthread_mutex_t bc_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bc_go = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t bc_done = PTHREAD_COND_INITIALIZER;
+static int bc_pending = 0;	/* workers still busy with their job */
+
+/*--------------------------------------------------------------------------*/
+/* Per cycle phase timings (-stats): the time of each phase is summed over  */
+/* the Actions of a cycle, then added to a log2 histogram in us at the end  */
+/* of the cycle. SIGUSR1 dumps the histograms to stderr.                    */
+/*--------------------------------------------------------------------------*/
+#define PH_WAKE 0		/* from dsc_rtwaitit return to group lookup */
+#define PH_GROUP 1		/* present and next user group lookup */
+#define PH_ACQ_BUS 2		/* acquisition bus transfers */
+#define PH_DECODE 3		/* acquisition message decode */
+#define PH_DT_WRITE 4		/* EM data table writes */
+#define PH_CTL_PREP 5		/* control data table reads and message build */
+#define PH_CTL_BUS 6		/* control bus transfers */
+#define PH_CYCLE 7		/* whole cycle */
+#define PH_NB 8
+
+#define STAT_BINS 24		/* bin b counts times below 2^b us */
+
+typedef struct phase_stat {
+    int cnt;			/* number of cycles the phase ran */
+    long long sum;		/* total time in us */
+    long long min;
+    long long max;
+    int bin[STAT_BINS];
+} PhaseStat;
+
+static PhaseStat phase_stat[PH_NB];
+static long long phase_cyc[PH_NB];	/* time of each phase in this cycle */
+static const char *phase_name[PH_NB] = {
+    "wake", "group", "acq bus", "decode", "dt write", "ctl prep", "ctl bus", "cycle"
+};
+static volatile sig_atomic_t stats_dump = 0;	/* set by SIGUSR1 */
 
 
 /*
@@ -378,6 +521,304 @@ static int GetCurrentTimeMsec (void)
 
 }
 
+/*====================================================*/
+/* Return current time in us for prep. measurements   */
+/*====================================================*/
+static long long GetCurrentTimeUsec (void)
+{
+    struct timeval tt;
+
+    gettimeofday (&tt, NULL);
+    return (tt.tv_sec * 1000000LL + tt.tv_usec);
+
+}
+
+/*====================================================*/
+/* Prepare a prebuilt chain of quick data buffers     */
+/* Topology, BC and RT are set once in BuildActions,  */
+/* per cycle only the packet size and error change.   */
+/*====================================================*/
+static void SetChainPktcnt (struct quick_data_buffer *p, int nb, int pktcnt)
+{
+    int i;
+
+    for (i = 0; i < nb; i++, p++) {
+	p->pktcnt = pktcnt;
+	p->error = 0;
+    }
+}
+
+/*====================================================*/
+/* -bcthreads: link the chains of an Action into one  */
+/* sub-chain per BC                                   */
+/*====================================================*/
+static void SplitChainsPerBc (Action * cact)
+{
+    int i, bc;
+    struct quick_data_buffer *lc[MAX_BC + 1];	/* last control buffer per BC */
+    struct quick_data_buffer *la[MAX_BC + 1];	/* last acqn. buffer per BC */
+
+    memset (lc, 0, sizeof (lc));
+    memset (la, 0, sizeof (la));
+    for (i = 0; i < cact->nb; i++) {
+	bc = cact->ctl[i].bc;
+	if ((bc < 1) || (bc > MAX_BC)) {
+	    fprintf (stderr, "%s: SplitChainsPerBc: el=%d has bad BC number %d. Aborting!\n", program, cact->el[i + 1], bc);
+	    exit (1);
+	}
+	cact->ctl[i].next = cact->acq[i].next = NULL;
+	if (lc[bc]) {
+	    lc[bc]->next = &cact->ctl[i];
+	    la[bc]->next = &cact->acq[i];
+	}
+	else {
+	    cact->ctl_bc[bc] = &cact->ctl[i];
+	    cact->acq_bc[bc] = &cact->acq[i];
+	}
+	lc[bc] = &cact->ctl[i];
+	la[bc] = &cact->acq[i];
+    }
+}
+
+/*====================================================*/
+/* -bcthreads: worker running the jobs of one BC      */
+/*====================================================*/
+static void *BcWorkerThread (void *arg)
+{
+    BcWorker *w = (BcWorker *) arg;
+    struct quick_data_buffer *job;
+    short cc;
+
+    pthread_mutex_lock (&bc_lock);
+    for (;;) {
+	while (w->job == NULL)
+	    pthread_cond_wait (&bc_go, &bc_lock);
+	job = w->job;
+	pthread_mutex_unlock (&bc_lock);
+
+	if (w->op == QIO_GET)
+	    cc = mil1553_get_raw_quick_data_net (w->fh, job);
+	else if (w->op == QIO_SEND)
+	    cc = mil1553_send_raw_quick_data_net (w->fh, job);
+	else if (w->op == QIO_STAGE)
+	    cc = mil1553_stage_quick_data_net (w->fh, job);
+	else
+	    cc = mil1553_wait_quick_data (w->fh, job, REPLY_TMO_us);
+
+	pthread_mutex_lock (&bc_lock);
+	w->cc = cc;
+	w->job = NULL;
+	if (--bc_pending == 0)
+	    pthread_cond_signal (&bc_done);
+    }
+    return (NULL);
+
+}
+
+/*====================================================*/
+/* -bcthreads: start one worker per BC in use, pinned */
+/* to a CPU and with the scheduling of the main task  */
+/*====================================================*/
+static void StartBcWorkers (void)
+{
+    int bc, ncpu;
+    Action *cact;
+    pthread_attr_t attr;
+    cpu_set_t cpus;
+
+    ncpu = sysconf (_SC_NPROCESSORS_ONLN);
+    if (ncpu < 1)
+	ncpu = 1;
+    pthread_attr_init (&attr);
+    pthread_attr_setinheritsched (&attr, PTHREAD_INHERIT_SCHED);
+
+    for (cact = act0; cact; cact = cact->next) {
+	SplitChainsPerBc (cact);
+	for (bc = 1; bc <= MAX_BC; bc++) {
+	    if ((cact->ctl_bc[bc] == NULL) || bcw[bc].on)
+		continue;
+	    if ((bcw[bc].fh = mil1553_init_quickdriver ()) < 0) {
+		perror ("mil1553_init_quickdriver");
+		exit (1);
+	    }
+	    if (pthread_create (&bcw[bc].thread, &attr, BcWorkerThread, &bcw[bc]) != 0) {
+		fprintf (stderr, "%s: Cannot start worker thread for BC %d, errno = %d\n", program, bc, errno);
+		exit (1);
+	    }
+	    CPU_ZERO (&cpus);
+	    CPU_SET ((bc - 1) % ncpu, &cpus);
+	    if (pthread_setaffinity_np (bcw[bc].thread, sizeof (cpus), &cpus) != 0)
+		fprintf (stderr, "%s: Cannot pin worker thread of BC %d\n", program, bc);
+	    bcw[bc].on = TRUE;
+	}
+    }
+    pthread_attr_destroy (&attr);
+
+}
+
+/*====================================================*/
+/* Run a bus operation on the chain of an Action, by  */
+/* the BC workers if any. The completion codes stay   */
+/* in the error field of each buffer.                 */
+/*====================================================*/
+static short ActionIo (struct quick_data_buffer *chain, struct quick_data_buffer **bcq, int op)
+{
+    int bc;
+    short cc = 0;
+    struct quick_data_buffer *last = NULL, *tail[MAX_BC + 1];
+
+    /* One commit for all the BCs so that they start together, the */
+    /* sub-chains are joined for it                                 */
+    if (bc_flg && (op == QIO_COMMIT)) {
+	for (bc = 1, chain = NULL; bc <= MAX_BC; bc++) {
+	    if (bcq[bc] == NULL)
+		continue;
+	    for (tail[bc] = bcq[bc]; tail[bc]->next; tail[bc] = tail[bc]->next);
+	    if (last)
+		last->next = bcq[bc];
+	    else
+		chain = bcq[bc];
+	    last = tail[bc];
+	}
+	cc = stage_quick_data (chain, TRUE);
+	for (bc = 1; bc <= MAX_BC; bc++)
+	    if (bcq[bc])
+		tail[bc]->next = NULL;
+	return cc;
+    }
+
+    if (!bc_flg) {
+	if (op == QIO_GET)
+	    return get_quick_data (chain);
+	if (op == QIO_SEND)
+	    return send_quick_data (chain);
+	if ((op == QIO_STAGE) || (op == QIO_COMMIT))
+	    return stage_quick_data (chain, op == QIO_COMMIT);
+	return wait_quick_data (chain);
+    }
+
+    pthread_mutex_lock (&bc_lock);
+    for (bc = 1; bc <= MAX_BC; bc++) {
+	if (bcq[bc]) {
+	    bcw[bc].op = op;
+	    bcw[bc].job = bcq[bc];
+	    bc_pending++;
+	}
+    }
+    pthread_cond_broadcast (&bc_go);
+    while (bc_pending)
+	pthread_cond_wait (&bc_done, &bc_lock);
+    for (bc = 1; bc <= MAX_BC; bc++) {
+	if (bcq[bc] && bcw[bc].cc && (bcw[bc].cc != EINPROGRESS) && (cc == 0))
+	    cc = bcw[bc].cc;
+    }
+    pthread_mutex_unlock (&bc_lock);
+
+    if (cc && (op != QIO_WAIT))
+	mil1553_print_error (cc);
+    return cc;
+
+}
+
+/*====================================================*/
+/* -stats: time stamp in us, 0 when stats are off     */
+/*====================================================*/
+static long long StatNow (void)
+{
+    struct timespec ts;
+
+    if (!stats_flg)
+	return (0);
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000000LL + ts.tv_nsec / 1000);
+
+}
+
+/*====================================================*/
+/* -stats: add time to a phase of the current cycle   */
+/*====================================================*/
+static void StatAdd (int ph, long long usec)
+{
+    if (stats_flg)
+	phase_cyc[ph] += usec;
+
+}
+
+/*====================================================*/
+/* -stats: add the time since *t to a phase and       */
+/* restart *t for the next one                        */
+/*====================================================*/
+static void StatLap (int ph, long long *t)
+{
+    long long now;
+
+    if (!stats_flg)
+	return;
+    now = StatNow ();
+    phase_cyc[ph] += now - *t;
+    *t = now;
+
+}
+
+/*====================================================*/
+/* -stats: fold the phases of a cycle into histograms */
+/*====================================================*/
+static void StatCycleEnd (long long start)
+{
+    int ph, b;
+    long long us;
+    PhaseStat *ps;
+
+    if (!stats_flg)
+	return;
+    phase_cyc[PH_CYCLE] = StatNow () - start;
+    for (ph = 0; ph < PH_NB; ph++) {
+	us = phase_cyc[ph];
+	phase_cyc[ph] = 0;
+	if (us == 0)
+	    continue;
+	ps = &phase_stat[ph];
+	if ((ps->cnt == 0) || (us < ps->min))
+	    ps->min = us;
+	if (us > ps->max)
+	    ps->max = us;
+	ps->sum += us;
+	ps->cnt++;
+	for (b = 0; (b < STAT_BINS - 1) && (us >= (1LL << b)); b++);
+	ps->bin[b]++;
+    }
+
+}
+
+/*====================================================*/
+/* -stats: print the histograms on stderr             */
+/*====================================================*/
+static void StatDump (void)
+{
+    int ph, b;
+    PhaseStat *ps;
+
+    fprintf (stderr, "\n%s: phase timings in us (bin: count of times < 2^bin us)\n", program);
+    for (ph = 0; ph < PH_NB; ph++) {
+	ps = &phase_stat[ph];
+	if (ps->cnt == 0)
+	    continue;
+	fprintf (stderr, "%-9s n=%d min=%lld avg=%lld max=%lld :", phase_name[ph],
+		 ps->cnt, ps->min, ps->sum / ps->cnt, ps->max);
+	for (b = 0; b < STAT_BINS; b++)
+	    if (ps->bin[b])
+		fprintf (stderr, " %d:%d", b, ps->bin[b]);
+	fprintf (stderr, "\n");
+    }
+    fflush (stderr);
+
+}
+
+static void StatSignal (int sig)
+{
+    stats_dump = 1;
+}
+
 /*====================================================*/
 /* Initialise PLS lines                               */
 /*====================================================*/
@@ -843,6 +1284,7 @@ static void BuildActions (int argc, char **argv)
 	act->t0 = MyCalloc (n);
 	act->ad = MyCalloc (n);
 	act->co = MyCalloc (n);
+	act->pco = MyCalloc (n);
 	act->er = MyCalloc (n);
 	act->stmp = MyCallocd (n);
 
@@ -939,6 +1381,7 @@ static void BuildActions (int argc, char **argv)
 	    act->dmn = CheckedAllocd (n, sizeof (double));
 	    act->dmx = CheckedAllocd (n, sizeof (double));
 	    act->acqv = CheckedAllocd (n, sizeof (double));
+	    act->aqraw = (unsigned int *) CheckedAlloc (n, sizeof (unsigned int));
 	    act->sum = CheckedAllocd (n, sizeof (double));
 	    act->sumsq = CheckedAllocd (n, sizeof (double));
 	    act->aq_ac = CheckedAllocd (n, 16 * sizeof (double));
@@ -1130,18 +1573,15 @@ static void ReqAcquisitionMinMax (Action * cact, int first)
 	fprintf (stderr, "%s: can't read CCAC DTcolumn, er= %d!\n", program, cact->co[0]);
 
     /* Initialize configuration request message for MIL-1553 */
-    pc = cact->ctl;		/* set pointer to ctrl. message */
-    memset (pc, 0, cact->nb * sizeof (struct quick_data_buffer));	/* clear ctrl. buffers */
+    pc = cact->ctl;		/* set pointer to ctrl. message, chain built in BuildActions */
 
-    /* Create linked list of ctrl. messages */
+    /* Fill in the prebuilt list of ctrl. messages */
     gettimeofday (&da, NULL);	/* get current time (TOD) */
     for (i = 0; i < cact->nb; i++, pc++) {
 	/* Prepare request message */
-	pc->bc = UPW (cact->ad[i]);	/* set BC number */
-	pc->rt = LOW (cact->ad[i]);	/* set RT number */
 	pc->stamp = cact->el[i + 1];	/* set STAMP field == element number */
 	pc->pktcnt = 22;	/* sizeof(req_msg) = 24 instead of 22 */
-	pc->next = ((i < (cact->nb - 1)) ? &pc[1] : NULL);	/* ptr. to next control block */
+	pc->error = 0;
 	msg = (req_msg *) & (pc->pkt[0]);
 	memcpy (msg, &(cact->v2[i * 6]), 22);
 	msg->protocol_date.sec = htonl (da.tv_sec);
@@ -1150,7 +1590,7 @@ static void ReqAcquisitionMinMax (Action * cact, int first)
     }
 
     /* Send request messages */
-    if (send_quick_data (cact->ctl)) {	/* if MIL-1553 error returned */
+    if (ActionIo (cact->ctl, cact->ctl_bc, QIO_SEND)) {	/* if MIL-1553 error returned */
 	fprintf (stderr, "%s: QCKDATERR for requesting hw min/max acquisition\n", program);
     }
 }
@@ -1180,23 +1620,14 @@ static void DoAcquisitionMinMax (Action * cact, int first)
     RDT (cact->hwmx, 1, col_hwmx, 0);
     RDT (cact->hwmn, 1, col_hwmn, 0);
 
-    /* Clear acqn. buffers */
-    pa = cact->acq;		/* set pointer to acqn. message */
-    memset (pa, 0, cact->nb * sizeof (struct quick_data_buffer));
-
-    /* Initialize acquisition message for MIL-1553 */
-    for (i = 0; i < cact->nb; i++, pa++) {
-	pa->bc = UPW (cact->ad[i]);	/* BC number */
-	pa->rt = LOW (cact->ad[i]);	/* RT number */
-	pa->pktcnt = sizeof (conf_msg);
-	pa->next = ((i < (cact->nb - 1)) ? &pa[1] : NULL);	/* pointer to next acq. message */
-    }
+    /* Initialize prebuilt acquisition chain for MIL-1553 */
+    SetChainPktcnt (cact->acq, cact->nb, sizeof (conf_msg));
 
     /* Get acquisition messages from all existing G64s. If hwmx contains a nonzero value,
        it is considered to be valid (by a previous powrt run or a programmer's action), erres = 0.
        The erres variable giving the coco for an EM reading is treated correspondingly */
 
-    cc = get_quick_data (cact->acq);
+    cc = ActionIo (cact->acq, cact->acq_bc, QIO_GET);
     if (cc) {			/* if MIL-1553 error returned */
 	for (i = 0; i < cact->nb; i++)
 	    if (cact->hwmx[i] == 0)
@@ -1266,22 +1697,20 @@ static void DoAcquisitionMinMax (Action * cact, int first)
 }
 
 /*====================================================*/
-/* Control Interrupt handling, called once per action */
+/* Build the control messages of an action into its   */
+/* prebuilt chain. Returns the user index of the      */
+/* messages, or -1 if there is no control this cycle. */
+/* Uses its own data descriptor and completion codes  */
+/* so it may run in the preparation thread during the */
+/* acquisition of the same action (not double PPM).   */
 /*====================================================*/
-static void DoControl (Action * cact)
+static int PrepareControl (Action * cact)
 {
-    int i, k, sz;
+    int i;
     int tgm;			/* flag for telegram: current = 0, next = 1 */
     int gval;			/* group value corresponding to next or present telegram */
-    int tr_nb;			/* element(equipment) number for debug tracing */
-
-    int els[2];			/* element array for single element */
-    int cos[2];			/* completion array for single element */
-    unsigned int fupa;		/* actuation except reset */
-    nonppm_ctrl_msg *dtrs;	/* dtrs points to message structure */
-    int lst_ctr_da = 0;
-    int dif_ctr_da;
     int indx_ctr_da;
+    data_array data_desc;	/* local: the global one belongs to the main thread */
     struct timeval da;
     struct quick_data_buffer *pc;	/* control buffers */
     ctrl_msg *msg;
@@ -1289,11 +1718,7 @@ static void DoControl (Action * cact)
 
     tgm = ppm_ctl[cact->grp];
     if (tgm < 0)
-	return;			/* no actions */
-
-    /* Clear errors from CAMAC and MIL-1553 */
-    sz = (cact->nb + 1) * sizeof (int);
-    memset (&cact->er[0], 0, sz);
+	return (-1);		/* no actions */
 
     /* Find group value */
     gval = (tgm) ? next_grp_val : pres_grp_val;
@@ -1307,32 +1732,26 @@ static void DoControl (Action * cact)
 	for (i = 0; i < cact->nb; i++)
 	    cact->el[i + 1] = cact->ms[i];
 
-    RDT (cact->v2, 6, col_ccac, 0);	/* get non ppm data */
-    if (trace_ctl_flg && (cact->co[0] != EQP_NOERR))
-	fprintf (stderr, "%s: DoControl: can't read CCAC column in DT, coco = %d!\n", program, cact->co[0]);
+    RDTP (cact->v2, 6, col_ccac, 0, cact->pco);	/* get non ppm data */
+    if (trace_ctl_flg && (cact->pco[0] != EQP_NOERR))
+	fprintf (stderr, "%s: DoControl: can't read CCAC column in DT, coco = %d!\n", program, cact->pco[0]);
 
     /* But read CCVA from slave if needed */
     if (cact->fdppm)
 	SelectEquipmentNumber (cact);
 
-    RDT (cact->v3, 5, col_ccva, -gval);	/* normal case */
+    RDTP (cact->v3, 5, col_ccva, -gval, cact->pco);	/* normal case */
 
-    if (trace_ctl_flg && (cact->co[0] != EQP_NOERR))
-	fprintf (stderr, "%s: DoControl: can't read CCVA column in DT, coco = %d!\n", program, cact->co[0]);
+    if (trace_ctl_flg && (cact->pco[0] != EQP_NOERR))
+	fprintf (stderr, "%s: DoControl: can't read CCVA column in DT, coco = %d!\n", program, cact->pco[0]);
 
-    /* Clear ctrl. message buffers */
+    /* Fill in the prebuilt list of control messages */
     pc = cact->ctl;		/* set pointer to ctrl. block */
-    memset (pc, 0, cact->nb * sizeof (struct quick_data_buffer));
-
-    /* Create linked list of control messages */
     gettimeofday (&da, NULL);	/* get TOD (Unix format) */
     for (i = 0; i < cact->nb; i++, pc++) {	/* scan all elements ... */
 
-	/* Initialise control block for MIL-1553 I/O */
-	pc->bc = UPW (cact->ad[i]);	/* set BC number */
-	pc->rt = LOW (cact->ad[i]);	/* set RT number */
+	/* Patch control block for MIL-1553 I/O */
 	pc->stamp = cact->el[i + 1];	/* set STAMP == el. number */
-	pc->next = ((i < (cact->nb - 1)) ? &pc[1] : NULL);	/* pointer to next ctrl. block */
 
 	/* Prepare control message */
 	msg = (ctrl_msg *) & (pc->pkt[0]);
@@ -1352,11 +1771,64 @@ static void DoControl (Action * cact)
 		     ntohs (msg->service), msg->type, ntohs (msg->member));
 	};
     }
+    return (indx_ctr_da);
+
+}
+
+
+/*====================================================*/
+/* Control Interrupt handling, called once per action */
+/* The messages are built here unless the preparation */
+/* thread already did it (-pipe option)               */
+/*====================================================*/
+static void DoControl (Action * cact)
+{
+    int i, sz;
+    short cc;
+    int tr_nb;			/* element(equipment) number for debug tracing */
+
+    int els[2];			/* element array for single element */
+    int cos[2];			/* completion array for single element */
+    unsigned int fupa;		/* actuation except reset */
+    nonppm_ctrl_msg *dtrs;	/* dtrs points to message structure */
+    int lst_ctr_da = 0;
+    int dif_ctr_da;
+    int indx_ctr_da;
+    long long prep;		/* start of message preparation in us */
+    long long t;		/* -stats: start of the current phase */
+    ctrl_msg *msg;
+
+
+    if (cact->prepared) {
+	indx_ctr_da = cact->ctl_user;
+	cact->prepared = FALSE;
+    }
+    else {
+	prep = GetCurrentTimeUsec ();
+	indx_ctr_da = PrepareControl (cact);
+	prep = GetCurrentTimeUsec () - prep;
+	prep_usec += prep;
+	StatAdd (PH_CTL_PREP, prep);
+    }
+    if (indx_ctr_da < 0)
+	return;			/* no actions */
+
+    /* Clear errors from CAMAC and MIL-1553 */
+    sz = (cact->nb + 1) * sizeof (int);
+    memset (&cact->er[0], 0, sz);
 
     tr_nb = -1;
 
     /* Send messages over MIL-1553: cact->nb messages */
-    if (send_quick_data (cact->ctl) != 0) {	/* MIL-1553 error (encoded in errno) */
+    t = StatNow ();
+    if (commit_flg) {		/* RB of all the staged messages at once */
+	cc = ActionIo (cact->ctl, cact->ctl_bc, QIO_STAGE);
+	if (cc == 0)
+	    cc = ActionIo (cact->ctl, cact->ctl_bc, QIO_COMMIT);
+    }
+    else
+	cc = ActionIo (cact->ctl, cact->ctl_bc, QIO_SEND);
+    if (cc != 0) {		/* MIL-1553 error (encoded in errno) */
 	for (i = 0; i <= cact->nb; i++)
 	    cact->er[i] = EQP_QCKDATERR;	/* log errors */
 	/* <<< DEBUG info >>> */
@@ -1372,6 +1844,7 @@ static void DoControl (Action * cact)
 		tr_nb = i;
 	}
     }
+    StatLap (PH_CTL_BUS, &t);
 
     /* <<< DEBUG info >>> */
     if (trace_ctl_flg && (tr_nb >= 0)) {	/* trace infos for 'tr_nb'-element */
@@ -1407,14 +1880,14 @@ static void DoControl (Action * cact)
 	    data_desc.size = 1;
 	    els[1] = cact->el[i + 1];
 	    cos[0] = cos[1] = 0;	/* clear cocos */
-	    eqm_rtr_iv (blsx, &col_fupa, &data_desc, 1, els, 2, 0, cos, 2);
+	    EQM_CALL (eqm_rtr_iv (blsx, &col_fupa, &data_desc, 1, els, 2, 0, cos, 2));
 	    if (trace_ctl_flg && (cos[0] != EQP_NOERR))
 		fprintf (stderr, "%s: DoControl: can't read FUPA column in DT, coco = %d!\n", program, cos[0]);
 	    dtrs->ccsact = fupa;
 	    data_desc.data = &(cact->v2[i * 6]);	/* data structure to write previous data into ccac */
 	    data_desc.size = 6;
 	    cos[0] = cos[1] = 0;
-	    eqm_rtw_iv (blsx, &col_ccac, &data_desc, 6, els, 2, 0, cos, 2);
+	    EQM_CALL (eqm_rtw_iv (blsx, &col_ccac, &data_desc, 6, els, 2, 0, cos, 2));
 	    if (trace_ctl_flg && (cos[0] != EQP_NOERR))
 		fprintf (stderr, "%s: DoControl: can't write CCAC column in DT, coco = %d!\n", program, cos[0]);
 	}
@@ -1424,6 +1897,71 @@ static void DoControl (Action * cact)
     WDT (&cact->er[1], 1, col_err1, 0);
     if (trace_ctl_flg && (cact->co[0] != EQP_NOERR))
 	fprintf (stderr, "%s: DoControl: can't write ERR1 column in DT, coco = %d!\n", program, cact->co[0]);
+    StatLap (PH_DT_WRITE, &t);
+
+}
+
+
+/*====================================================*/
+/* Control preparation thread (-pipe option): builds  */
+/* the control chains of the signalled interrupt      */
+/*====================================================*/
+static void *PrepareControlThread (void *arg)
+{
+    Action *cact;
+    int irpt;
+    long long prep;
+
+    pthread_mutex_lock (&pipe_lock);
+    for (;;) {
+	while (pipe_irpt == 0)
+	    pthread_cond_wait (&pipe_cond, &pipe_lock);
+	irpt = pipe_irpt;
+	pthread_mutex_unlock (&pipe_lock);
+
+	/* Double PPM actions change el[] in DoAcquisition, keep them serial */
+	prep = GetCurrentTimeUsec ();
+	for (cact = act0; cact; cact = cact->next) {
+	    if ((irpt == cact->ci) && (cact->first == 0) && (cact->fdppm == 0)) {
+		cact->ctl_user = PrepareControl (cact);
+		cact->prepared = TRUE;
+	    }
+	}
+
+	pthread_mutex_lock (&pipe_lock);
+	pipe_usec = GetCurrentTimeUsec () - prep;
+	pipe_irpt = 0;
+	pthread_cond_broadcast (&pipe_cond);
+    }
+    return (NULL);
+
+}
+
+
+/*====================================================*/
+/* Hand the interrupt over to the preparation thread  */
+/*====================================================*/
+static void StartControlPrep (int irpt)
+{
+    pthread_mutex_lock (&pipe_lock);
+    pipe_irpt = irpt;
+    pthread_cond_broadcast (&pipe_cond);
+    pthread_mutex_unlock (&pipe_lock);
+
+}
+
+
+/*====================================================*/
+/* Wait until the preparation thread is done          */
+/*====================================================*/
+static void WaitControlPrep (void)
+{
+    pthread_mutex_lock (&pipe_lock);
+    while (pipe_irpt != 0)
+	pthread_cond_wait (&pipe_cond, &pipe_lock);
+    prep_usec += pipe_usec;
+    StatAdd (PH_CTL_PREP, pipe_usec);
+    pthread_mutex_unlock (&pipe_lock);
 
 }
 
@@ -1483,6 +2021,63 @@ static void ResetAquArray (Action * cact)
 }
 
 
+/*====================================================*/
+/* Batch decode of the acqn. messages of one Action   */
+/* First pass checks each message and copies it into  */
+/* the AQ column buffer, the aqn fields are packed    */
+/* into aqraw. Second pass converts all of them from  */
+/* network order at once, into the acqv column.       */
+/* Returns the index of the element to trace or -1.   */
+/*====================================================*/
+static int DecodeAcqBatch (Action * cact)
+{
+    int i, err;
+    int tr_nb = -1;
+    int n = cact->nb;
+    unsigned int *raw = cact->aqraw;
+    acq_msg *msg;
+    float f;
+
+    for (i = 0; i < n; i++) {
+	msg = (acq_msg *) & (cact->acq[i].pkt[0]);
+	/* <<< DEBUG info >>> select index of element to be traced */
+	if (trace_acq_flg && (cact->el[i + 1] == trace_elm))
+	    tr_nb = i;
+	err = cact->er[i + 1] = c1553toem (cact->acq[i].error);
+	if (err == 0) {
+	    if (((ntohs (msg->service) != 0) || (msg->type != 1))) {
+		fprintf (stderr, "%s: DoAcquisition: eqn=%d bc=%d rt=%d loc=%d ms=%d, service=%x, type=%x memb=%d(%d)\n",
+			 program, cact->eqn[i + 1], UPW (cact->ad[i]), LOW (cact->ad[i]), cact->el[i + 1],
+			 (cact->fdppm ? cact->ms[i] : 0), ntohs (msg->service), msg->type,
+			 ntohs (msg->member), get_globelno (blsx, ntohs (msg-> member)));
+		err = EQP_BADBUF;
+	    }
+	}
+	if (err == 0) {
+	    memcpy (&cact->va[i * 11], msg, 11 * sizeof (int));
+	    if (raw)
+		memcpy (&raw[i], &msg->aqn, sizeof (int));
+	}
+	else {
+	    memset (&cact->va[i * 11], 0, 11 * sizeof (int));
+	    if (raw)
+		raw[i] = 0;
+	}
+    }
+
+    /* only valid acquisition values are written, the others stay zero */
+    if (cact->its > 0) {
+	for (i = 0; i < n; i++)
+	    raw[i] = ntohl (raw[i]);
+	for (i = 0; i < n; i++) {
+	    memcpy (&f, &raw[i], sizeof (float));
+	    cact->acqv[i] = f;
+	}
+    }
+    return tr_nb;
+}
+
+
 /*====================================================*/
 /* Acquisition Interrupt handling                     */
 /* Multiple acquisitions per cycle for its <> 0       */
@@ -1494,9 +2089,9 @@ static void DoAcquisition (Action * cact)
     int tgm;			/* flag for telegram: current = 0, next = 1 */
     int gval;			/* group value dependent on "present" or "next" group */
     double stamp;		/* cycle stamp */
-    int err;
     int tr_nb;			/* element(equipment) index for debug tracing */
-    struct quick_data_buffer *pa;	/* acqn. buffers */
+    long long prep;		/* start of message preparation in us */
+    long long t;		/* -stats: start of the current phase */
     acq_msg *msg;
     int nm;			/* actual number of measurements in current cycle */
     double aqv;			/* acquisition value */
@@ -1519,63 +2114,37 @@ static void DoAcquisition (Action * cact)
     }
 
     /* Get cycle stamp and put them into the data columns gval and 0 */
+    t = StatNow ();
     stamp = TgmGetLastTelegramTimeStampSeconds (plstb);
     for (i = 0; i < cact->nb; i++)
 	cact->stmp[i] = stamp;
     WDTD (cact->stmp, 1, col_stmp, -gval);	/* write cycle stamp into column of current user */
     WDTD (cact->stmp, 1, col_stmp, 0);	/* write cycle stamp into zero column */
+    StatLap (PH_DT_WRITE, &t);
 
-    pa = cact->acq;		/* set pointer to acqn. messages */
-
-    /* Clear acqn. buffers */
-    memset (pa, 0, cact->nb * sizeof (struct quick_data_buffer));
+    prep = GetCurrentTimeUsec ();
     if (cact->its > 0)
 	memset (cact->acqv, 0, cact->nb * sizeof (double));
 
-    /* Initialise control blocks for M1553 I/O */
-    for (i = 0; i < cact->nb; i++, pa++) {
-	pa->bc = UPW (cact->ad[i]);	/* set BC number */
-	pa->rt = LOW (cact->ad[i]);	/* set RT number */
-	pa->pktcnt = sizeof (acq_msg);
-	pa->next = ((i < (cact->nb - 1)) ? &pa[1] : NULL);	/* pointer to next acqn. message */
-    }
+    /* Initialise prebuilt control blocks for M1553 I/O */
+    SetChainPktcnt (cact->acq, cact->nb, sizeof (acq_msg));
+    prep_usec += GetCurrentTimeUsec () - prep;
 
-    err = 0;
     tr_nb = -1;
 
     /* Get acqn. messages from all existing G64s */
-    cc = get_quick_data (cact->acq);
+    t = StatNow ();
+    cc = ActionIo (cact->acq, cact->acq_bc, QIO_GET);
+    StatLap (PH_ACQ_BUS, &t);
     if (cc) {			/* MIL-1553 global error */
 	for (i = 0; i <= cact->nb; i++)
 	    cact->er[i] = EQP_QCKDATERR;	/* log error */
 	fprintf (stderr, "%s: DoAcquisition: get_quick_data ioctl error = %d\n", program, errno);
     }
-    else {                      /* check error field for each acqn. message */
-	for (i = 0; i < cact->nb; i++) {
-	    msg = (acq_msg *) & (cact->acq[i].pkt[0]);
-	    /* <<< DEBUG info >>> select index of element to be traced */
-	    if (trace_acq_flg && (cact->el[i + 1] == trace_elm))
-		tr_nb = i;
-	    err = cact->er[i + 1] = c1553toem (cact->acq[i].error);
-	    if (err == 0) {
-		if (((ntohs (msg->service) != 0) || (msg->type != 1))) {
-		    fprintf (stderr, "%s: DoAcquisition: eqn=%d bc=%d rt=%d loc=%d ms=%d, service=%x, type=%x memb=%d(%d)\n",
-			     program, cact->eqn[i + 1], UPW (cact->ad[i]), LOW (cact->ad[i]), cact->el[i + 1],
-			     (cact->fdppm ? cact->ms[i] : 0), ntohs (msg->service), msg->type,
-			     ntohs (msg->member), get_globelno (blsx, ntohs (msg-> member)));
-		    err = EQP_BADBUF;
-		}
-	    }
-	    if (err == 0) {
-		memcpy (&cact->va[i * 11], msg, 11 * sizeof (int));
-		if (cact->its > 0)
-		    cact->acqv[i] = ntohx (msg->aqn);   /* write only valid acquisition values into the column set to zero before */
-	    }
-	    else {
-		memset (&cact->va[i * 11], 0, 11 * sizeof (int));
-	    }
-	}
-
+    else                        /* check error field for each acqn. message */
+	tr_nb = DecodeAcqBatch (cact);
+    StatLap (PH_DECODE, &t);
+    if (cc == 0) {
 	/* <<< DEBUG info >>> */
 	if (trace_acq_flg && (tr_nb >= 0)) {	/* trace selected element */
 	    msg = (acq_msg *) & (cact->va[tr_nb * 11]);
@@ -1674,6 +2243,7 @@ static void DoAcquisition (Action * cact)
     WDT (&cact->er[1], 1, col_err2, 0);
     if (trace_acq_flg && (cact->co[0] != EQP_NOERR))
 	fprintf (stderr, "%s: DoAcquisition: can't write ERR2 column in DT, coco = %d!\n", program, cact->co[0]);
+    StatLap (PH_DT_WRITE, &t);
 }
 
 
@@ -1736,8 +2306,12 @@ static void Usage (void)
     fprintf (stderr, "  -trace_acq <el.nr.>   trace the aquisition for given power converter\n");
     fprintf (stderr, "  -trace_ctl <el.nr.>   trace the control for given power converter\n");
     fprintf (stderr, "  -jitter <x>           trace all jitter bigger than <x> ms\n");
-    fprintf (stderr, "  -time                 print total treatment time in ms\n");
+    fprintf (stderr, "  -time                 print total treatment time in ms and message prep. time in us\n");
     fprintf (stderr, "  -loop <x>             handle loop number <x>\n");
+    fprintf (stderr, "  -pipe                 prepare control messages during the acquisitions\n");
+    fprintf (stderr, "  -bcthreads            run the bus work of each BC in its own thread\n");
+    fprintf (stderr, "  -stats                time each cycle phase, kill -USR1 dumps the histograms\n");
+    fprintf (stderr, "  -commit               stage the controls, then start them all together\n");
 }
 
 
@@ -1790,6 +2364,14 @@ static void GetCmdLineOptions (int argc, char **argv)
 	}
 	else if (strcmp (argv[i], "-time") == 0)
 	    pdelay_flg = TRUE;
+	else if (strcmp (argv[i], "-pipe") == 0)
+	    pipe_flg = TRUE;
+	else if (strcmp (argv[i], "-bcthreads") == 0)
+	    bc_flg = TRUE;
+	else if (strcmp (argv[i], "-stats") == 0)
+	    stats_flg = TRUE;
+	else if (strcmp (argv[i], "-commit") == 0)
+	    commit_flg = TRUE;
 	else if ((strcmp (argv[i], "-trace_acq") == 0)
 		 || (strcmp (argv[i], "-trace_ctl") == 0)) {
 	    if (++i >= argc) {
@@ -1824,7 +2406,10 @@ int main (int argc, char **argv)
     int notwaited = 1;
     int fd = (-1);		/* file descriptor for connect routine */
     int date_s = 0;
+    long long cyc;		/* -stats: start of the cycle */
+    long long t;		/* -stats: start of the current phase */
     time_t t0;
+    pthread_t pipe_thread;
     char dat[128];
 
     /* Get program name for error printouts */
@@ -1861,11 +2446,20 @@ int main (int argc, char **argv)
     if (exit_flg)
 	exit (1);		/* exit task here if 'config' option has been selected */
 
+    /* Start the per BC workers before any bus access */
+    if (bc_flg)
+	StartBcWorkers ();
+
+    /* Dump the phase timings on request */
+    if (stats_flg)
+	signal (SIGUSR1, StatSignal);
+
     for (i = 1; i >= 0; i--) {
 	for (act = act0; act; act = act->next) {	/* scan all Actions */
 	    /* Request acquisition of hardware MIN/MAX values for 1553 power converters */
 	    ReqAcquisitionMinMax (act, i);
-	    usleep (40000);
+	    if (act->fdppm == 0)
+		ActionIo (act->acq, act->acq_bc, QIO_WAIT);
 	    /* Acquire hardware MIN/MAX values for 1553 power converters */
 	    DoAcquisitionMinMax (act, i);
 	    act->first = 0;	/* clear flag */
@@ -1874,11 +2468,18 @@ int main (int argc, char **argv)
     if (no_timing) {		/* no interrupts present, loop all 1.2 sec */
 	for (;;) {		/* only for non PPM equipment valid */
 
+	    if (stats_dump) {
+		stats_dump = 0;
+		StatDump ();
+	    }
+	    cyc = StatNow ();
+
 	    /* Do acquisition and then control actions */
 	    for (act = act0; act; act = act->next)
 		DoAcquisition (act);
 	    for (act = act0; act; act = act->next)
 		DoControl (act);
+	    StatCycleEnd (cyc);
 
 	    usleep (1200000);	/* sleep for 1.2 sec */
 	}
@@ -1891,6 +2492,12 @@ int main (int argc, char **argv)
 	fd = dsc_rtconnect (act->its);
     }
 
+    /* Start the control preparation thread */
+    if (pipe_flg && (pthread_create (&pipe_thread, NULL, PrepareControlThread, NULL) != 0)) {
+	fprintf (stderr, "%s: Cannot start control preparation thread, errno = %d\n", program, errno);
+	pipe_flg = FALSE;
+    }
+
 
     /* 
      * Infinite Acquisition & Control Loop :
@@ -1900,9 +2507,14 @@ int main (int argc, char **argv)
 
 	if (pdelay_flg) {
 	    if (date_s != 0) {
-		fprintf (stderr, "%d ", GetCurrentTimeMsec () - date_s);
+		fprintf (stderr, "%d(prep:%dus) ", GetCurrentTimeMsec () - date_s, prep_usec);
 		fflush (stderr);
 	    }
+	    prep_usec = 0;
+	}
+	if (stats_dump) {
+	    stats_dump = 0;
+	    StatDump ();
 	}
 
 	/* After all done open the lock for other processes */
@@ -1910,6 +2522,7 @@ int main (int argc, char **argv)
 	/* disturbing the power supplies... the protocol isn't perfect */
 
 	irpt = dsc_rtwaitit ();
+	t = cyc = StatNow ();
 
 	notwaited = 1;
 
@@ -1923,17 +2536,24 @@ int main (int argc, char **argv)
 	    fflush (stderr);
 	}
 
+	StatLap (PH_WAKE, &t);
+
 	/* Get PRESENT and NEXT user group values */
-	if (GetCurrentUserGroup () != 0)
+	if ((GetCurrentUserGroup () != 0) || (GetNextUserGroup () != 0)) {
+	    StatCycleEnd (cyc);
 	    continue;		/* skip this cycle */
-	if (GetNextUserGroup () != 0)
-	    continue;
+	}
+	StatLap (PH_GROUP, &t);
 
 	/* Reset multiple acquisition parameters for all actions */
 	for (act = act0; act; act = act->next) {	/* scan all Actions */
 	    if (irpt == act->its)
 		ResetAquArray (act);
 	}
+	/* Let control messages be built while the bus does the acquisitions */
+	if (pipe_flg)
+	    StartControlPrep (irpt);
+
 	/* Do all acquisition actions before control actions */
 	for (act = act0; act; act = act->next) {	/* scan all Actions */
 	    if (irpt == act->ai) {
@@ -1945,10 +2565,13 @@ int main (int argc, char **argv)
 	    }
 	}
 	/* Now do all control actions */
+	if (pipe_flg)
+	    WaitControlPrep ();
 	for (act = act0; act; act = act->next) {
 	    if ((irpt == act->ci) && (act->first == 0))
 		DoControl (act);
 	}
+	StatCycleEnd (cyc);
 
     }
 
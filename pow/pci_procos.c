@@ -132,6 +132,82 @@ static short get_quick_data (struct quick_data_buffer *p)
     return 0;
 }
 
+/* Wait for the reply of a request, at most the old fixed 40 ms gap */
+#define REPLY_TMO_us 40000
+
+static short wait_quick_data (struct quick_data_buffer *p)
+{
+    if (mil1533_init_done == 0) {
+	if ((mil1533_fh = mil1553_init_quickdriver ()) < 0) {
+	    perror ("mil1553_init_quickdriver");
+	    return (-1);
+	}
+	mil1533_init_done = 1;
+    }
+    return mil1553_wait_quick_data(mil1533_fh, p, REPLY_TMO_us);
+}
+
+/*====================================================*/
+/* configuration replies by BC/RTI, valid as long as  */
+/* the driver generation of the RTI does not change   */
+/*====================================================*/
+static struct {
+    unsigned int gen;
+    int valid;
+    struct quick_data_buffer rep;
+} conf_cache[CACHE_BCS][32];
+
+/* 1: cached reply copied, 0: not cached but *gen allows storing it, -1: no cache */
+static int conf_cache_get (int addr, struct quick_data_buffer *rep, unsigned int *gen)
+{
+    int bc = UPW(addr), rt = LOW(addr);
+
+    if (mil1533_init_done == 0) {
+	if ((mil1533_fh = mil1553_init_quickdriver ()) < 0)
+	    return (-1);
+	mil1533_init_done = 1;
+    }
+    if (rtilib_cache_gen(mil1533_fh, bc, rt, gen) != 0)
+	return (-1);
+    if (!conf_cache[bc][rt].valid || (conf_cache[bc][rt].gen != *gen))
+	return (0);
+    memcpy(rep, &conf_cache[bc][rt].rep, sizeof(struct quick_data_buffer));
+    rep->next = NULL;
+    return (1);
+}
+
+static void conf_cache_put (int addr, struct quick_data_buffer *rep, unsigned int gen)
+{
+    int bc = UPW(addr), rt = LOW(addr);
+
+    memcpy(&conf_cache[bc][rt].rep, rep, sizeof(struct quick_data_buffer));
+    conf_cache[bc][rt].gen = gen;
+    conf_cache[bc][rt].valid = 1;
+}
+
+#else
+
+/*====================================================*/
+/* no readiness wait in the old library: fixed delay  */
+/*====================================================*/
+static short wait_quick_data (struct quick_data_buffer *p)
+{
+    struct timespec rqtp, rmtp; /* 'nanosleep' time structure */
+    rqtp.tv_sec = 0;
+    rqtp.tv_nsec = 40000*1000;
+    nanosleep(&rqtp, &rmtp);
+    return 0;
+}
+
+static int conf_cache_get (int addr, struct quick_data_buffer *rep, unsigned int *gen)
+{
+    return (-1);
+}
+
+static void conf_cache_put (int addr, struct quick_data_buffer *rep, unsigned int gen)
+{
+}
+
 #endif
 
 /*====================================================*/
@@ -217,17 +293,6 @@ static int c1553toem (int err)
     return (e);
 }
 
-/*====================================================*/
-/* wait using nanosleep instead of usleep             */
-/*====================================================*/
-static void my_usleep(int dly)
-{
-    struct timespec rqtp, rmtp; /* 'nanosleep' time structure */
-    rqtp.tv_sec = 0;
-    rqtp.tv_nsec = dly*1000;
-    nanosleep(&rqtp, &rmtp);
-}
-
 /*****************************************************************************
    subroutine for PPM aquisition for non PPM power supplies
 ******************************************************************************/
@@ -546,85 +611,206 @@ sproco(r03bcv,r03bcv_dtr,double)
 }
 
 /*****************************************************************************
-R03BUFV               Reads back control parameters as received by G64  
-*****************************************************************************/
-
-typedef struct {
-    int     address1;       /* RO  BC/ RTI logical address          */
-    int     cnnt;           /* RO  Connection column                */
-} r03bufv_dtr; 
+   subroutine reading back a message (service) from a vector of power
+   supplies: one request chain, one send, one wait and one get for all of
+   them. The elements whose reply failed are retried together.
+   addr[i] is the ADDRESS1 of member membno[i]. On return rep[i] holds the
+   reply with its 1553 error, coco[i] is only set on error.
+   Configuration replies (service 5) come from conf_cache when possible.
+******************************************************************************/
 
-sproco(r03bufv,r03bufv_dtr,double)
+static void readback_vec (int service, int pktcnt, int nel, int *addr, int *membno,
+			  int plsline, struct quick_data_buffer *rep, int *coco)
 {
-    int                         cc, retry_count;
-    struct quick_data_buffer    send_buf;
-    struct quick_data_buffer   *quickptr_req = &send_buf;
-    struct quick_data_buffer    receive_buf;
-    struct quick_data_buffer   *quickptr_ctl = &receive_buf;
+    int                         i, cc, retry_count, npend;
+    int                        *pend;          /* reply still wanted */
+    long long                  *cgen;          /* generation to cache the reply, -1 none */
+    unsigned int                gen;
+    struct quick_data_buffer   *req, *reqh, *reph;
+    struct quick_data_buffer  **reqt, **rept;
     req_msg                    *req_ptr;
-    ctrl_msg                   *ctrl_ptr;
     struct timeval     da;
 
+    req = (struct quick_data_buffer *) calloc(nel, sizeof(struct quick_data_buffer));
+    pend = (int *) calloc(nel, sizeof(int));
+    cgen = (long long *) calloc(nel, sizeof(long long));
+    if ((req == NULL) || (pend == NULL) || (cgen == NULL)) {
+	for (i = 0; i < nel; i++) {
+	    rep[i].error = ENOMEM;
+	    coco[i] = EQP_SYS5ERR;
+	}
+	free(req);
+	free(pend);
+	free(cgen);
+	return;
+    }
+    for (i = 0; i < nel; i++) {
+	pend[i] = 1;
+	cgen[i] = -1;
+	if (service == 5) {
+	    switch (conf_cache_get(addr[i], &rep[i], &gen)) {
+		case 1:
+		    pend[i] = 0;
+		break;
+		case 0:
+		    cgen[i] = gen;
+		break;
+	    }
+	}
+    }
+
     retry_count = 0;
-    {
-retry:  gettimeofday(&da, NULL);  /* get TOD (Unix format) */
-	memset(quickptr_req, 0, sizeof(struct quick_data_buffer));
-	quickptr_req->bc = UPW(dtr->address1); /* BC number */
-	quickptr_req->rt = LOW(dtr->address1); /* RT number */
-	quickptr_req->stamp = 0;
-	quickptr_req->error = 0;
-	quickptr_req->pktcnt = 22; /* sizeof (req_msg) = 24 instead of 22 */
-	quickptr_req->next = NULL;
-
-	/* Initialize request message */
-	req_ptr = (req_msg *) &(quickptr_req->pkt[0]);
-	req_ptr->family         = htons(EQP_POW);
-	req_ptr->type           = TYPE;
-	req_ptr->sub_family     = SUB_FAMILY;
-	req_ptr->member         = htons(membno);
-	req_ptr->protocol_date.sec = htonl(da.tv_sec);
-	req_ptr->protocol_date.usec = htonl(da.tv_usec);
-	req_ptr->service        = htons(1);     /* read back ctrl msg */
-	req_ptr->cycle.machine  = htons(gm_getmachine());
-	req_ptr->cycle.pls_line = htons(plsline);
-	req_ptr->specialist     = htons(0);
-
-	/* Send request message to G64 */
-	cc = send_quick_data (quickptr_req);
-	if (cc) {
-		printf(" <= r03bufv:send_quick_data\n");
-		*coco = EQP_QCKDATERR;
-		return;
+    for (;;) {
+	/* Chain the requests and the replies still wanted */
+	gettimeofday(&da, NULL);  /* get TOD (Unix format) */
+	reqh = reph = NULL;
+	reqt = &reqh;
+	rept = &reph;
+	for (i = 0; i < nel; i++) {
+	    if (!pend[i])
+		continue;
+	    memset(&req[i], 0, sizeof(struct quick_data_buffer));
+	    req[i].bc = UPW(addr[i]); /* BC number */
+	    req[i].rt = LOW(addr[i]); /* RT number */
+	    req[i].pktcnt = 22;       /* sizeof (req_msg) = 24 instead of 22 */
+
+	    /* Initialize request message */
+	    req_ptr = (req_msg *) &(req[i].pkt[0]);
+	    req_ptr->family         = htons(EQP_POW);
+	    req_ptr->type           = TYPE;
+	    req_ptr->sub_family     = SUB_FAMILY;
+	    req_ptr->member         = htons(membno[i]);
+	    req_ptr->protocol_date.sec = htonl(da.tv_sec);
+	    req_ptr->protocol_date.usec = htonl(da.tv_usec);
+	    req_ptr->service        = htons(service);
+	    req_ptr->cycle.machine  = htons(gm_getmachine());
+	    req_ptr->cycle.pls_line = htons(plsline);
+	    req_ptr->specialist     = htons(0);
+	    *reqt = &req[i];
+	    reqt = &req[i].next;
+
+	    memset(&rep[i], 0, sizeof(struct quick_data_buffer));
+	    rep[i].bc = req[i].bc;
+	    rep[i].rt = req[i].rt;
+	    rep[i].pktcnt = pktcnt;
+	    *rept = &rep[i];
+	    rept = &rep[i].next;
 	}
-	my_usleep(40000);
-	memset(quickptr_ctl, 0, sizeof(struct quick_data_buffer));
-	quickptr_ctl->bc = UPW(dtr->address1); /* BC number */
-	quickptr_ctl->rt = LOW(dtr->address1); /* RT number */
-	quickptr_ctl->pktcnt = sizeof(ctrl_msg);
-	quickptr_ctl->next = NULL;
-
-	/* Wait for the reply message */
-	/* Check its OK and retry if its not what we expect */
-
-	cc = get_quick_data(quickptr_ctl);
-	ctrl_ptr = (ctrl_msg *) &(quickptr_ctl->pkt[0]);
-	if ((cc) || (quickptr_ctl->error != 0) || (ntohs(ctrl_ptr->service != 1))) {
-		if (retry_count < RETRIES) {
-			retry_count++;
-			goto retry;
+
+	if (reqh == NULL)
+	    break;            /* all replies came from the cache */
+
+	/* Send all request messages, then wait for and get all replies */
+	cc = send_quick_data(reqh);
+	if (cc) {
+	    printf(" <= readback_vec:send_quick_data\n");
+	    for (i = 0; i < nel; i++) {
+		if (pend[i]) {
+		    rep[i].error = cc;
+		    coco[i] = EQP_QCKDATERR;
+		    pend[i] = 0;
 		}
-		printf(" <= r03bufv:get_quick_data\n");
+	    }
+	    break;
 	}
-    }
-    if (quickptr_ctl->error != 0) {
-	*coco =  c1553toem (quickptr_ctl->error);
-	return;
-    }
+	wait_quick_data(reph);
+	cc = get_quick_data(reph);
+
+	/* Check each reply is OK and retry the ones that are not */
+	npend = 0;
+	for (i = 0; i < nel; i++) {
+	    if (!pend[i])
+		continue;
+	    if (req[i].error)
+		rep[i].error = req[i].error;
+	    else if (cc && (rep[i].error == 0))
+		rep[i].error = cc;
+	    req_ptr = (req_msg *) &(rep[i].pkt[0]);
+	    if ((rep[i].error == 0) && (ntohs(req_ptr->service) == service)) {
+		pend[i] = 0;
+		if (cgen[i] >= 0)
+		    conf_cache_put(addr[i], &rep[i], (unsigned int) cgen[i]);
+	    }
+	    else
+		npend++;
+	}
+	if (npend == 0)
+	    break;
+	if (retry_count >= RETRIES) {
+	    printf(" <= readback_vec:get_quick_data\n");
+	    break;
+	}
+	retry_count++;
+    }
+
+    /* Per element completion */
+    for (i = 0; i < nel; i++) {
+	if (!pend[i])
+	    continue;
+	req_ptr = (req_msg *) &(rep[i].pkt[0]);
+	if (rep[i].error != 0)
+	    coco[i] = c1553toem(rep[i].error);
+	else if (ntohs(req_ptr->service) != service)
+	    coco[i] = EQP_SERVICERR;  /* check if wanted service was delivered */
+    }
+    free(req);
+    free(pend);
+    free(cgen);
+}
 
-    /* check if wanted service was delivered */
-    if (ntohs(ctrl_ptr->service) != 1)
-	    *coco = EQP_SERVICERR;
+/*****************************************************************************
+   subroutine reading back a message from the elements el_arr[1..n] of a
+   block, n = el_arr[0]. Returns the n replies (to be freed by the caller)
+   or NULL if ADDRESS1 could not be read. coco[0] is the overall completion
+   and coco[1..n] the completion of each element, as for eqm_dtr_iv.
+******************************************************************************/
+
+static struct quick_data_buffer *readback_els (int bls_num, int *el_arr, int plsline,
+					       int service, int pktcnt, int *coco)
+{
+    int                         i, nel;
+    int                        *addr;
+    struct quick_data_buffer   *rep;
+    data_array                  data_desc;
+
+    nel = el_arr[0];
+    for (i = 0; i <= nel; i++)
+	coco[i] = 0;
+    addr = (int *) calloc(nel, sizeof(int));
+    rep = (struct quick_data_buffer *) calloc(nel, sizeof(struct quick_data_buffer));
+    if ((addr == NULL) || (rep == NULL)) {
+	coco[0] = EQP_SYS5ERR;
+	goto error_exit;
+    }
+
+    data_desc.data = addr;
+    data_desc.type = EQM_TYP_INT;
+    data_desc.size = nel;
+    eqm_dtr_iv (bls_num, EQP_ADDRESS1, &data_desc, 1, el_arr, nel + 1, 0, coco, nel + 1);
+    if (coco[0] != 0)
+	goto error_exit;
+
+    readback_vec(service, pktcnt, nel, addr, &el_arr[1], plsline, rep, &coco[1]);
+    free(addr);
+    return (rep);
+
+error_exit:
+    free(addr);
+    free(rep);
+    return (NULL);
+}
+
+/*****************************************************************************
+R03BUFV               Reads back control parameters as received by G64  
+*****************************************************************************/
+
+typedef struct {
+    int     address1;       /* RO  BC/ RTI logical address          */
+    int     cnnt;           /* RO  Connection column                */
+} r03bufv_dtr; 
 
+static void r03bufv_values(ctrl_msg *ctrl_ptr, double *value)
+{
     value[0] = (double) ntohs(ctrl_ptr->family);
     value[1] = (double) ctrl_ptr->type;
     value[2] = (double) ctrl_ptr->sub_family;
@@ -647,6 +833,30 @@ retry:  gettimeofday(&da, NULL);  /* get TOD (Unix format) */
     value[19] = (double) ctrl_ptr->ccv3_change;
 }
 
+sproco(r03bufv,r03bufv_dtr,double)
+{
+    struct quick_data_buffer    receive_buf;
+
+    readback_vec(1, sizeof(ctrl_msg), 1, &dtr->address1, &membno, plsline, &receive_buf, coco);
+    if (receive_buf.error == 0)
+	r03bufv_values((ctrl_msg *) &(receive_buf.pkt[0]), value);
+}
+
+/* Vector version: elements el_arr[1..n], n = el_arr[0], 20 values each */
+void r03bufv_vec(int bls_num, int *el_arr, int plsline, double *value, int *coco)
+{
+    int                         i;
+    struct quick_data_buffer   *rep;
+
+    rep = readback_els(bls_num, el_arr, plsline, 1, sizeof(ctrl_msg), coco);
+    if (rep == NULL)
+	return;
+    for (i = 0; i < el_arr[0]; i++)
+	if (rep[i].error == 0)
+	    r03bufv_values((ctrl_msg *) &(rep[i].pkt[0]), &value[i * 20]);
+    free(rep);
+}
+
 /*****************************************************************************
 R03CCSAV              Reads actuation from control protocol             
 *****************************************************************************/
@@ -745,75 +955,8 @@ typedef struct {
     int     cnnt;           /* RO  Connection column        */
 } r03confv_dtr; 
 
-sproco(r03confv,r03confv_dtr,double)
+static void r03confv_values(conf_msg *conf_ptr, double *value)
 {
-    int                         cc, retry_count;
-    struct quick_data_buffer    send_buf;
-    struct quick_data_buffer   *quickptr_req = &send_buf;
-    struct quick_data_buffer    receive_buf;
-    struct quick_data_buffer   *quickptr_ctl = &receive_buf;
-    req_msg                    *req_ptr;
-    conf_msg                   *conf_ptr;
-    struct timeval     da;
-
-    retry_count = 0;
-    {
-retry:  memset(quickptr_req, 0, sizeof(struct quick_data_buffer));
-	quickptr_req->bc = UPW(dtr->address1); /* BC number */
-	quickptr_req->rt = LOW(dtr->address1); /* RT number */
-	quickptr_req->pktcnt = 22;    /* sizeof (req_msg) = 24 instead of 22 */
-	quickptr_req->next = NULL;
-	gettimeofday(&da, NULL);  /* get TOD (Unix format) */
-
-	/* Initialize request message */
-	req_ptr = (req_msg *) &(quickptr_req->pkt[0]);
-	req_ptr->family         = htons(EQP_POW);
-	req_ptr->type           = TYPE;
-	req_ptr->sub_family     = SUB_FAMILY;
-	req_ptr->member         = htons(membno);
-	req_ptr->service        = htons(5);     /* read back ctrl msg */
-	req_ptr->cycle.machine  = htons(gm_getmachine());
-	req_ptr->cycle.pls_line = htons(plsline);
-	req_ptr->protocol_date.sec = htonl(da.tv_sec);
-	req_ptr->protocol_date.usec = htonl(da.tv_usec);
-	req_ptr->specialist     = htons(0);
-
-	/* Send request message to G64 */
-	cc = send_quick_data (quickptr_req);
-	if (cc) {
-		printf(" <= r03confv:send_quick_data\n");
-		*coco = EQP_QCKDATERR;
-		return;
-	}
-	my_usleep(40000);
-	memset(quickptr_ctl, 0, sizeof(struct quick_data_buffer));
-	quickptr_ctl->bc = UPW(dtr->address1); /* BC number */
-	quickptr_ctl->rt = LOW(dtr->address1); /* RT number */
-	quickptr_ctl->pktcnt = sizeof(conf_msg);
-	quickptr_ctl->next = NULL;
-
-	/* Wait for the reply message */
-	/* Check its OK and retry if its not what we expect */
-
-	cc = get_quick_data (quickptr_ctl);
-	conf_ptr = (conf_msg *) &(quickptr_ctl->pkt[0]);
-	if ((cc) || (quickptr_ctl->error != 0) || (htons(conf_ptr->service != 5))) {
-		if (retry_count < RETRIES) {
-			retry_count++;
-			goto retry;
-		}
-		printf(" <= r03confv:get_quick_data\n");
-	}
-    }
-    if (quickptr_ctl->error != 0) {
-	*coco =  c1553toem (quickptr_ctl->error);
-	return;
-    }
-
-    /* check if wanted service was delivered */
-    if (ntohs(conf_ptr->service) != 5)
-	*coco = EQP_SERVICERR;
-
     value[0] = (double) ntohs(conf_ptr->family);
     value[1] = (double) conf_ptr->type;
     value[2] = (double) conf_ptr->sub_family;
@@ -832,6 +975,30 @@ retry:  memset(quickptr_req, 0, sizeof(struct quick_data_buffer));
     value[15] = ntohx(conf_ptr->mode);
 }
 
+sproco(r03confv,r03confv_dtr,double)
+{
+    struct quick_data_buffer    receive_buf;
+
+    readback_vec(5, sizeof(conf_msg), 1, &dtr->address1, &membno, plsline, &receive_buf, coco);
+    if (receive_buf.error == 0)
+	r03confv_values((conf_msg *) &(receive_buf.pkt[0]), value);
+}
+
+/* Vector version: elements el_arr[1..n], n = el_arr[0], 16 values each */
+void r03confv_vec(int bls_num, int *el_arr, int plsline, double *value, int *coco)
+{
+    int                         i;
+    struct quick_data_buffer   *rep;
+
+    rep = readback_els(bls_num, el_arr, plsline, 5, sizeof(conf_msg), coco);
+    if (rep == NULL)
+	return;
+    for (i = 0; i < el_arr[0]; i++)
+	if (rep[i].error == 0)
+	    r03confv_values((conf_msg *) &(rep[i].pkt[0]), &value[i * 16]);
+    free(rep);
+}
+
 /*****************************************************************************
 R03DATEV              Reads date in LynxOS encoded form                 
 *****************************************************************************/
@@ -1004,6 +1004,7 @@ int cc;
 int GetBcInfo(int arg) {     /* Get BC info */
 
 struct mil1553_dev_info_s dev_info;
+struct mil1553_bc_stats_s stats;
 unsigned int wc, cc, tr, tmo;
 float temp, ftmo;
 
@@ -1051,6 +1052,15 @@ float temp, ftmo;
    printf("Word count errors:%d\n",dev_info.wc_errors);
    printf("Tx clash errors  :%d\n",dev_info.tx_clash_errors);
    printf("Tx count         :%d\n",dev_info.tx_count);
+   stats.bc = bc;
+   if (milib_get_bc_stats(milf,&stats) == 0) {
+      printf("TxBuf MMIO saved :%d\n",stats.tx_mmio_saved);
+      printf("Shared reads     :%d in flight, %d recent\n",
+	     stats.rd_attach_hits,stats.rd_fresh_hits);
+      printf("Broadcast frames :%d\n",stats.bcast_frames);
+      printf("Sync frames      :%d\n",stats.sync_frames);
+      printf("Sync skew max ns :%d\n",stats.sync_skew_max_ns);
+   }
    printf("Interrupt count  :%d\n",dev_info.icnt);
    printf("Tx = Rx + timeouts = ints?  : %d = %d = %d ... %s\n",
 		dev_info.tx_frames,
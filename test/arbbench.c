@@ -0,0 +1,108 @@
+/**
+ * Many client throughput, direct driver handles against the bus arbiter
+ *
+ * arbbench [-c clients] [-n reads] [-b bc] [-r rti] [-a]
+ *
+ * Each client is a process reading the CSR of bc/rti n times, on its own
+ * /dev/mil1553 handle or, with -a, through mil1553arbd.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <mil1553.h>
+#include <librti.h>
+#include <libarbiter.h>
+
+static char git_version[] __attribute__((used)) = GIT_VERSION;
+
+#define MIL1553_DEV_PATH "/dev/mil1553"
+
+static int client(int arbiter, int reads, int bc, int rti) {
+
+	unsigned short csr, str;
+	int i, fn, errs = 0;
+
+	if (arbiter)
+		fn = arb_attach(0);
+	else
+		fn = open(MIL1553_DEV_PATH, O_RDWR, 0);
+	if (fn < 0) {
+		perror("arbbench: client");
+		return 255;
+	}
+	for (i=0; i<reads; i++)
+		if (rtilib_read_csr(fn, bc, rti, &csr, &str))
+			errs++;
+	if (arbiter)
+		arb_detach(fn);
+	else
+		close(fn);
+	return errs > 254 ? 254 : errs;
+}
+
+int main(int argc, char *argv[]) {
+
+	struct arb_stats_s before, after;
+	uint64_t t0, t1;
+	int i, st, fn = -1, errs = 0;
+	int clients = 8, reads = 1000, bc = 1, rti = 1, arbiter = 0;
+	double secs;
+
+	for (i=1; i<argc; i++) {
+		if ((strcmp(argv[i], "-c") == 0) && (i+1 < argc))
+			clients = atoi(argv[++i]);
+		else if ((strcmp(argv[i], "-n") == 0) && (i+1 < argc))
+			reads = atoi(argv[++i]);
+		else if ((strcmp(argv[i], "-b") == 0) && (i+1 < argc))
+			bc = atoi(argv[++i]);
+		else if ((strcmp(argv[i], "-r") == 0) && (i+1 < argc))
+			rti = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-a") == 0)
+			arbiter = 1;
+		else {
+			fprintf(stderr, "usage: %s [-c clients] [-n reads] [-b bc] [-r rti] [-a]\n", argv[0]);
+			exit(1);
+		}
+	}
+
+	memset(&before, 0, sizeof(before));
+	if (arbiter) {
+		if ((fn = arb_attach(0)) < 0) {
+			perror("arbbench: arb_attach");
+			exit(1);
+		}
+		arb_get_stats(fn, &before);
+	}
+
+	t0 = arb_now_us();
+	for (i=0; i<clients; i++) {
+		if (fork() == 0)
+			exit(client(arbiter, reads, bc, rti));
+	}
+	for (i=0; i<clients; i++) {
+		if (wait(&st) > 0 && WIFEXITED(st))
+			errs += WEXITSTATUS(st);
+	}
+	t1 = arb_now_us();
+	secs = (t1 - t0) / 1e6;
+
+	printf("arbbench: %s %d clients x %d reads bc:%d rti:%d\n",
+	       arbiter ? "arbiter" : "direct", clients, reads, bc, rti);
+	printf("  %.3f s, %.0f reads/s, %d errors\n",
+	       secs, secs > 0 ? clients * reads / secs : 0.0, errs);
+	if (arbiter) {
+		arb_get_stats(fn, &after);
+		printf("  frames:%u coalesced:%u deferred:%u\n",
+		       after.frames - before.frames,
+		       after.coalesced - before.coalesced,
+		       after.deferred - before.deferred);
+		arb_detach(fn);
+	}
+	return 0;
+}
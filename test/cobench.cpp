@@ -0,0 +1,142 @@
+/**
+ * Overlapped CSR reads, one thread per BC against coroutines on one thread
+ *
+ * cobench [-b bcs] [-r rtis] [-n reads] [-t]
+ *
+ * Reads the CSR of RTIs 1..rtis on BCs 1..bcs, n times each. By default
+ * one coroutine per RTI on one libmil1553co bus, with -t one thread per
+ * BC doing blocking rtilib_read_csr calls on its own driver handle.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <libmil1553co.hpp>
+
+static char git_version[] __attribute__((used)) = GIT_VERSION;
+
+#define MIL1553_DEV_PATH "/dev/mil1553"
+#define MAX_BCS 31
+
+static int bcs = 1, rtis = 1, reads = 1000;
+
+static double now_s(void) {
+
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* ===================================== */
+
+static int thread_errs[MAX_BCS + 1];
+
+static void *bc_thread(void *arg) {
+
+	long bc = (long) arg;
+	unsigned short csr, str;
+	int i, rti, fn;
+
+	fn = open(MIL1553_DEV_PATH, O_RDWR, 0);
+	if (fn < 0) {
+		thread_errs[bc] = reads * rtis;
+		return NULL;
+	}
+	for (i=0; i<reads; i++)
+		for (rti=1; rti<=rtis; rti++)
+			if (rtilib_read_csr(fn, bc, rti, &csr, &str))
+				thread_errs[bc]++;
+	close(fn);
+	return NULL;
+}
+
+static int run_threads(void) {
+
+	pthread_t th[MAX_BCS + 1];
+	long bc;
+	int errs = 0;
+
+	for (bc=1; bc<=bcs; bc++)
+		pthread_create(&th[bc], NULL, bc_thread, (void *) bc);
+	for (bc=1; bc<=bcs; bc++) {
+		pthread_join(th[bc], NULL);
+		errs += thread_errs[bc];
+	}
+	return errs;
+}
+
+/* ===================================== */
+
+static int co_errs;
+
+static mil1553co::task<> rti_reader(mil1553co::bus &bus, int bc, int rti) {
+
+	for (int i=0; i<reads; i++) {
+		mil1553co::csr_reply r = co_await bus.read_csr(bc, rti);
+		if (r.cc)
+			co_errs++;
+	}
+}
+
+static int run_coroutines(void) {
+
+	mil1553co::bus bus(MIL1553_DEV_PATH);
+	int bc, rti, cc;
+
+	if (bus.error()) {
+		errno = bus.error();
+		perror("cobench: bus");
+		return reads * rtis * bcs;
+	}
+	for (bc=1; bc<=bcs; bc++)
+		for (rti=1; rti<=rtis; rti++)
+			bus.spawn(rti_reader(bus, bc, rti));
+	cc = bus.run();
+	if (cc)
+		fprintf(stderr, "cobench: run: %s\n", strerror(cc));
+	return co_errs;
+}
+
+/* ===================================== */
+
+int main(int argc, char *argv[]) {
+
+	int i, errs, threads = 0;
+	double t0, secs;
+
+	for (i=1; i<argc; i++) {
+		if ((strcmp(argv[i], "-b") == 0) && (i+1 < argc))
+			bcs = atoi(argv[++i]);
+		else if ((strcmp(argv[i], "-r") == 0) && (i+1 < argc))
+			rtis = atoi(argv[++i]);
+		else if ((strcmp(argv[i], "-n") == 0) && (i+1 < argc))
+			reads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-t") == 0)
+			threads = 1;
+		else {
+			fprintf(stderr, "usage: %s [-b bcs] [-r rtis] [-n reads] [-t]\n", argv[0]);
+			exit(1);
+		}
+	}
+	if ((bcs < 1) || (bcs > MAX_BCS) || (rtis < 1) || (rtis > 30)) {
+		fprintf(stderr, "cobench: bcs 1..%d, rtis 1..30\n", MAX_BCS);
+		exit(1);
+	}
+
+	t0 = now_s();
+	errs = threads ? run_threads() : run_coroutines();
+	secs = now_s() - t0;
+
+	printf("cobench: %s %d bcs x %d rtis x %d reads\n",
+	       threads ? "threads" : "coroutines", bcs, rtis, reads);
+	printf("  %.3f s, %.0f reads/s, %d errors\n",
+	       secs, secs > 0 ? bcs * rtis * reads / secs : 0.0, errs);
+	return 0;
+}
@@ -0,0 +1,425 @@
+/**
+ * mil1553 bus arbiter daemon, see lib/libarbiter.h
+ *
+ * Owns /dev/mil1553 and executes the frames local clients post in their
+ * shared memory rings. Clients are served by priority then in order of
+ * submission, BC locks are kept here so a locked BC only sees frames
+ * from its owner. Identical register reads are answered from one frame.
+ *
+ * mil1553arbd [-w window_us] [-p rt_priority] [-v]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <mil1553.h>
+#include <librti.h>
+#include <libarbiter.h>
+
+static char git_version[] __attribute__((used)) = GIT_VERSION;
+
+#define MIL1553_DEV_PATH "/dev/mil1553"
+#define ARB_WAIT_MS 100
+#define PENDING (ARB_CLIENTS * ARB_RING)
+#define RECENT 64
+
+struct pend_s {
+	int slot;
+	int pid;                      /** Owner when submitted */
+	int done;
+	struct arb_req_s req;
+};
+
+struct recent_s {
+	int valid;
+	uint16_t bc, rti, sa, wc;
+	uint64_t t_start;             /** When the frame started */
+	uint16_t rxbuf[ARB_WORDS+1];
+};
+
+static struct arb_shm_s *shm;
+static int fd;
+static int verbose = 0;
+static volatile int stop_flg = 0;
+static volatile int dump_flg = 0;
+
+static struct pend_s pend[PENDING];
+static int npend = 0;
+static int bc_owner[32];              /** Slot + 1 holding the BC lock */
+static int bc_owner_pid[32];
+static struct recent_s recent[RECENT];
+
+/* ===================================== */
+
+static void on_signal(int sig) {
+
+	if (sig == SIGUSR1)
+		dump_flg = 1;
+	else
+		stop_flg = 1;
+}
+
+static void dump_stats(void) {
+
+	struct arb_client_s *c;
+	int i;
+
+	printf("mil1553arbd: requests:%u frames:%u coalesced:%u deferred:%u sweeps:%u clients:%u\n",
+	       shm->stats.requests, shm->stats.frames, shm->stats.coalesced,
+	       shm->stats.deferred, shm->stats.sweeps, shm->stats.clients);
+	for (i=0; i<ARB_CLIENTS; i++) {
+		c = &shm->client[i];
+		if (c->pid)
+			printf("  slot:%02d pid:%d prio:%d requests:%u coalesced:%u\n",
+			       i, c->pid, c->prio, c->requests, c->coalesced);
+	}
+	fflush(stdout);
+}
+
+/* ===================================== */
+
+/**
+ * Free the slots of dead processes and the BC locks they held
+ */
+
+static void reap(void) {
+
+	struct arb_client_s *c;
+	int i, pid, bc, n = 0;
+
+	for (i=0; i<ARB_CLIENTS; i++) {
+		c = &shm->client[i];
+		pid = c->pid;
+		if (pid && (kill(pid, 0) < 0) && (errno == ESRCH)) {
+			if (verbose)
+				printf("mil1553arbd: slot %d pid %d gone\n", i, pid);
+			__sync_bool_compare_and_swap(&c->pid, pid, 0);
+			pid = 0;
+		}
+		if (pid)
+			n++;
+	}
+	shm->stats.clients = n;
+
+	for (bc=0; bc<32; bc++) {
+		if (bc_owner[bc]
+		&&  (shm->client[bc_owner[bc] - 1].pid != bc_owner_pid[bc]))
+			bc_owner[bc] = 0;
+	}
+	for (i=0; i<npend; i++)
+		if (shm->client[pend[i].slot].pid != pend[i].pid)
+			pend[i].done = 1;
+}
+
+/**
+ * Move the submitted requests to the pending list, never more than the
+ * completion ring of their client can take.
+ */
+
+static void collect(void) {
+
+	struct arb_client_s *c;
+	struct arb_ring_s *r;
+	uint32_t head;
+	int i;
+
+	for (i=0; i<ARB_CLIENTS; i++) {
+		c = &shm->client[i];
+		if (!c->pid)
+			continue;
+		r = &c->ring;
+		while (((head = r->sq_head) != r->sq_tail)
+		&&     (head - r->cq_head < ARB_RING)
+		&&     (npend < PENDING)) {
+			__sync_synchronize();
+			pend[npend].slot = i;
+			pend[npend].pid  = c->pid;
+			pend[npend].done = 0;
+			memcpy(&pend[npend].req, &r->sq[head & (ARB_RING - 1)], sizeof(struct arb_req_s));
+			npend++;
+			r->sq_head = head + 1;
+		}
+	}
+}
+
+static int by_policy(const void *a, const void *b) {
+
+	const struct pend_s *pa = a, *pb = b;
+	int prioa = shm->client[pa->slot].prio;
+	int priob = shm->client[pb->slot].prio;
+
+	if (prioa != priob)
+		return priob - prioa;
+	return (pa->req.ticket < pb->req.ticket) ? -1 : (pa->req.ticket > pb->req.ticket);
+}
+
+static void complete(struct pend_s *p, int cc, uint16_t *rxbuf, int coalesced) {
+
+	struct arb_client_s *c = &shm->client[p->slot];
+	struct arb_ring_s *r = &c->ring;
+	struct arb_cpl_s *cpl;
+	uint32_t tail;
+
+	p->done = 1;
+	if (c->pid != p->pid)
+		return;
+	tail = r->cq_tail;
+	cpl = &r->cq[tail & (ARB_RING - 1)];
+	cpl->seq = p->req.seq;
+	cpl->cc  = cc;
+	cpl->coalesced = coalesced;
+	if (rxbuf)
+		memcpy(cpl->rxbuf, rxbuf, sizeof(cpl->rxbuf));
+	__sync_synchronize();
+	r->cq_tail = tail + 1;
+	arb_futex_wake(&r->cq_tail);
+
+	c->requests++;
+	shm->stats.requests++;
+	if (coalesced) {
+		c->coalesced++;
+		shm->stats.coalesced++;
+	}
+}
+
+/* ===================================== */
+
+/**
+ * Only reads that leave the RTI as it was, as the driver shares them:
+ * the CSR, the signature and the status word. TXBUF/RXBUF reads move
+ * the buffer pointer, two of them read different words.
+ */
+
+static int coalescable(struct arb_req_s *req) {
+
+	if ((req->tr != TR_READ) || !req->reply)
+		return 0;
+	return (req->sa == SA_CSR) || (req->sa == SA_SIGNATURE)
+	||     (((req->sa == 0) || (req->sa == SA_MODE)) && (req->wc == MODE_READ_STR));
+}
+
+static struct recent_s *recent_slot(struct arb_req_s *req) {
+
+	return &recent[(req->bc * 31 + req->rti * 7 + req->sa * 3 + req->wc) % RECENT];
+}
+
+static struct recent_s *recent_hit(struct arb_req_s *req) {
+
+	struct recent_s *rc = recent_slot(req);
+
+	if (rc->valid
+	&&  (rc->bc == req->bc) && (rc->rti == req->rti)
+	&&  (rc->sa == req->sa) && (rc->wc == req->wc)
+	&&  (req->t_submit <= rc->t_start + shm->window_us))
+		return rc;
+	return NULL;
+}
+
+/**
+ * Anything else sent to an RTI may change what it reads back, a broadcast
+ * reaches all of them
+ */
+
+static void recent_forget(int bc, int rti) {
+
+	int i;
+
+	for (i=0; i<RECENT; i++)
+		if (recent[i].valid && (recent[i].bc == bc) && ((recent[i].rti == rti) || (rti == RTI_BROADCAST)))
+			recent[i].valid = 0;
+}
+
+static void xfer(struct pend_s *p) {
+
+	struct arb_req_s *req = &p->req;
+	struct recent_s *rc;
+	uint16_t rxbuf[ARB_WORDS+1];
+	uint64_t t_start;
+	int cc;
+
+	if (coalescable(req)) {
+		if ((rc = recent_hit(req))) {
+			complete(p, 0, rc->rxbuf, 1);
+			return;
+		}
+	} else
+		recent_forget(req->bc, req->rti);
+
+	memset(rxbuf, 0, sizeof(rxbuf));
+	t_start = arb_now_us();
+	cc = rtilib_send_receive(fd, req->bc, req->rti, req->wc, req->sa, req->tr,
+				 req->reply ? REPLY : NO_REPLY, rxbuf, req->txbuf);
+	shm->stats.frames++;
+
+	if (coalescable(req) && (cc == 0)) {
+		rc = recent_slot(req);
+		rc->valid = 1;
+		rc->bc  = req->bc;
+		rc->rti = req->rti;
+		rc->sa  = req->sa;
+		rc->wc  = req->wc;
+		rc->t_start = t_start;
+		memcpy(rc->rxbuf, rxbuf, sizeof(rxbuf));
+	}
+	complete(p, cc, rxbuf, 0);
+}
+
+/**
+ * One pass over the pending list in policy order. A client whose
+ * request must wait for a BC lock is skipped until the next pass so
+ * that its requests stay in order.
+ * Returns the number of requests completed.
+ */
+
+static int serve(void) {
+
+	char blocked[ARB_CLIENTS];
+	struct pend_s *p;
+	int i, j, bc, owner, done = 0;
+
+	memset(blocked, 0, sizeof(blocked));
+	qsort(pend, npend, sizeof(struct pend_s), by_policy);
+
+	for (i=0; i<npend; i++) {
+		p = &pend[i];
+		if (p->done || blocked[p->slot])
+			continue;
+		bc = p->req.bc & 31;
+		owner = bc_owner[bc];
+		if (owner && (owner != p->slot + 1)) {
+			blocked[p->slot] = 1;
+			shm->stats.deferred++;
+			continue;
+		}
+		switch (p->req.op) {
+			case ARB_LOCK_BC:
+				bc_owner[bc] = p->slot + 1;
+				bc_owner_pid[bc] = p->pid;
+				complete(p, 0, NULL, 0);
+			break;
+
+			case ARB_UNLOCK_BC:
+				bc_owner[bc] = 0;
+				complete(p, 0, NULL, 0);
+			break;
+
+			case ARB_XFER:
+				xfer(p);
+			break;
+
+			default:
+				complete(p, EINVAL, NULL, 0);
+		}
+		done++;
+	}
+
+	for (i=0, j=0; i<npend; i++)
+		if (!pend[i].done)
+			pend[j++] = pend[i];
+	npend = j;
+	return done;
+}
+
+/* ===================================== */
+
+static int create_shm(int window_us) {
+
+	int sfd;
+
+	shm_unlink(ARB_SHM_NAME);
+	sfd = shm_open(ARB_SHM_NAME, O_RDWR | O_CREAT | O_EXCL, 0666);
+	if (sfd < 0) {
+		perror("mil1553arbd: shm_open");
+		return -1;
+	}
+	fchmod(sfd, 0666);
+	if (ftruncate(sfd, sizeof(struct arb_shm_s)) < 0) {
+		perror("mil1553arbd: ftruncate");
+		return -1;
+	}
+	shm = mmap(NULL, sizeof(struct arb_shm_s), PROT_READ | PROT_WRITE, MAP_SHARED, sfd, 0);
+	if (shm == MAP_FAILED) {
+		perror("mil1553arbd: mmap");
+		return -1;
+	}
+	close(sfd);
+
+	memset(shm, 0, sizeof(struct arb_shm_s));
+	shm->window_us = window_us;
+	shm->version   = ARB_VERSION;
+	shm->daemon_pid = getpid();
+	__sync_synchronize();
+	shm->magic = ARB_MAGIC;
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+
+	struct sched_param param;
+	struct sigaction sa;
+	uint32_t bell;
+	int i, window_us = 0, rt_prio = 0;
+
+	for (i=1; i<argc; i++) {
+		if ((strcmp(argv[i], "-w") == 0) && (i+1 < argc))
+			window_us = atoi(argv[++i]);
+		else if ((strcmp(argv[i], "-p") == 0) && (i+1 < argc))
+			rt_prio = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-v") == 0)
+			verbose = 1;
+		else {
+			fprintf(stderr, "usage: %s [-w window_us] [-p rt_priority] [-v]\n", argv[0]);
+			exit(1);
+		}
+	}
+
+	fd = open(MIL1553_DEV_PATH, O_RDWR, 0);
+	if (fd < 0) {
+		perror("mil1553arbd: " MIL1553_DEV_PATH);
+		exit(1);
+	}
+	if (rt_prio) {
+		param.sched_priority = rt_prio;
+		if (sched_setscheduler(0, SCHED_FIFO, &param) < 0)
+			perror("mil1553arbd: sched_setscheduler");
+	}
+	if (create_shm(window_us) < 0)
+		exit(1);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGUSR1, &sa, NULL);
+
+	printf("mil1553arbd: %s running, window %dus\n", git_version, window_us);
+	fflush(stdout);
+
+	while (!stop_flg) {
+		bell = shm->doorbell;
+		collect();
+		shm->stats.sweeps++;
+		if (npend && serve())
+			continue;
+		reap();
+		if (dump_flg) {
+			dump_flg = 0;
+			dump_stats();
+		}
+		arb_futex_wait(&shm->doorbell, bell, ARB_WAIT_MS);
+	}
+
+	shm->daemon_pid = 0;
+	dump_stats();
+	shm_unlink(ARB_SHM_NAME);
+	close(fd);
+	return 0;
+}
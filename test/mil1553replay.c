@@ -0,0 +1,385 @@
+/**
+ * Print or replay a librti bus capture
+ *
+ * mil1553replay [-p] [-a] [-w] [-v] [-x scale] [-g max_gap_us] file
+ *
+ * file is written by rtilib_capture_start or with MIL1553_CAPTURE set.
+ * With -p the frames are printed. Otherwise they are sent again in the
+ * same order, batches and synchronous starts as such, on /dev/mil1553
+ * or, with -a, through mil1553arbd. Each reply is compared with the
+ * recorded one. Timing is the recorded one scaled by -x, 0 sends back
+ * to back, and -g caps the idle time between frames. Frames that change
+ * RTI state (writes, broadcasts, mode commands, TXBUF and RXBUF reads,
+ * which move the buffer pointer) are only sent with -w.
+ * Records a thread was still writing when the capture ended are left
+ * out.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <mil1553.h>
+#include <librti.h>
+#include <libarbiter.h>
+
+static char git_version[] __attribute__((used)) = GIT_VERSION;
+
+#define MIL1553_DEV_PATH "/dev/mil1553"
+#define GROUP_MAX 64
+
+static struct rti_capture_hdr_s *hdr;
+static struct rti_capture_rec_s *recs;
+
+static int writes = 0, verbose = 0;
+
+static unsigned long frames, skipped, unfinished, status_diffs, data_diffs;
+static double rec_ns, rep_ns;
+
+static unsigned long long now_ns(void) {
+
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct rti_capture_rec_s *rec_at(unsigned long long seq) {
+
+	return &recs[seq % hdr->frames];
+}
+
+/* A record is whole once its seq is its number plus one */
+
+static int rec_done(unsigned long long seq) {
+
+	return rec_at(seq)->seq == seq + 1;
+}
+
+/* ===================================== */
+
+static int load(char *path) {
+
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(path, O_RDONLY, 0);
+	if (fd < 0) {
+		perror("mil1553replay: open");
+		return errno;
+	}
+	if (fstat(fd, &st) < 0) {
+		perror("mil1553replay: stat");
+		close(fd);
+		return errno;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror("mil1553replay: mmap");
+		return errno;
+	}
+
+	hdr  = map;
+	recs = (struct rti_capture_rec_s *) (hdr + 1);
+	if ((st.st_size < sizeof(*hdr))
+	||  (hdr->magic != RTI_CAPTURE_MAGIC)
+	||  (hdr->version != RTI_CAPTURE_VERSION)
+	||  (hdr->rec_size != sizeof(*recs))
+	||  (hdr->frames == 0)
+	||  (st.st_size < sizeof(*hdr) + (off_t) hdr->frames * sizeof(*recs))) {
+		fprintf(stderr, "mil1553replay: %s: not a version %d capture\n",
+			path, RTI_CAPTURE_VERSION);
+		return EINVAL;
+	}
+	return 0;
+}
+
+/* ===================================== */
+
+static void decode(struct rti_capture_rec_s *rec, int *rti, int *wc, int *sa, int *tr) {
+
+	*rti = (rec->txreg & TXREG_RTI_MASK) >> TXREG_RTI_SHIFT;
+	*wc  = (rec->txreg & TXREG_WC_MASK) >> TXREG_WC_SHIFT;
+	*sa  = (rec->txreg & TXREG_SUBA_MASK) >> TXREG_SUBA_SHIFT;
+	*tr  = (rec->txreg & TXREG_TR_MASK) >> TXREG_TR_SHIFT;
+	if ((*wc == 0) && (*sa != 0) && (*sa != SA_MODE))
+		*wc = TX_BUF_SIZE;
+}
+
+/* Register reads leave the RTI as it was, anything else needs -w. */
+/* A TXBUF or RXBUF read moves the buffer pointer. */
+
+static int changes_rti(struct rti_capture_rec_s *rec) {
+
+	int rti, wc, sa, tr;
+
+	decode(rec, &rti, &wc, &sa, &tr);
+	if ((tr == TR_WRITE) || (rti == RTI_BROADCAST))
+		return 1;
+	if ((sa == 0) || (sa == SA_MODE))
+		return (wc != MODE_READ_STR) && (wc != MODE_READ_LAST_STR)
+		    && (wc != MODE_READ_LAST_CMD);
+	return (sa == SA_TXBUF) || (sa == SA_RXBUF);
+}
+
+static void print_rec(unsigned long long seq, struct rti_capture_rec_s *rec) {
+
+	int i, rti, wc, sa, tr;
+
+	decode(rec, &rti, &wc, &sa, &tr);
+	printf("%8llu %12.3f us bc:%02d rti:%02d sa:%02d wc:%02d %s%s%s st:%d %8.3f us",
+	       seq, (rec->ts_ns - hdr->t0_ns) / 1e3, rec->bc, rti, sa, wc,
+	       tr ? "T" : "R",
+	       (rec->flags & CAP_BATCH) ? " batch" : "",
+	       (rec->flags & CAP_SYNC) ? " sync" : "",
+	       rec->status, rec->latency_ns / 1e3);
+	if (rec->rx_wc)
+		printf(" str:%s", rtilib_str_to_str(rec->rxbuf[0]));
+	printf("\n");
+	if (verbose) {
+		for (i=0; i<rec->tx_wc; i++)
+			printf("%s%04X", i ? " " : "   tx ", rec->txbuf[i]);
+		if (rec->tx_wc)
+			printf("\n");
+		for (i=0; i<rec->rx_wc; i++)
+			printf("%s%04X", i ? " " : "   rx ", rec->rxbuf[i]);
+		if (rec->rx_wc)
+			printf("\n");
+	}
+}
+
+/* ===================================== */
+
+static void compare(unsigned long long seq, struct rti_capture_rec_s *rec,
+		    int status, unsigned short *rxbuf, int rx_wc) {
+
+	int i;
+
+	frames++;
+	if (status != rec->status) {
+		status_diffs++;
+		if (verbose)
+			printf("mil1553replay: %llu: status %d was %d\n", seq, status, rec->status);
+		return;
+	}
+	if (status || !(rec->flags & CAP_REPLY))
+		return;
+	if (rx_wc > rec->rx_wc)
+		rx_wc = rec->rx_wc;
+	for (i=0; i<rx_wc; i++)
+		if (rxbuf[i] != rec->rxbuf[i])
+			break;
+	if ((i < rx_wc) || (rx_wc != rec->rx_wc)) {
+		data_diffs++;
+		if (verbose) {
+			printf("mil1553replay: %llu: reply differs, was\n", seq);
+			print_rec(seq, rec);
+		}
+	}
+}
+
+static void replay_one(int fn, unsigned long long seq, struct rti_capture_rec_s *rec) {
+
+	unsigned short rxbuf[RX_BUF_SIZE];
+	unsigned long long t0;
+	int rti, wc, sa, tr, cc;
+
+	decode(rec, &rti, &wc, &sa, &tr);
+	memset(rxbuf, 0, sizeof(rxbuf));
+	t0 = now_ns();
+	cc = rtilib_send_cmd(fn, rec->bc, rti, rec->txreg & ~TXREG_RTI_MASK,
+			     (rec->flags & CAP_REPLY) ? REPLY : NO_REPLY,
+			     rxbuf, rec->txbuf);
+	rep_ns += now_ns() - t0;
+	rec_ns += rec->latency_ns;
+	compare(seq, rec, cc, rxbuf, rec->rx_wc);
+}
+
+/* Frames of one MIL1553_SEND or SYNC_SEND go out together again */
+
+static void replay_group(int fn, unsigned long long seq, int n) {
+
+	struct mil1553_tx_item_s items[GROUP_MAX];
+	struct mil1553_rti_interrupt_s ends[GROUP_MAX];
+	struct rti_capture_rec_s *rec;
+	unsigned long long t0;
+	unsigned long long latency = 0;
+	int i, rti, wc, sa, tr;
+
+	memset(items, 0, sizeof(items));
+	memset(ends, 0, sizeof(ends));
+	for (i=0; i<n; i++) {
+		rec = rec_at(seq + i);
+		decode(rec, &rti, &wc, &sa, &tr);
+		items[i].bc         = rec->bc;
+		items[i].rti_number = rti;
+		items[i].txreg      = rec->txreg;
+		items[i].no_reply   = !(rec->flags & CAP_REPLY);
+		memcpy(items[i].txbuf, rec->txbuf, sizeof(unsigned short) * rec->tx_wc);
+		if (rec->latency_ns > latency)
+			latency = rec->latency_ns;
+	}
+
+	t0 = now_ns();
+	if (rec_at(seq)->flags & CAP_SYNC)
+		rtilib_send_sync(fn, items, n, ends, NULL);
+	else
+		rtilib_send_batch(fn, items, n, ends);
+	rep_ns += now_ns() - t0;
+	rec_ns += latency;
+
+	for (i=0; i<n; i++) {
+		rec = rec_at(seq + i);
+		if (items[i].no_reply)
+			frames++;
+		else
+			compare(seq + i, rec, ends[i].status, ends[i].rxbuf, ends[i].wc);
+	}
+}
+
+/* ===================================== */
+
+static int replay(int fn, double scale, unsigned long long max_gap_ns) {
+
+	struct rti_capture_rec_s *rec, *nxt;
+	unsigned long long seq, first, gap, prev_ts, start, target;
+	struct timespec ts;
+	int i, n, kind, change;
+
+	first = (hdr->head > hdr->frames) ? hdr->head - hdr->frames : 0;
+	start = now_ns();
+	target = 0;
+	prev_ts = rec_at(first)->ts_ns;
+
+	for (seq=first; seq<hdr->head; seq+=n) {
+		rec = rec_at(seq);
+		n = 1;
+		if (!rec_done(seq)) {
+			unfinished++;
+			continue;
+		}
+
+		/* A group is the following records of the same start */
+
+		change = changes_rti(rec);
+		kind = rec->flags & (CAP_BATCH | CAP_SYNC);
+		if (kind) {
+			while ((seq + n < hdr->head) && (n < GROUP_MAX) && rec_done(seq + n)) {
+				nxt = rec_at(seq + n);
+				if ((nxt->ts_ns != rec->ts_ns)
+				||  ((nxt->flags & (CAP_BATCH | CAP_SYNC)) != kind))
+					break;
+				change |= changes_rti(nxt);
+				n++;
+			}
+		}
+		if (change && !writes) {
+			skipped += n;
+			continue;
+		}
+
+		gap = (rec->ts_ns > prev_ts) ? rec->ts_ns - prev_ts : 0;
+		if (max_gap_ns && (gap > max_gap_ns))
+			gap = max_gap_ns;
+		prev_ts = rec->ts_ns;
+		target += gap * scale;
+		if (scale > 0) {
+			ts.tv_sec  = (start + target) / 1000000000ULL;
+			ts.tv_nsec = (start + target) % 1000000000ULL;
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+		}
+
+		if (!kind)
+			replay_one(fn, seq, rec);
+		else
+			replay_group(fn, seq, n);
+		for (i=0; i<n; i++)
+			if (verbose > 1)
+				print_rec(seq + i, rec_at(seq + i));
+	}
+	return 0;
+}
+
+/* ===================================== */
+
+int main(int argc, char *argv[]) {
+
+	unsigned long long seq, first, max_gap_ns = 0;
+	double scale = 1.0, secs, t0;
+	int i, fn, print = 0, arbiter = 0;
+	time_t start;
+	char *path = NULL;
+
+	for (i=1; i<argc; i++) {
+		if (strcmp(argv[i], "-p") == 0)
+			print = 1;
+		else if (strcmp(argv[i], "-a") == 0)
+			arbiter = 1;
+		else if (strcmp(argv[i], "-w") == 0)
+			writes = 1;
+		else if (strcmp(argv[i], "-v") == 0)
+			verbose++;
+		else if ((strcmp(argv[i], "-x") == 0) && (i+1 < argc))
+			scale = atof(argv[++i]);
+		else if ((strcmp(argv[i], "-g") == 0) && (i+1 < argc))
+			max_gap_ns = atoll(argv[++i]) * 1000ULL;
+		else if ((argv[i][0] != '-') && !path)
+			path = argv[i];
+		else {
+			path = NULL;
+			break;
+		}
+	}
+	if (!path || (scale < 0)) {
+		fprintf(stderr, "usage: %s [-p] [-a] [-w] [-v] [-x scale] [-g max_gap_us] file\n", argv[0]);
+		exit(1);
+	}
+	if (load(path))
+		exit(1);
+
+	first = (hdr->head > hdr->frames) ? hdr->head - hdr->frames : 0;
+	start = hdr->start_sec;
+	printf("mil1553replay: %s pid %u, %llu frames from %llu, started %s",
+	       path, hdr->pid, hdr->head - first, first, ctime(&start));
+	if (print) {
+		for (seq=first; seq<hdr->head; seq++) {
+			if (rec_done(seq))
+				print_rec(seq, rec_at(seq));
+			else
+				printf("%8llu unfinished\n", seq);
+		}
+		exit(0);
+	}
+
+	if (arbiter)
+		fn = arb_attach(0);
+	else
+		fn = open(MIL1553_DEV_PATH, O_RDWR, 0);
+	if (fn < 0) {
+		perror("mil1553replay: driver");
+		exit(1);
+	}
+
+	t0 = now_ns() / 1e9;
+	replay(fn, scale, max_gap_ns);
+	secs = now_ns() / 1e9 - t0;
+
+	if (arbiter)
+		arb_detach(fn);
+	else
+		close(fn);
+
+	printf("mil1553replay: %lu frames in %.3f s, %lu skipped without -w, %lu unfinished\n",
+	       frames, secs, skipped, unfinished);
+	printf("  %lu status and %lu reply differences\n", status_diffs, data_diffs);
+	printf("  frame time %.3f s recorded, %.3f s replayed\n", rec_ns / 1e9, rep_ns / 1e9);
+	return (status_diffs || data_diffs) ? 2 : 0;
+}
@@ -0,0 +1,282 @@
+/**
+ * Simulated bus for test programs, see rtisim.h
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include <mil1553.h>
+#include <librti.h>
+
+#include "rtisim.h"
+
+struct sim_rti_s sim_rti[SIM_BCS][32];
+
+unsigned long sim_frames = 0;
+unsigned long sim_bcasts = 0;
+int sim_late = 0;
+
+static unsigned int up_rtis[SIM_BCS];  /* As the driver last saw them */
+
+#define SIM_EVENTS 256
+
+static struct mil1553_rti_interrupt_s events[SIM_EVENTS];
+static int evt_rp = 0, evt_wp = 0, evt_late = 0;
+
+int sim_open(void) {
+
+	return open("/dev/null", O_RDWR, 0);
+}
+
+void sim_reset(void) {
+
+	memset(sim_rti, 0, sizeof(sim_rti));
+	sim_frames = sim_bcasts = 0;
+	sim_late = 0;
+	memset(up_rtis, 0, sizeof(up_rtis));
+	evt_rp = evt_wp = evt_late = 0;
+}
+
+/* ===================================== */
+
+static void write_csr(struct sim_rti_s *r, int sa, unsigned short w) {
+
+	if (sa == SA_CLEAR_CSR) {
+		r->csr &= ~w;
+		if (w & CSR_TB)
+			r->str &= ~STR_TB;
+		return;
+	}
+	r->csr |= w;
+	if (w & CSR_RTP)
+		r->txp = 0;
+	if (w & CSR_RRP)
+		r->rxp = 0;
+	if (w & CSR_RB)
+		r->str |= STR_RB;
+}
+
+/**
+ * One frame, rxbuf gets the status word then the data, *rx_wc the
+ * words in it. Returns zero or errno.
+ */
+
+static int frame(int bc, int rti, int wc, int sa, int tr,
+		 unsigned short *txbuf, unsigned short *rxbuf, int *rx_wc) {
+
+	struct sim_rti_s *r;
+	int i;
+
+	*rx_wc = 0;
+	if ((bc < 0) || (bc >= SIM_BCS) || (rti < 1) || (rti > RTI_BROADCAST))
+		return EINVAL;
+	__atomic_add_fetch(&sim_frames, 1, __ATOMIC_RELAXED);
+
+	if (rti == RTI_BROADCAST) {
+		__atomic_add_fetch(&sim_bcasts, 1, __ATOMIC_RELAXED);
+		for (i=1; i<RTI_BROADCAST; i++)
+			if (sim_rti[bc][i].up && (tr == TR_WRITE) && (sa == SA_SET_CSR || sa == SA_CLEAR_CSR))
+				write_csr(&sim_rti[bc][i], sa, txbuf[0]);
+		return 0;
+	}
+
+	r = &sim_rti[bc][rti];
+	if (!r->up) {
+		__atomic_and_fetch(&up_rtis[bc], ~(1U << rti), __ATOMIC_RELAXED);
+		return ETIME;           /* As read_reply, nobody answered */
+	}
+	__atomic_or_fetch(&up_rtis[bc], 1U << rti, __ATOMIC_RELAXED);
+
+	rxbuf[0] = r->str | (rti << STR_RTI_SHIFT);
+	*rx_wc = 1;
+	if ((sa == 0) || (sa == SA_MODE))
+		return 0;
+
+	if (tr == TR_WRITE) {
+		switch (sa) {
+			case SA_SET_CSR:
+			case SA_CLEAR_CSR:
+				write_csr(r, sa, txbuf[0]);
+			break;
+
+			case SA_RXBUF:
+				for (i=0; i<wc && r->rxp<SIM_BUF; i++)
+					r->rxbuf[r->rxp++] = txbuf[i];
+			break;
+
+			case SA_TXBUF:
+				for (i=0; i<wc && r->txp<SIM_BUF; i++)
+					r->txbuf[r->txp++] = txbuf[i];
+			break;
+		}
+		return 0;
+	}
+
+	for (i=1; i<=wc; i++) {
+		switch (sa) {
+			case SA_CSR:
+				rxbuf[i] = r->csr;
+			break;
+
+			case SA_TXBUF:
+				rxbuf[i] = (r->txp < SIM_BUF) ? r->txbuf[r->txp++] : 0;
+			break;
+
+			case SA_RXBUF:
+				rxbuf[i] = (r->rxp < SIM_BUF) ? r->rxbuf[r->rxp++] : 0;
+			break;
+
+			case SA_SIGNATURE:
+				rxbuf[i] = 0xFFFD;
+			break;
+
+			default:
+				rxbuf[i] = 0;
+			break;
+		}
+	}
+	*rx_wc = wc + 1;
+	if (r->reply_wc && (r->reply_wc < *rx_wc))
+		*rx_wc = r->reply_wc;
+	return 0;
+}
+
+/* ===================================== */
+
+static int do_xfer(struct mil1553_xfer_s *x) {
+
+	unsigned short txbuf[TX_BUF_SIZE], rxbuf[RX_BUF_SIZE];
+	unsigned short *utx = (unsigned short *) (unsigned long) x->txbuf;
+	unsigned short *urx = (unsigned short *) (unsigned long) x->rxbuf;
+	int cc, rx_wc;
+
+	memset(txbuf, 0, sizeof(txbuf));
+	if (utx && (x->tr == TR_WRITE))
+		memcpy(txbuf, utx, x->wc * sizeof(short));
+	cc = frame(x->bc, x->rti, x->wc, x->sa, x->tr, txbuf, rxbuf, &rx_wc);
+	x->received_wc = 0;
+	if (!(x->flags & XFER_REPLY))
+		return 0;               /* The driver doesn't read a reply to miss */
+	if (cc)
+		return cc;
+	if (urx)
+		memcpy(urx, rxbuf, rx_wc * sizeof(short));
+	x->received_wc = rx_wc;
+	return 0;
+}
+
+static int do_send(struct mil1553_send_s *send) {
+
+	struct mil1553_tx_item_s *item;
+	struct mil1553_rti_interrupt_s *evt;
+	unsigned int i;
+	int wc, sa, tr, rx_wc;
+
+	evt_late = sim_late ? evt_wp : evt_rp;          /* Last SEND's events show now */
+	for (i=0; i<send->item_count; i++) {
+		item = &send->tx_item_array[i];
+		wc = (item->txreg & TXREG_WC_MASK) >> TXREG_WC_SHIFT;
+		sa = (item->txreg & TXREG_SUBA_MASK) >> TXREG_SUBA_SHIFT;
+		tr = (item->txreg & TXREG_TR_MASK) >> TXREG_TR_SHIFT;
+		if ((wc == 0) && (sa != 0) && (sa != SA_MODE))
+			wc = TX_BUF_SIZE;
+
+		evt = &events[evt_wp % SIM_EVENTS];
+		memset(evt, 0, sizeof(*evt));
+		evt->status = frame(item->bc, item->rti_number, wc, sa, tr,
+				    item->txbuf, evt->rxbuf, &rx_wc);
+		if (item->no_reply)
+			continue;
+		evt->bc         = item->bc;
+		evt->rti_number = item->rti_number;
+		evt->wc         = rx_wc;
+		evt->str        = evt->rxbuf[0];
+		evt_wp++;
+	}
+	return 0;
+}
+
+static int do_recv(struct mil1553_recv_s *recv) {
+
+	int last = sim_late ? evt_late : evt_wp;
+
+	if (evt_rp >= last)
+		return ETIME;           /* As recv_client_event */
+	recv->pk_type = TX_END;
+	recv->interrupt = events[evt_rp++ % SIM_EVENTS];
+	return 0;
+}
+
+/* ===================================== */
+
+int ioctl(int fd, unsigned long cmd, ...) {
+
+	struct mil1553_rti_gen_s *gen;
+	struct mil1553_bc_stats_s *stats;
+	unsigned long *reg;
+	va_list ap;
+	void *arg;
+	int i, cc;
+
+	va_start(ap, cmd);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+
+	switch (cmd) {
+		case MIL1553_XFER:
+			cc = do_xfer(arg);
+		break;
+
+		case MIL1553_SEND:
+			cc = do_send(arg);
+		break;
+
+		case MIL1553_RECV:
+			cc = do_recv(arg);
+		break;
+
+		case MIL1553_GET_UP_RTIS:
+			reg = arg;
+			if (*reg >= SIM_BCS) {
+				cc = EINVAL;
+				break;
+			}
+			for (i=1, cc=*reg, *reg=0; i<RTI_BROADCAST; i++)
+				if (sim_rti[cc][i].up)
+					*reg |= 1 << i;
+			up_rtis[cc] = *reg;
+			cc = 0;
+		break;
+
+		case MIL1553_GET_BC_STATS:
+			stats = arg;
+			if ((stats->version != MIL1553_BC_STATS_VERSION) || (stats->bc >= SIM_BCS)) {
+				cc = EINVAL;
+				break;
+			}
+			stats->up_rtis = up_rtis[stats->bc];
+			stats->bcast_frames = sim_bcasts;
+			cc = 0;
+		break;
+
+		case MIL1553_GET_RTI_GEN:
+			gen = arg;
+			gen->gen = 0;
+			cc = 0;
+		break;
+
+		default:
+			cc = ENOTTY;
+		break;
+	}
+	if (cc) {
+		errno = cc;
+		return -1;
+	}
+	return 0;
+}
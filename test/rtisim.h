@@ -0,0 +1,41 @@
+#ifndef _RTISIM_H
+#define _RTISIM_H
+
+/**
+ * Simulated bus for test programs. Linking rtisim.o replaces ioctl(2)
+ * so librti talks to RTIs kept in memory instead of /dev/mil1553:
+ * MIL1553_XFER, MIL1553_SEND/RECV, GET_UP_RTIS, GET_RTI_GEN and
+ * GET_BC_STATS are served, a frame to an RTI that is not up times out.
+ * The up mask GET_BC_STATS returns follows frames and GET_UP_RTIS scans,
+ * as in the driver.
+ *
+ * Each RTI has a CSR, a status word and its TXBUF/RXBUF with their
+ * pointers, which data frames move and RTP/RRP reset. Setting RB marks
+ * the RXBUF busy, clearing TB frees the TXBUF.
+ *
+ * Only reads with MIL1553_XFER may come from several threads at once.
+ */
+
+#define SIM_BCS 4
+#define SIM_BUF 256
+
+struct sim_rti_s {
+	int up;
+	unsigned short csr;
+	unsigned short str;
+	unsigned short txbuf[SIM_BUF];      /** What the equipment sends */
+	unsigned short rxbuf[SIM_BUF];      /** What the equipment received */
+	int txp, rxp;                       /** Buffer pointers */
+	int reply_wc;                       /** If set, replies are cut to this many words */
+};
+
+extern struct sim_rti_s sim_rti[SIM_BCS][32];
+
+extern unsigned long sim_frames;        /** Frames done */
+extern unsigned long sim_bcasts;        /** Of which broadcasts */
+extern int sim_late;                    /** TX_END events of a SEND come after the next SEND */
+
+int sim_open(void);
+void sim_reset(void);
+
+#endif
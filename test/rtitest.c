@@ -0,0 +1,360 @@
+/**
+ * librti against the simulated bus of rtisim.c
+ *
+ * rtitest [-v]
+ *
+ * Each test sets up the simulated RTIs, drives librti and checks what
+ * the RTIs and the caller end up with. Exits non zero if one fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include <mil1553.h>
+#include <librti.h>
+
+#include "rtisim.h"
+
+static char git_version[] __attribute__((used)) = GIT_VERSION;
+
+static int fn, verbose = 0;
+
+#define CHECK(cond) do {                                                \
+	if (!(cond)) {                                                  \
+		printf("rtitest: %s:%d: %s\n", __func__, __LINE__, #cond); \
+		errs++;                                                 \
+	}                                                               \
+} while (0)
+
+/* ===================================== */
+
+/**
+ * Each equipment message resets the buffer pointer: two receives of the
+ * same TXBUF give the same data, two sends land at the start of RXBUF.
+ */
+
+static int test_eqp_repeat(void) {
+
+	unsigned short rxbuf[RX_BUF_SIZE], txbuf[TX_BUF_SIZE];
+	struct sim_rti_s *r;
+	int i, n, errs = 0;
+
+	sim_reset();
+	r = &sim_rti[1][5];
+	r->up = 1;
+	for (i=0; i<SIM_BUF; i++)
+		r->txbuf[i] = 0x5000 + i;
+
+	for (n=0; n<2; n++) {
+		r->str |= STR_TB;
+		memset(rxbuf, 0, sizeof(rxbuf));
+		CHECK(rtilib_recv_eqp(fn,1,5,8,rxbuf) == 0);
+		for (i=0; i<8; i++)
+			CHECK(rxbuf[1+i] == 0x5000 + i);
+	}
+
+	for (i=0; i<8; i++)
+		txbuf[i] = 0x6000 + i;
+	for (n=0; n<2; n++) {
+		r->str &= ~STR_RB;
+		CHECK(rtilib_send_eqp(fn,1,5,8,txbuf) == 0);
+		CHECK(r->rxp == 8);
+		for (i=0; i<8; i++)
+			CHECK(r->rxbuf[i] == 0x6000 + i);
+	}
+	return errs;
+}
+
+/* ===================================== */
+
+/**
+ * A broadcast commit must not set RB on an RTI that nobody staged and
+ * that the driver has seen up, either at a scan or answering a frame.
+ * The decision costs no bus time: a broadcast commit is one frame.
+ */
+
+static int stage_two(unsigned short *txbuf) {
+
+	int rti, errs = 0;
+
+	for (rti=1; rti<=2; rti++) {
+		sim_rti[1][rti].str &= ~STR_RB;
+		CHECK(rtilib_stage_eqp(fn,1,rti,4,txbuf) == 0);
+	}
+	return errs;
+}
+
+static int test_commit_new_rti(void) {
+
+	unsigned short txbuf[4] = { 1, 2, 3, 4 }, str;
+	unsigned int failed;
+	unsigned long bcasts, frames, up;
+	int rti, errs = 0;
+
+	sim_reset();
+	for (rti=1; rti<=2; rti++)
+		sim_rti[1][rti].up = 1;
+	errs += stage_two(txbuf);
+	frames = sim_frames;
+	CHECK(rtilib_commit_eqp(fn,1,0x6,&failed) == 0);
+	CHECK(sim_frames == frames + 1);
+	CHECK(sim_bcasts == 1);
+	for (rti=1; rti<=2; rti++)
+		CHECK(sim_rti[1][rti].str & STR_RB);
+
+	/* RTI 3 answers a frame, the commit goes one RTI at a time */
+
+	sim_rti[1][3].up = 1;
+	CHECK(rtilib_read_str(fn,1,3,&str) == 0);
+	errs += stage_two(txbuf);
+	bcasts = sim_bcasts;
+	CHECK(rtilib_commit_eqp(fn,1,0x6,&failed) == 0);
+	CHECK(failed == 0);
+	CHECK(sim_bcasts == bcasts);
+	CHECK((sim_rti[1][3].csr & CSR_RB) == 0);
+	for (rti=1; rti<=2; rti++)
+		CHECK(sim_rti[1][rti].str & STR_RB);
+
+	/* RTI 3 stops answering, broadcasts are back */
+
+	sim_rti[1][3].up = 0;
+	CHECK(rtilib_read_str(fn,1,3,&str) != 0);
+	errs += stage_two(txbuf);
+	CHECK(rtilib_commit_eqp(fn,1,0x6,&failed) == 0);
+	CHECK(sim_bcasts == bcasts + 1);
+
+	/* RTI 4 is found by a scan */
+
+	sim_rti[1][4].up = 1;
+	up = 1;
+	CHECK(ioctl(fn,MIL1553_GET_UP_RTIS,&up) == 0);
+	errs += stage_two(txbuf);
+	CHECK(rtilib_commit_eqp(fn,1,0x6,&failed) == 0);
+	CHECK(sim_bcasts == bcasts + 1);
+	CHECK((sim_rti[1][4].csr & CSR_RB) == 0);
+	return errs;
+}
+
+/* ===================================== */
+
+/**
+ * The TX_END events of a batch that timed out come later and must not
+ * be taken for those of the next batch.
+ */
+
+static void sig_items(struct mil1553_tx_item_s *items, int n, int rti) {
+
+	int i;
+
+	memset(items, 0, n * sizeof(*items));
+	for (i=0; i<n; i++) {
+		items[i].bc         = 1;
+		items[i].rti_number = rti;
+		items[i].txreg      = RTI_CMD_TXREG(RTI_CMD(1,SA_SIGNATURE,TR_READ),rti);
+	}
+}
+
+static int test_batch_late(void) {
+
+	struct mil1553_tx_item_s items[2];
+	struct mil1553_rti_interrupt_s ends[2];
+	struct mil1553_recv_s recv;
+	int i, n, rti, errs = 0;
+
+	sim_reset();
+	for (rti=5; rti<=6; rti++)
+		sim_rti[1][rti].up = 1;
+
+	sim_late = 1;
+	sig_items(items,2,5);
+	CHECK(rtilib_send_batch(fn,items,2,ends) == ETIME);
+
+	sim_late = 0;
+	for (n=0; n<2; n++) {
+		sig_items(items,2,6);
+		memset(ends, 0, sizeof(ends));
+		CHECK(rtilib_send_batch(fn,items,2,ends) == 0);
+		for (i=0; i<2; i++)
+			CHECK(ends[i].rti_number == 6);
+	}
+
+	/* Nothing left over for the next caller */
+
+	memset(&recv, 0, sizeof(recv));
+	CHECK((ioctl(fn,MIL1553_RECV,&recv) < 0) && (errno == ETIME));
+	return errs;
+}
+
+/* ===================================== */
+
+/**
+ * Threads capturing at the same time each get their own records, all
+ * of them whole, and a timeout keeps its errno.
+ */
+
+#define CAP_THREADS 4
+#define CAP_FRAMES  2000
+
+static void *capture_thread(void *arg) {
+
+	unsigned short rxbuf[RX_BUF_SIZE];
+	long rti = (long) arg;
+	int i;
+
+	for (i=0; i<CAP_FRAMES; i++)
+		rtilib_send_receive(fn,1,rti,1,SA_SIGNATURE,TR_READ,REPLY,rxbuf,NULL);
+	return NULL;
+}
+
+static int test_capture_threads(void) {
+
+	char path[] = "/tmp/rtitest.capXXXXXX";
+	struct rti_capture_hdr_s *hdr;
+	struct rti_capture_rec_s *recs;
+	pthread_t threads[CAP_THREADS];
+	unsigned short rxbuf[RX_BUF_SIZE];
+	unsigned int counts[CAP_THREADS+1];
+	unsigned long long len;
+	int i, rti, fd, errs = 0;
+	void *map;
+
+	sim_reset();
+	for (rti=1; rti<=CAP_THREADS; rti++)
+		sim_rti[1][rti].up = 1;
+	fd = mkstemp(path);
+	CHECK(fd >= 0);
+	if (fd < 0)
+		return errs;
+	close(fd);
+	CHECK(rtilib_capture_start(path,CAP_THREADS * CAP_FRAMES + 1) == 0);
+
+	for (rti=1; rti<=CAP_THREADS; rti++)
+		pthread_create(&threads[rti-1], NULL, capture_thread, (void *) (long) rti);
+	for (rti=1; rti<=CAP_THREADS; rti++)
+		pthread_join(threads[rti-1], NULL);
+	CHECK(rtilib_send_receive(fn,1,CAP_THREADS+1,1,SA_SIGNATURE,TR_READ,REPLY,rxbuf,NULL) == ETIME);
+	rtilib_capture_stop();
+
+	len = sizeof(*hdr) + (CAP_THREADS * CAP_FRAMES + 1ULL) * sizeof(*recs);
+	fd = open(path, O_RDONLY);
+	map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	unlink(path);
+	CHECK(map != MAP_FAILED);
+	if (map == MAP_FAILED)
+		return errs;
+	hdr  = map;
+	recs = (struct rti_capture_rec_s *) (hdr + 1);
+
+	CHECK(hdr->head == CAP_THREADS * CAP_FRAMES + 1);
+	memset(counts, 0, sizeof(counts));
+	for (i=0; i<hdr->head; i++) {
+		CHECK(recs[i].seq == i + 1);
+		rti = (recs[i].txreg & TXREG_RTI_MASK) >> TXREG_RTI_SHIFT;
+		if ((rti >= 1) && (rti <= CAP_THREADS + 1))
+			counts[rti-1]++;
+	}
+	for (rti=1; rti<=CAP_THREADS; rti++)
+		CHECK(counts[rti-1] == CAP_FRAMES);
+	CHECK(recs[hdr->head-1].status == ETIME);
+	munmap(map, len);
+	return errs;
+}
+
+/**
+ * A capture records the reply as it came: an RTI answering fewer words
+ * than asked gives a record with only those.
+ */
+
+static int test_capture_short(void) {
+
+	char path[] = "/tmp/rtitest.capXXXXXX";
+	struct rti_capture_hdr_s *hdr;
+	struct rti_capture_rec_s *recs;
+	unsigned short rxbuf[RX_BUF_SIZE];
+	unsigned long long len;
+	int fd, errs = 0;
+	void *map;
+
+	sim_reset();
+	sim_rti[1][7].up = 1;
+	sim_rti[1][7].reply_wc = 2;
+	fd = mkstemp(path);
+	CHECK(fd >= 0);
+	if (fd < 0)
+		return errs;
+	close(fd);
+	CHECK(rtilib_capture_start(path,2) == 0);
+	CHECK(rtilib_send_receive(fn,1,7,4,SA_SIGNATURE,TR_READ,REPLY,rxbuf,NULL) == 0);
+	sim_rti[1][7].reply_wc = 0;
+	CHECK(rtilib_send_receive(fn,1,7,4,SA_SIGNATURE,TR_READ,REPLY,rxbuf,NULL) == 0);
+	rtilib_capture_stop();
+
+	len = sizeof(*hdr) + 2 * sizeof(*recs);
+	fd = open(path, O_RDONLY);
+	map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	unlink(path);
+	CHECK(map != MAP_FAILED);
+	if (map == MAP_FAILED)
+		return errs;
+	hdr  = map;
+	recs = (struct rti_capture_rec_s *) (hdr + 1);
+
+	CHECK(hdr->head == 2);
+	CHECK(recs[0].rx_wc == 2);
+	CHECK(recs[0].rxbuf[1] == 0xFFFD);
+	CHECK(recs[1].rx_wc == 5);
+	munmap(map, len);
+	return errs;
+}
+
+/* ===================================== */
+
+static struct {
+	char *name;
+	int (*test)(void);
+} tests[] = {
+	{ "eqp_repeat", test_eqp_repeat },
+	{ "commit_new_rti", test_commit_new_rti },
+	{ "batch_late", test_batch_late },
+	{ "capture_threads", test_capture_threads },
+	{ "capture_short", test_capture_short },
+};
+
+int main(int argc, char *argv[]) {
+
+	int i, errs, failed = 0;
+
+	for (i=1; i<argc; i++) {
+		if (strcmp(argv[i], "-v") == 0)
+			verbose = 1;
+		else {
+			fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+			exit(1);
+		}
+	}
+
+	fn = sim_open();
+	if (fn < 0) {
+		perror("rtitest: sim_open");
+		exit(1);
+	}
+	for (i=0; i<sizeof(tests)/sizeof(tests[0]); i++) {
+		errs = tests[i].test();
+		if (errs || verbose)
+			printf("rtitest: %s %s\n", tests[i].name, errs ? "FAILED" : "ok");
+		if (errs)
+			failed++;
+	}
+	printf("rtitest: %d tests, %d failed\n", i, failed);
+	close(fn);
+	return failed ? 1 : 0;
+}
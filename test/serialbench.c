@@ -0,0 +1,322 @@
+/**
+ * Power supply message serializers, table generated against the old ones
+ *
+ * serialbench [-n loops]
+ *
+ * The serialize_xxx_msg functions of libquick-serial are generated from
+ * the layout tables in pow_messages_serial.h. Here they are checked
+ * against the hand written routines they replaced, kept below as ref_xxx:
+ * random raw messages of each type are serialized both ways and every
+ * field compared, then serialized again to check they come back as they
+ * were. Then both are timed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libquick-serial.h>
+
+extern int mil1553_old_power_supply;
+
+static char git_version[] __attribute__((used)) = GIT_VERSION;
+
+static double now_s(void) {
+
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fill_random(void *p, int size) {
+
+	unsigned char *cp = p;
+	int i;
+
+	for (i=0; i<size; i++)
+		cp[i] = rand();
+}
+
+/* ===================================== */
+
+/* The serializers as they were before the layout tables, not inlined */
+/* so both sides pay a call as the library ones do */
+
+static void FloatWordSwap(float *f) {
+
+	unsigned short *wp, w;
+	wp = (unsigned short *) f;
+	w = *wp;
+	*wp = wp[1];
+	wp[1] = w;
+}
+
+static void FieldSwap(unsigned char *cp) {
+
+	char c = *cp;
+	*cp = cp[1];
+	cp[1] = c;
+}
+
+static void IntWordSwap(int *ip) {
+
+	unsigned int l, r;
+
+	r = (*ip & 0xFFFF0000) >> 16;
+	l = (*ip & 0x0000FFFF) << 16;
+	*ip = l | r;
+}
+
+static float FloatByteSwap(float f) {
+
+	union {
+		float f;
+		unsigned char b[4];
+	} dat1, dat2;
+
+	dat1.f = f;
+	dat2.b[0] = dat1.b[1];
+	dat2.b[1] = dat1.b[0];
+	dat2.b[2] = dat1.b[3];
+	dat2.b[3] = dat1.b[2];
+	return dat2.f;
+}
+
+static __attribute__((noinline)) void ref_req(req_msg *req_p) {
+
+	FieldSwap((unsigned char *) &req_p->type);
+	IntWordSwap(&req_p->protocol_date.sec);
+	IntWordSwap(&req_p->protocol_date.usec);
+}
+
+static __attribute__((noinline)) void ref_read_ctrl(ctrl_msg *ctrl_p) {
+
+	FieldSwap((unsigned char *) &ctrl_p->ccsact_change);
+	if (mil1553_old_power_supply) {
+		ctrl_p->ccv  = FloatByteSwap(ctrl_p->ccv);
+		ctrl_p->ccv1 = FloatByteSwap(ctrl_p->ccv1);
+		ctrl_p->ccv2 = FloatByteSwap(ctrl_p->ccv2);
+		ctrl_p->ccv3 = FloatByteSwap(ctrl_p->ccv3);
+	} else {
+		FloatWordSwap(&ctrl_p->ccv);
+		FloatWordSwap(&ctrl_p->ccv1);
+		FloatWordSwap(&ctrl_p->ccv2);
+		FloatWordSwap(&ctrl_p->ccv3);
+	}
+	FieldSwap((unsigned char *) &ctrl_p->ccv_change);
+	FieldSwap((unsigned char *) &ctrl_p->ccv2_change);
+}
+
+static __attribute__((noinline)) void ref_write_ctrl(ctrl_msg *ctrl_p) {
+
+	FieldSwap((unsigned char *) &ctrl_p->ccsact_change);
+	FloatWordSwap(&ctrl_p->ccv);
+	FloatWordSwap(&ctrl_p->ccv1);
+	FloatWordSwap(&ctrl_p->ccv2);
+	FloatWordSwap(&ctrl_p->ccv3);
+	FieldSwap((unsigned char *) &ctrl_p->ccv_change);
+	FieldSwap((unsigned char *) &ctrl_p->ccv2_change);
+}
+
+static __attribute__((noinline)) void ref_acq(acq_msg *acq_p) {
+
+	FieldSwap((unsigned char *) &acq_p->phys_status);
+	FieldSwap((unsigned char *) &acq_p->ext_aspect);
+	FloatWordSwap(&acq_p->aqn);
+	FloatWordSwap(&acq_p->aqn1);
+	FloatWordSwap(&acq_p->aqn2);
+	FloatWordSwap(&acq_p->aqn3);
+}
+
+static __attribute__((noinline)) void ref_conf(conf_msg *conf_p) {
+
+	FloatWordSwap(&conf_p->i_nominal);
+	FloatWordSwap(&conf_p->resolution);
+	FloatWordSwap(&conf_p->i_max);
+	FloatWordSwap(&conf_p->i_min);
+	FloatWordSwap(&conf_p->di_dt);
+	FloatWordSwap(&conf_p->mode);
+}
+
+/* ===================================== */
+
+static int errors;
+
+/* Fields of a and b compared as C types, floats bitwise */
+
+#define CHECK(msg, name, field, ctype, kind) {                          \
+	if (memcmp(&a->field, &b->field, sizeof(ctype))) {              \
+		printf("serialbench: " #msg "." #name " %s differs\n", what); \
+		errors++;                                               \
+	}                                                               \
+}
+
+#define CHECK_CTRL(name, field, ctype, kind) CHECK(ctrl_msg, name, field, ctype, kind)
+#define CHECK_ACQ(name, field, ctype, kind)  CHECK(acq_msg,  name, field, ctype, kind)
+#define CHECK_CONF(name, field, ctype, kind) CHECK(conf_msg, name, field, ctype, kind)
+
+static void compare_ctrl(const char *what, ctrl_msg *a, ctrl_msg *b) {
+
+	REQ_MSG_VIEW(CHECK_CTRL)
+	CTRL_MSG_VIEW(CHECK_CTRL)
+}
+
+static void compare_acq(const char *what, acq_msg *a, acq_msg *b) {
+
+	REQ_MSG_VIEW(CHECK_ACQ)
+	ACQ_MSG_VIEW(CHECK_ACQ)
+}
+
+static void compare_conf(const char *what, conf_msg *a, conf_msg *b) {
+
+	REQ_MSG_VIEW(CHECK_CONF)
+	CONF_MSG_VIEW(CHECK_CONF)
+}
+
+/* Serialize a copy both ways, then serialize again to get raw back */
+
+static void check_ctrl(int read, int old) {
+
+	ctrl_msg raw, ref, msg;
+
+	mil1553_old_power_supply = old;
+	fill_random(&raw, sizeof(raw));
+	ref = msg = raw;
+	ref_req((req_msg *) &ref);
+	serialize_req_msg((req_msg *) &msg);
+	if (read) {
+		ref_read_ctrl(&ref);
+		serialize_read_ctrl_msg(&msg);
+	} else {
+		ref_write_ctrl(&ref);
+		serialize_write_ctrl_msg(&msg);
+	}
+	compare_ctrl(read ? "read" : "write", &ref, &msg);
+
+	serialize_req_msg((req_msg *) &msg);
+	if (read)
+		serialize_read_ctrl_msg(&msg);
+	else
+		serialize_write_ctrl_msg(&msg);
+	compare_ctrl("round trip", &raw, &msg);
+	mil1553_old_power_supply = 0;
+}
+
+static void check_acq(void) {
+
+	acq_msg raw, ref, msg;
+
+	fill_random(&raw, sizeof(raw));
+	ref = msg = raw;
+	ref_req((req_msg *) &ref);
+	ref_acq(&ref);
+	serialize_req_msg((req_msg *) &msg);
+	serialize_acq_msg(&msg);
+	compare_acq("serialize", &ref, &msg);
+
+	serialize_req_msg((req_msg *) &msg);
+	serialize_acq_msg(&msg);
+	compare_acq("round trip", &raw, &msg);
+}
+
+static void check_conf(void) {
+
+	conf_msg raw, ref, msg;
+
+	fill_random(&raw, sizeof(raw));
+	ref = msg = raw;
+	ref_req((req_msg *) &ref);
+	ref_conf(&ref);
+	serialize_req_msg((req_msg *) &msg);
+	serialize_conf_msg(&msg);
+	compare_conf("serialize", &ref, &msg);
+
+	serialize_req_msg((req_msg *) &msg);
+	serialize_conf_msg(&msg);
+	compare_conf("round trip", &raw, &msg);
+}
+
+/* ===================================== */
+
+#define MSGS 64
+
+static ctrl_msg ctrls[MSGS];
+static acq_msg  acqs[MSGS];
+static conf_msg confs[MSGS];
+
+/* ns per message of n loops over the MSGS messages of each type */
+
+static double time_ref(int loops) {
+
+	double t0 = now_s();
+	int i, j;
+
+	for (i=0; i<loops; i++) {
+		for (j=0; j<MSGS; j++) {
+			ref_req((req_msg *) &ctrls[j]);
+			ref_write_ctrl(&ctrls[j]);
+			ref_req((req_msg *) &acqs[j]);
+			ref_acq(&acqs[j]);
+			ref_req((req_msg *) &confs[j]);
+			ref_conf(&confs[j]);
+		}
+	}
+	return (now_s() - t0) * 1e9 / (3.0 * loops * MSGS);
+}
+
+static double time_new(int loops) {
+
+	double t0 = now_s();
+	int i, j;
+
+	for (i=0; i<loops; i++) {
+		for (j=0; j<MSGS; j++) {
+			serialize_req_msg((req_msg *) &ctrls[j]);
+			serialize_write_ctrl_msg(&ctrls[j]);
+			serialize_req_msg((req_msg *) &acqs[j]);
+			serialize_acq_msg(&acqs[j]);
+			serialize_req_msg((req_msg *) &confs[j]);
+			serialize_conf_msg(&confs[j]);
+		}
+	}
+	return (now_s() - t0) * 1e9 / (3.0 * loops * MSGS);
+}
+
+int main(int argc, char *argv[]) {
+
+	double ref, gen;
+	int i, loops = 100000;
+
+	for (i=1; i<argc; i++) {
+		if ((strcmp(argv[i], "-n") == 0) && (i+1 < argc))
+			loops = atoi(argv[++i]);
+		else {
+			fprintf(stderr, "usage: %s [-n loops]\n", argv[0]);
+			exit(1);
+		}
+	}
+
+	for (i=0; i<1000; i++) {
+		check_ctrl(0, 0);
+		check_ctrl(1, 0);
+		check_ctrl(1, 1);
+		check_acq();
+		check_conf();
+	}
+	if (errors) {
+		printf("serialbench: %d errors, generated and old serializers disagree\n", errors);
+		exit(1);
+	}
+
+	fill_random(ctrls, sizeof(ctrls));
+	fill_random(acqs, sizeof(acqs));
+	fill_random(confs, sizeof(confs));
+	ref = time_ref(loops);
+	gen = time_new(loops);
+
+	printf("serialbench: %d loops x %d messages of each type, fields checked\n", loops, MSGS);
+	printf("  old %.1f ns/msg, generated %.1f ns/msg\n", ref, gen);
+	return 0;
+}
@@ -0,0 +1,183 @@
+/**
+ * Decode cost of acquisition messages, full serialize against field views
+ *
+ * viewbench [-n loops] [-m messages]
+ *
+ * Each loop decodes aqn and phys_status from m raw acquisition packets,
+ * once by serializing a copy of the whole message as mil1553_get_quick_data
+ * does, once with the pow_messages_view.h accessors. Before timing, every
+ * field of every message type is checked to read the same both ways.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libquick-serial.h>
+#include <pow_messages_view.h>
+
+static char git_version[] __attribute__((used)) = GIT_VERSION;
+
+#define MAX_MSGS 1024
+
+static double now_s(void) {
+
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fill_random(void *p, int size) {
+
+	unsigned char *cp = p;
+	int i;
+
+	for (i=0; i<size; i++)
+		cp[i] = rand();
+}
+
+/* ===================================== */
+
+static int errors;
+
+#define CHECK(msg, name, field, ctype, kind) {                          \
+	ctype v = msg##_get_##name(raw);                                \
+	if (memcmp(&v, &native.field, sizeof(v))) {                     \
+		printf("viewbench: " #msg "." #name " differs\n");      \
+		errors++;                                               \
+	}                                                               \
+}
+
+#define CHECK_CTRL(name, field, ctype, kind) CHECK(ctrl_msg, name, field, ctype, kind)
+#define CHECK_ACQ(name, field, ctype, kind)  CHECK(acq_msg,  name, field, ctype, kind)
+#define CHECK_CONF(name, field, ctype, kind) CHECK(conf_msg, name, field, ctype, kind)
+
+static void check_ctrl(int old) {
+
+	unsigned char raw[sizeof(ctrl_msg)];
+	ctrl_msg native;
+
+	mil1553_old_power_supply = old;
+	fill_random(raw, sizeof(raw));
+	memcpy(&native, raw, sizeof(native));
+	serialize_req_msg((req_msg *) &native);
+	serialize_read_ctrl_msg(&native);
+	REQ_MSG_VIEW(CHECK_CTRL)
+	CTRL_MSG_VIEW(CHECK_CTRL)
+	mil1553_old_power_supply = 0;
+}
+
+static void check_acq(void) {
+
+	unsigned char raw[sizeof(acq_msg)];
+	acq_msg native;
+
+	fill_random(raw, sizeof(raw));
+	memcpy(&native, raw, sizeof(native));
+	serialize_req_msg((req_msg *) &native);
+	serialize_acq_msg(&native);
+	REQ_MSG_VIEW(CHECK_ACQ)
+	ACQ_MSG_VIEW(CHECK_ACQ)
+}
+
+static void check_conf(void) {
+
+	unsigned char raw[sizeof(conf_msg)];
+	conf_msg native;
+
+	fill_random(raw, sizeof(raw));
+	memcpy(&native, raw, sizeof(native));
+	serialize_req_msg((req_msg *) &native);
+	serialize_conf_msg(&native);
+	REQ_MSG_VIEW(CHECK_CONF)
+	CONF_MSG_VIEW(CHECK_CONF)
+}
+
+/* Setters must give back the raw packet the getters read */
+
+#define ROUND_TRIP(msg, name, field, ctype, kind)                       \
+	msg##_set_##name(copy, msg##_get_##name(raw));
+
+#define ROUND_TRIP_ACQ(name, field, ctype, kind) ROUND_TRIP(acq_msg, name, field, ctype, kind)
+
+static void check_set(void) {
+
+	unsigned char raw[sizeof(acq_msg)], copy[sizeof(acq_msg)];
+
+	fill_random(raw, sizeof(raw));
+	memset(copy, 0, sizeof(copy));
+	REQ_MSG_VIEW(ROUND_TRIP_ACQ)
+	ACQ_MSG_VIEW(ROUND_TRIP_ACQ)
+	if (memcmp(raw, copy, sizeof(raw))) {
+		printf("viewbench: acq_msg setters differ\n");
+		errors++;
+	}
+}
+
+/* ===================================== */
+
+static acq_msg raws[MAX_MSGS];
+
+int main(int argc, char *argv[]) {
+
+	acq_msg native;
+	double t0, full, view, sum;
+	volatile double sink;
+	int i, j, loops = 100000, msgs = 64;
+
+	for (i=1; i<argc; i++) {
+		if ((strcmp(argv[i], "-n") == 0) && (i+1 < argc))
+			loops = atoi(argv[++i]);
+		else if ((strcmp(argv[i], "-m") == 0) && (i+1 < argc))
+			msgs = atoi(argv[++i]);
+		else {
+			fprintf(stderr, "usage: %s [-n loops] [-m messages]\n", argv[0]);
+			exit(1);
+		}
+	}
+	if ((msgs < 1) || (msgs > MAX_MSGS))
+		msgs = MAX_MSGS;
+
+	for (i=0; i<1000; i++) {
+		check_ctrl(i & 1);
+		check_acq();
+		check_conf();
+		check_set();
+	}
+	if (errors) {
+		printf("viewbench: %d errors, views and serialize disagree\n", errors);
+		exit(1);
+	}
+
+	fill_random(raws, sizeof(raws));
+
+	sum = 0;
+	t0 = now_s();
+	for (i=0; i<loops; i++) {
+		for (j=0; j<msgs; j++) {
+			memcpy(&native, &raws[j], sizeof(native));
+			serialize_req_msg((req_msg *) &native);
+			serialize_acq_msg(&native);
+			sum += native.aqn + native.phys_status;
+		}
+	}
+	full = now_s() - t0;
+	sink = sum;
+
+	sum = 0;
+	t0 = now_s();
+	for (i=0; i<loops; i++)
+		for (j=0; j<msgs; j++)
+			sum += acq_msg_get_aqn(&raws[j]) + acq_msg_get_phys_status(&raws[j]);
+	view = now_s() - t0;
+	sink += sum;
+
+	printf("viewbench: %d loops x %d acq messages, fields checked\n", loops, msgs);
+	printf("  serialize %.1f ns/msg, view %.1f ns/msg\n",
+	       full * 1e9 / ((double) loops * msgs),
+	       view * 1e9 / ((double) loops * msgs));
+	(void) sink;
+	return 0;
+}